@@ -70,6 +70,19 @@ static void rr_game_validate_loadout(struct rr_game *this)
     }
 }
 
+static void read_account_cells(struct proto_bug *decoder,
+                               uint32_t (*cells)[rr_rarity_id_max],
+                               uint8_t id_offset)
+{
+    uint8_t id;
+    while ((id = proto_bug_read_uint8(decoder, "id")))
+    {
+        uint8_t rarity = proto_bug_read_uint8(decoder, "rarity");
+        uint32_t count = proto_bug_read_varuint(decoder, "count");
+        cells[id - id_offset][rarity] = count;
+    }
+}
+
 static void rr_game_read_account(struct rr_game *this, struct proto_bug *decoder)
 {
     memset(this->inventory, 0, sizeof this->inventory);
@@ -79,25 +92,18 @@ static void rr_game_read_account(struct rr_game *this, struct proto_bug *decoder
     proto_bug_read_string(decoder, uuid, sizeof this->rivet_account.uuid,
                           "uuid");
     this->cache.experience = proto_bug_read_float64(decoder, "xp");
-    uint8_t id;
-    while ((id = proto_bug_read_uint8(decoder, "id")))
-    {
-        uint8_t rarity = proto_bug_read_uint8(decoder, "rarity");
-        uint32_t count = proto_bug_read_varuint(decoder, "count");
-        this->inventory[id][rarity] = count;
-    }
-    while ((id = proto_bug_read_uint8(decoder, "id")))
-    {
-        uint8_t rarity = proto_bug_read_uint8(decoder, "rarity");
-        uint32_t count = proto_bug_read_varuint(decoder, "count");
-        this->failed_crafts[id][rarity] = count;
-    }
-    while ((id = proto_bug_read_uint8(decoder, "id")))
-    {
-        uint8_t rarity = proto_bug_read_uint8(decoder, "rarity");
-        uint32_t count = proto_bug_read_varuint(decoder, "count");
-        this->cache.mob_kills[id - 1][rarity] = count;
-    }
+    read_account_cells(decoder, this->inventory, 0);
+    read_account_cells(decoder, this->failed_crafts, 0);
+    read_account_cells(decoder, this->cache.mob_kills, 1);
+}
+
+// only the cells that changed, zero counts included
+static void rr_game_read_account_delta(struct rr_game *this,
+                                       struct proto_bug *decoder)
+{
+    read_account_cells(decoder, this->inventory, 0);
+    read_account_cells(decoder, this->failed_crafts, 0);
+    read_account_cells(decoder, this->cache.mob_kills, 1);
 }
 
 uint32_t rr_game_get_adjusted_inventory_count(struct rr_game *this, uint8_t id,
@@ -887,6 +893,7 @@ void rr_game_websocket_on_event_function(enum rr_websocket_event_type type,
         {
         case rr_clientbound_update:
         {
+            uint32_t tick = proto_bug_read_varuint(&encoder, "tick");
             this->socket_error = 0;
             this->joined_squad = 1;
 
@@ -972,7 +979,7 @@ void rr_game_websocket_on_event_function(enum rr_websocket_event_type type,
                     rr_write_dev_cheat_packets(this, 1);
                     this->simulation_ready = 1;
                 }
-                rr_simulation_read_binary(this, &encoder);
+                rr_simulation_read_binary(this, &encoder, tick);
             }
             else
             {
@@ -1015,8 +1022,14 @@ void rr_game_websocket_on_event_function(enum rr_websocket_event_type type,
         {
             this->is_dev = proto_bug_read_uint8(&encoder, "is_dev");
             this->kick_vote_pos = proto_bug_read_uint8(&encoder, "kick vote");
-            for (uint32_t s = 0; s < RR_SQUAD_COUNT; ++s)
+            this->selected_biome = proto_bug_read_uint8(&encoder, "biome");
+            // only the squads that changed since the last dump, index + 1
+            uint8_t s;
+            while ((s = proto_bug_read_uint8(&encoder, "squad")))
             {
+                --s;
+                if (s >= RR_SQUAD_COUNT)
+                    break;
                 struct rr_game_squad *squad = &this->other_squads[s];
                 for (uint32_t i = 0; i < RR_SQUAD_MEMBER_COUNT; ++i)
                 {
@@ -1028,8 +1041,6 @@ void rr_game_websocket_on_event_function(enum rr_websocket_event_type type,
                         proto_bug_read_uint8(&encoder, "ready");
                     squad->squad_members[i].disconnected =
                         proto_bug_read_uint8(&encoder, "disconnected");
-                    squad->squad_members[i].blocked =
-                        proto_bug_read_uint8(&encoder, "blocked");
                     squad->squad_members[i].is_dev =
                         proto_bug_read_uint8(&encoder, "is_dev");
                     uint8_t kick_vote_count =
@@ -1080,7 +1091,9 @@ void rr_game_websocket_on_event_function(enum rr_websocket_event_type type,
                     proto_bug_read_uint8(&encoder, "private");
                 squad->squad_expose_code =
                     proto_bug_read_uint8(&encoder, "expose_code");
-                this->selected_biome = proto_bug_read_uint8(&encoder, "biome");
+                uint8_t blocked = proto_bug_read_uint8(&encoder, "blocked");
+                for (uint32_t i = 0; i < RR_SQUAD_MEMBER_COUNT; ++i)
+                    squad->squad_members[i].blocked = (blocked >> i) & 1;
                 proto_bug_read_string(&encoder, squad->squad_code, 16,
                                       "squad code");
             }
@@ -1196,6 +1209,9 @@ void rr_game_websocket_on_event_function(enum rr_websocket_event_type type,
         case rr_clientbound_account_result:
             rr_game_read_account(this, &encoder);
             break;
+        case rr_clientbound_account_delta:
+            rr_game_read_account_delta(this, &encoder);
+            break;
         case rr_clientbound_craft_result:
         {
             this->crafting_data.crafting_id =
@@ -1515,6 +1531,9 @@ void rr_game_tick(struct rr_game *this, float delta)
     if (this->simulation_ready)
     {
         rr_simulation_tick(this->simulation, this->lerp_delta);
+        // dying entities keep playing out their last snapshots
+        this->deletion_simulation->latest_tick = this->simulation->latest_tick;
+        this->deletion_simulation->render_tick = this->simulation->render_tick;
         rr_deletion_simulation_tick(this->deletion_simulation,
                                     this->lerp_delta);
 
@@ -1629,7 +1648,6 @@ void rr_game_tick(struct rr_game *this, float delta)
         }
 #undef GRID_SIZE
         struct rr_simulation *sim = this->simulation;
-        rr_simulation_create_component_vectors(sim);
         if (rr_frand() < 0.05)
         {
             EntityIdx petal_id = rr_simulation_alloc_entity(sim);
@@ -1681,7 +1699,7 @@ void rr_game_tick(struct rr_game *this, float delta)
         rr_system_particle_render_tick(this, &this->default_particle_manager,
                                        delta);
         struct rr_renderer_context_state state2;
-        for (uint32_t i = 0; i < this->simulation->petal_count; ++i)
+        for (uint32_t i = 0; i < this->simulation->petal_count;)
         {
             struct rr_component_physical *physical = rr_simulation_get_physical(
                 sim, this->simulation->petal_vector[i]);
@@ -1700,11 +1718,14 @@ void rr_game_tick(struct rr_game *this, float delta)
             rr_renderer_context_state_free(this->renderer, &state2);
             if (physical->lerp_x > 1200)
             {
+                // the last petal gets swapped into slot i
                 __rr_simulation_pending_deletion_free_components(
                     this->simulation->petal_vector[i], sim);
                 __rr_simulation_pending_deletion_unset_entity(
                     this->simulation->petal_vector[i], sim);
+                continue;
             }
+            ++i;
         }
         rr_system_particle_render_tick(this, &this->foreground_particle_manager,
                                        delta);
@@ -1836,6 +1857,16 @@ void rr_game_tick(struct rr_game *this, float delta)
             frame_sum * 0.001f / RR_DEBUG_POLL_SIZE, frame_max * 0.001f);
         rr_renderer_stroke_text(this->renderer, debug_mspt, 0, 0);
         rr_renderer_fill_text(this->renderer, debug_mspt, 0, 0);
+        if (this->simulation_ready)
+        {
+            struct rr_simulation *simulation = this->simulation;
+            sprintf(debug_mspt,
+                    "snapshot buffer: %.2f ticks | late updates: %u",
+                    simulation->latest_tick - simulation->render_tick,
+                    simulation->late_updates);
+            rr_renderer_stroke_text(this->renderer, debug_mspt, 0, -14);
+            rr_renderer_fill_text(this->renderer, debug_mspt, 0, -14);
+        }
         sprintf(debug_mspt, "ctx calls: %d", rr_renderer_get_op_size());
         rr_renderer_context_state_free(this->renderer, &state);
         // rr_renderer_stroke_text
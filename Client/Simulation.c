@@ -39,9 +39,15 @@ void rr_simulation_entity_create_with_id(struct rr_simulation *this,
     this->entity_tracker[entity] = 1;
 }
 
-void rr_simulation_read_binary(struct rr_game *game, struct proto_bug *encoder)
+void rr_simulation_read_binary(struct rr_game *game, struct proto_bug *encoder,
+                               uint32_t tick)
 {
     struct rr_simulation *this = game->simulation;
+    if (this->latest_tick == 0)
+        this->render_tick = (double)tick - RR_INTERPOLATION_DELAY_TICKS;
+    else if (this->render_tick > this->latest_tick)
+        ++this->late_updates;
+    this->latest_tick = tick;
     EntityIdx id = 0;
     while (1)
     {
@@ -67,7 +73,11 @@ void rr_simulation_read_binary(struct rr_game *game, struct proto_bug *encoder)
             RR_FOR_EACH_COMPONENT
 #undef XX
             if (rr_simulation_has_physical(del_s, id_2))
-                rr_simulation_get_physical(del_s, id_2)->deletion_type = type;
+            {
+                struct rr_component_physical *physical =
+                    rr_simulation_get_physical(del_s, id_2);
+                physical->deletion_type = type;
+            }
         }
         __rr_simulation_pending_deletion_free_components(id, this);
         __rr_simulation_pending_deletion_unset_entity(id, this);
@@ -107,6 +117,9 @@ void rr_simulation_read_binary(struct rr_game *game, struct proto_bug *encoder)
             rr_simulation_get_##COMPONENT(this, id), encoder);
         RR_FOR_EACH_COMPONENT
 #undef XX
+        if (rr_simulation_has_physical(this, id))
+            rr_component_physical_push_snapshot(
+                rr_simulation_get_physical(this, id), tick);
     }
     game->player_info = rr_simulation_get_player_info(
         this, proto_bug_read_varuint(encoder, "pinfo id"));
@@ -118,7 +131,6 @@ void rr_simulation_read_binary(struct rr_game *game, struct proto_bug *encoder)
 
 void rr_simulation_tick(struct rr_simulation *this, float delta)
 {
-    rr_simulation_create_component_vectors(this);
     rr_system_interpolation_tick(this, delta);
 }
 
@@ -133,7 +145,6 @@ void rr_deletion_simulation_tick(struct rr_simulation *this, float delta)
                                RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT),
                            this, __rr_simulation_pending_deletion_unset_entity);
     memset(this->pending_deletions, 0, RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT));
-    rr_simulation_create_component_vectors(this);
     rr_system_deletion_animation_tick(this, delta);
 }
 
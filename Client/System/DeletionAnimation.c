@@ -18,6 +18,7 @@
 
 #include <math.h>
 
+#include <Client/System/Interpolation.h>
 #include <Shared/Entity.h>
 #include <Shared/SimulationCommon.h>
 #include <Shared/Utilities.h>
@@ -39,6 +40,15 @@ void system_deletion_animation_for_each_function(EntityIdx entity,
     {
         struct rr_component_physical *physical =
             rr_simulation_get_physical(this, entity);
+        if (physical->snapshot_count > 0)
+        {
+            struct rr_physical_snapshot sample;
+            rr_system_interpolation_sample(this, physical, &sample);
+            physical->lerp_x = sample.x;
+            physical->lerp_y = sample.y;
+            physical->lerp_radius = sample.radius;
+            physical->lerp_angle = sample.angle;
+        }
         physical->deletion_animation =
             rr_lerp(physical->deletion_animation, 1, 15 * delta);
         if (physical->deletion_animation > 0.9)
@@ -28,6 +28,71 @@ struct function_captures
     struct rr_simulation *simulation;
 };
 
+// state at a fractional server tick. past the newest snapshot an entity that
+// moved in the newest update keeps going for a bit, anything else holds
+void rr_system_interpolation_sample(struct rr_simulation *simulation,
+                                   struct rr_component_physical *physical,
+                                   struct rr_physical_snapshot *out)
+{
+    double tick = simulation->render_tick;
+    uint8_t head = physical->snapshot_head;
+    struct rr_physical_snapshot *newer = &physical->snapshots[head];
+    if (tick >= newer->tick)
+    {
+        *out = *newer;
+        if (physical->snapshot_count < 2 ||
+            newer->tick != simulation->latest_tick)
+            return;
+        struct rr_physical_snapshot *older =
+            &physical->snapshots[(head + RR_PHYSICAL_SNAPSHOT_COUNT - 1) %
+                                 RR_PHYSICAL_SNAPSHOT_COUNT];
+        if (older->tick + 1 != newer->tick)
+            return;
+        float ahead = fmin(tick - newer->tick, RR_MAX_EXTRAPOLATION_TICKS);
+        out->x += (newer->x - older->x) * ahead;
+        out->y += (newer->y - older->y) * ahead;
+        return;
+    }
+    for (uint32_t i = 1; i < physical->snapshot_count; ++i)
+    {
+        struct rr_physical_snapshot *older =
+            &physical->snapshots[(head + RR_PHYSICAL_SNAPSHOT_COUNT - i) %
+                                 RR_PHYSICAL_SNAPSHOT_COUNT];
+        if (tick >= older->tick)
+        {
+            float t = (tick - older->tick) / (newer->tick - older->tick);
+            out->tick = older->tick;
+            out->x = rr_lerp(older->x, newer->x, t);
+            out->y = rr_lerp(older->y, newer->y, t);
+            out->angle = rr_angle_lerp(older->angle, newer->angle, t);
+            out->radius = rr_lerp(older->radius, newer->radius, t);
+            return;
+        }
+        newer = older;
+    }
+    // older than anything kept
+    *out = *newer;
+}
+
+// the render clock runs at the server's rate, sped up or slowed down a little
+// to settle at RR_INTERPOLATION_DELAY_TICKS behind the newest update
+static void advance_render_tick(struct rr_simulation *this, float delta)
+{
+    if (this->latest_tick == 0)
+        return;
+    double target = (double)this->latest_tick - RR_INTERPOLATION_DELAY_TICKS;
+    double error = target - this->render_tick;
+    if (fabs(error) > 4 * RR_INTERPOLATION_DELAY_TICKS)
+    {
+        this->render_tick = target;
+        return;
+    }
+    this->render_tick += delta * 25 * (1 + rr_fclamp(error * 0.1, -0.2, 0.2));
+    // past this only extrapolation is left and that gives up after a while
+    if (this->render_tick > this->latest_tick + RR_MAX_EXTRAPOLATION_TICKS)
+        this->render_tick = this->latest_tick + RR_MAX_EXTRAPOLATION_TICKS;
+}
+
 void system_interpolation_for_each_function(EntityIdx entity, void *_captures)
 {
     struct function_captures *captures = _captures;
@@ -45,8 +110,22 @@ void system_interpolation_for_each_function(EntityIdx entity, void *_captures)
         physical->velocity.x = physical->x - physical->lerp_x;
         physical->velocity.y = physical->y - physical->lerp_y;
 
-        physical->lerp_x = rr_lerp(physical->lerp_x, physical->x, 10 * delta);
-        physical->lerp_y = rr_lerp(physical->lerp_y, physical->y, 10 * delta);
+        if (physical->snapshot_count > 0)
+        {
+            struct rr_physical_snapshot sample;
+            rr_system_interpolation_sample(this, physical, &sample);
+            physical->lerp_x = sample.x;
+            physical->lerp_y = sample.y;
+            physical->lerp_radius = sample.radius;
+            physical->lerp_angle = sample.angle;
+        }
+        else
+        {
+            physical->lerp_x =
+                rr_lerp(physical->lerp_x, physical->x, 10 * delta);
+            physical->lerp_y =
+                rr_lerp(physical->lerp_y, physical->y, 10 * delta);
+        }
         physical->lerp_velocity.x =
             rr_lerp(physical->lerp_velocity.x, physical->velocity.x, 5 * delta);
         physical->lerp_velocity.y =
@@ -55,19 +134,26 @@ void system_interpolation_for_each_function(EntityIdx entity, void *_captures)
             physical->lerp_angle = physical->angle;
         physical->animation_started = 1;
 
-        physical->lerp_radius =
-            rr_lerp(physical->lerp_radius, physical->radius, 10 * delta);
-        physical->lerp_angle =
-            rr_angle_lerp(physical->lerp_angle, physical->angle, 10 * delta);
-        if (rr_simulation_has_mob(this, entity))
+        uint8_t smoothed = physical->snapshot_count == 0;
+        if (smoothed)
         {
-            if (physical->turning_animation == 0)
-                physical->turning_animation = physical->angle;
-
             physical->lerp_radius =
                 rr_lerp(physical->lerp_radius, physical->radius, 10 * delta);
             physical->lerp_angle = rr_angle_lerp(physical->lerp_angle,
                                                  physical->angle, 10 * delta);
+        }
+        if (rr_simulation_has_mob(this, entity))
+        {
+            if (physical->turning_animation == 0)
+                physical->turning_animation = physical->angle;
+
+            if (smoothed)
+            {
+                physical->lerp_radius = rr_lerp(physical->lerp_radius,
+                                                physical->radius, 10 * delta);
+                physical->lerp_angle = rr_angle_lerp(
+                    physical->lerp_angle, physical->angle, 10 * delta);
+            }
             physical->turning_animation = rr_angle_lerp(
                 physical->turning_animation, physical->angle, 6 * delta);
 
@@ -164,6 +250,7 @@ void rr_system_interpolation_tick(struct rr_simulation *simulation, float delta)
     struct function_captures captures;
     captures.simulation = simulation;
     captures.delta = delta;
+    advance_render_tick(simulation, delta);
     rr_simulation_for_each_entity(simulation, &captures,
                                   system_interpolation_for_each_function);
     simulation->updated_this_tick = 0;
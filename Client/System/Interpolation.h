@@ -18,6 +18,18 @@
 
 #include <Shared/Entity.h>
 
+// entities are drawn this many server ticks behind the newest update so
+// that a late one still has something to interpolate towards
+#define RR_INTERPOLATION_DELAY_TICKS (2)
+// how far positions are carried on once the updates run out
+#define RR_MAX_EXTRAPOLATION_TICKS (2)
+
 struct rr_simulation;
+struct rr_component_physical;
+struct rr_physical_snapshot;
 
 void rr_system_interpolation_tick(struct rr_simulation *, float);
+// state of an entity at the simulation's render tick
+void rr_system_interpolation_sample(struct rr_simulation *,
+                                    struct rr_component_physical *,
+                                    struct rr_physical_snapshot *);
@@ -20,9 +20,24 @@ class GameServer
     alias = "100";
     rivet_server_id = "no-uuid";
     clients = new Array(64).fill(0);
-    constructor()
+    constructor(ws, instance)
     {
         this.alias = (id++).toString(36);
+        this.ws = ws;
+        this.instance = instance;
+    }
+    send(encoder)
+    {
+        const data = encoder.data.subarray(0, encoder.at);
+        if (this.instance === 0)
+            return this.ws.send(data);
+        // [success, 100, instance, ...] for every instance but the first
+        const wrapped = new Uint8Array(data.length + 2);
+        wrapped[0] = data[0];
+        wrapped[1] = 100;
+        wrapped[2] = this.instance;
+        wrapped.set(data.subarray(1), 3);
+        this.ws.send(wrapped);
     }
 }
 
@@ -262,6 +262,51 @@ function merge_petals(obj1, obj2) {
     }
 }
 
+// same as the game server's, order independent so it can be kept up to date
+// cell by cell there
+function account_cell_hash(table, id, rarity, count)
+{
+    let hash = Math.imul((table << 16) | (id << 8) | rarity, 0x9e3779b1) ^ count;
+    hash ^= hash >>> 16;
+    hash = Math.imul(hash, 0x85ebca6b);
+    hash ^= hash >>> 13;
+    hash = Math.imul(hash, 0xc2b2ae35);
+    hash ^= hash >>> 16;
+    return hash >>> 0;
+}
+
+function account_hash(user)
+{
+    let hash = 0;
+    const tables = [user.petals, user.failed_crafts, user.mob_gallery];
+    for (let table = 0; table < tables.length; table++)
+        for (const key in tables[table])
+        {
+            const count = tables[table][key];
+            if (!count)
+                continue;
+            const [id, rarity] = key.split(':').map(Number);
+            hash = (hash + account_cell_hash(table, id, rarity, count)) >>> 0;
+        }
+    return hash;
+}
+
+function read_account_cells(decoder, cells, id_offset)
+{
+    let id = decoder.ReadUint8();
+    while (id)
+    {
+        const rarity = decoder.ReadUint8();
+        const count = decoder.ReadVarUint();
+        const key = (id - id_offset)+':'+rarity;
+        if (count)
+            cells[key] = count;
+        else
+            delete cells[key];
+        id = decoder.ReadUint8();
+    }
+}
+
 async function handle_error(res, cb)
 {
     try
@@ -362,12 +407,32 @@ const connected_clients = {};
 wss.on("connection", (ws, req) => {
     if (req.url !== `/api/${SERVER_SECRET}`)
        return ws.close();
-    const game_server = new GameServer();
-    game_server[game_server.alias] = game_server;
+    // one process can host several instances, every instance but the first
+    // wraps its messages in [100, instance, ...] and is registered on first use
+    const instances = [];
+    const get_instance = (index) => {
+        if (instances[index])
+            return instances[index];
+        const game_server = instances[index] = new GameServer(ws, index);
+        log("game connect", [game_server.alias]);
+        game_servers[game_server.alias] = game_server;
+        const encoder = new protocol.BinaryWriter();
+        encoder.WriteUint8(0);
+        encoder.WriteStringNT(game_server.alias);
+        game_server.send(encoder);
+        return game_server;
+    };
     ws.on('message', async (message) => {
         const data = new Uint8Array(message);
         const decoder = new protocol.BinaryReader(data);
-        switch(decoder.ReadUint8())
+        let opcode = decoder.ReadUint8();
+        let game_server = instances[0];
+        if (opcode === 100)
+        {
+            game_server = get_instance(decoder.ReadUint8());
+            opcode = decoder.ReadUint8();
+        }
+        switch(opcode)
         {
             case 0:
             {
@@ -381,7 +446,7 @@ wss.on("connection", (ws, req) => {
                     encoder.WriteUint8(2);
                     encoder.WriteUint8(pos);
                     encoder.WriteStringNT(uuid);
-                    ws.send(encoder.data.subarray(0, encoder.at));
+                    game_server.send(encoder);
                     break;
                 }
                 try {
@@ -392,7 +457,7 @@ wss.on("connection", (ws, req) => {
                     encoder.WriteUint8(1);
                     encoder.WriteUint8(pos);
                     connected_clients[uuid].write(encoder);
-                    ws.send(encoder.data.subarray(0, encoder.at));
+                    game_server.send(encoder);
                 } catch(e) {
                     console.log(e);
                 }
@@ -456,6 +521,36 @@ wss.on("connection", (ws, req) => {
                 await write_db_entry(uuid, user);
                 break;
             }
+            case 4:
+            {
+                // only the cells that changed since the last write
+                const uuid = decoder.ReadStringNT();
+                if (!connected_clients[uuid])
+                    break;
+                if (connected_clients[uuid].server !== game_server.alias)
+                    break;
+                const user = connected_clients[uuid].user;
+                user.xp = decoder.ReadFloat64();
+                user.checkpoint = decoder.ReadUint8();
+                read_account_cells(decoder, user.petals, 0);
+                read_account_cells(decoder, user.failed_crafts, 0);
+                read_account_cells(decoder, user.mob_gallery, 1);
+                const hash = (decoder.ReadVarUint() | (decoder.ReadVarUint() << 16)) >>> 0;
+                await write_db_entry(uuid, user);
+                if (account_hash(user) === hash)
+                    break;
+                // missed a delta somewhere, ask for the whole account
+                log("account drift", [uuid]);
+                const pos = game_server.clients.indexOf(uuid);
+                if (pos === -1)
+                    break;
+                const encoder = new protocol.BinaryWriter();
+                encoder.WriteUint8(3);
+                encoder.WriteUint8(pos);
+                encoder.WriteStringNT(uuid);
+                game_server.send(encoder);
+                break;
+            }
             case 3:
             {
                 let petals = {};
@@ -477,21 +572,21 @@ wss.on("connection", (ws, req) => {
                 break;
         }
     });
-    log("game connect", [game_server.alias]);
-    game_servers[game_server.alias] = game_server;
-    const encoder = new protocol.BinaryWriter();
-    encoder.WriteUint8(0);
-    encoder.WriteStringNT(game_server.alias);
-    ws.send(encoder.data.subarray(0, encoder.at));
+    get_instance(0);
     ws.on('close', async () => {
-        log("game disconnect", [game_server.alias]);
-        for (const uuid of game_server.clients)
+        for (const game_server of instances)
         {
-            if (connected_clients[uuid] && connected_clients[uuid].server === game_server.alias)
-                await write_db_entry(uuid, connected_clients[uuid].user);
-            delete connected_clients[uuid];
+            if (!game_server)
+                continue;
+            log("game disconnect", [game_server.alias]);
+            for (const uuid of game_server.clients)
+            {
+                if (connected_clients[uuid] && connected_clients[uuid].server === game_server.alias)
+                    await write_db_entry(uuid, connected_clients[uuid].user);
+                delete connected_clients[uuid];
+            }
+            delete game_servers[game_server.alias];
         }
-        delete game_servers[game_server.alias];
     });
 });
 
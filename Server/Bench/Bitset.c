@@ -0,0 +1,183 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// the enter/leave diff of a client's view, walked bit by bit the way
+// rr_simulation_write_binary used to against the word level diff it does
+// now. views are 16384 entity bitsets where a few percent of the entities
+// leave and enter every tick
+//
+// usage: rrolf-bench-bitset [ticks]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Shared/Bitset.h>
+#include <Shared/Entity.h>
+
+#define SIZE (RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT))
+
+struct counts
+{
+    uint8_t *view;
+    uint8_t *new_view;
+    uint64_t deletions;
+    uint64_t creations;
+    uint64_t updates;
+};
+
+static uint64_t get_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void old_deletion(uint64_t id, void *_captures)
+{
+    struct counts *captures = _captures;
+    if (!rr_bitset_get_bit(captures->new_view, id))
+    {
+        rr_bitset_unset(captures->view, id);
+        ++captures->deletions;
+    }
+}
+
+static void old_update(uint64_t id, void *_captures)
+{
+    struct counts *captures = _captures;
+    if (!rr_bitset_get_bit(captures->view, id))
+    {
+        rr_bitset_set(captures->view, id);
+        ++captures->creations;
+    }
+    else
+        ++captures->updates;
+}
+
+static void old_diff(struct counts *counts)
+{
+    rr_bitset_for_each_bit(counts->view, counts->view + SIZE, counts,
+                           old_deletion);
+    rr_bitset_for_each_bit(counts->new_view, counts->new_view + SIZE, counts,
+                           old_update);
+}
+
+static void count_deletion(uint64_t id, void *_captures)
+{
+    ++((struct counts *)_captures)->deletions;
+}
+
+static void count_creation(uint64_t id, void *_captures)
+{
+    struct counts *captures = _captures;
+    rr_bitset_set(captures->view, id);
+    ++captures->creations;
+}
+
+static void count_update(uint64_t id, void *_captures)
+{
+    ++((struct counts *)_captures)->updates;
+}
+
+static void new_diff(struct counts *counts)
+{
+    uint8_t removed[SIZE];
+    uint8_t added[SIZE];
+    uint8_t kept[SIZE];
+    rr_bitset_diff(counts->view, counts->new_view, removed, added, kept, SIZE);
+    memcpy(counts->view, kept, SIZE);
+    rr_bitset_for_each_set(removed, SIZE, counts, count_deletion);
+    rr_bitset_for_each_set(added, SIZE, counts, count_creation);
+    rr_bitset_for_each_set(kept, SIZE, counts, count_update);
+}
+
+// the same sequence of views for both, seeded per run
+static void next_view(uint8_t *view, uint32_t occupancy, uint32_t churn)
+{
+    for (uint32_t i = 0; i < churn; ++i)
+    {
+        uint32_t id;
+        do
+            id = 1 + rand() % occupancy;
+        while (!rr_bitset_get(view, id));
+        rr_bitset_unset(view, id);
+        do
+            id = 1 + rand() % occupancy;
+        while (rr_bitset_get(view, id));
+        rr_bitset_set(view, id);
+    }
+}
+
+// entities come from the free list so ids are packed at the bottom,
+// occupancy is the highest id and in view how many of those are visible
+static void run(uint32_t occupancy, uint32_t in_view, uint32_t ticks)
+{
+    uint8_t views[2][SIZE];
+    struct counts counts[2];
+    uint64_t times[2] = {0, 0};
+    for (uint32_t which = 0; which < 2; ++which)
+    {
+        srand(occupancy * 31 + in_view);
+        uint8_t target[SIZE];
+        memset(target, 0, SIZE);
+        for (uint32_t i = 0; i < in_view;)
+        {
+            uint32_t id = 1 + rand() % occupancy;
+            if (!rr_bitset_get(target, id))
+            {
+                rr_bitset_set(target, id);
+                ++i;
+            }
+        }
+        memset(views[which], 0, SIZE);
+        memset(&counts[which], 0, sizeof counts[which]);
+        counts[which].view = views[which];
+        counts[which].new_view = target;
+        for (uint32_t tick = 0; tick < ticks; ++tick)
+        {
+            next_view(target, occupancy, in_view / 32 + 1);
+            uint64_t start = get_time();
+            if (which == 0)
+                old_diff(&counts[which]);
+            else
+                new_diff(&counts[which]);
+            times[which] += get_time() - start;
+        }
+    }
+    uint8_t same = memcmp(views[0], views[1], SIZE) == 0 &&
+                   counts[0].deletions == counts[1].deletions &&
+                   counts[0].creations == counts[1].creations &&
+                   counts[0].updates == counts[1].updates;
+    printf("%10u %10u %10llu %12.1f %12.1f %9.2fx %s\n", occupancy, in_view,
+           (unsigned long long)rr_bitset_count(views[1], SIZE),
+           times[0] / (double)ticks, times[1] / (double)ticks,
+           times[0] / (double)times[1], same ? "" : "MISMATCH");
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t ticks = argc > 1 ? atoi(argv[1]) : 20000;
+    printf("%10s %10s %10s %12s %12s %10s\n", "highest id", "in view",
+           "counted", "bit ns", "word ns", "speedup");
+    run(2048, 300, ticks);
+    run(4096, 1500, ticks);
+    run(4096, 3000, ticks);
+    run(16383, 1500, ticks);
+    run(16383, 8000, ticks);
+    return 0;
+}
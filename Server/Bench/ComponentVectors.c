@@ -0,0 +1,261 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// checks that every COMPONENT##_vector and COMPONENT##_index stays in sync
+// with entity_tracker. every tick a seeded mix of entities is created with
+// random components, components are added to live entities, deletions are
+// requested and handled the way the server's tick ends, and one component
+// vector is walked while the entities it visits are swap-removed. the walk
+// has to visit everything that was in the vector exactly once. exits with 1
+// on the first mismatch
+//
+// usage: rrolf-bench-component-vectors [ticks] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Server/EntityAllocation.h>
+#include <Server/Simulation.h>
+#include <Shared/Bitset.h>
+
+#define COMPONENT_COUNT (13)
+
+struct component_vector
+{
+    char const *name;
+    uint32_t id;
+    EntityIdx *vector;
+    EntityIdx *index;
+    EntityIdx *count;
+};
+
+static uint8_t visited[RR_MAX_ENTITY_COUNT];
+static uint8_t expected[RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT)];
+static uint8_t removed_in_walk[RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT)];
+
+static void get_vectors(struct rr_simulation *this,
+                        struct component_vector *vectors)
+{
+    uint32_t i = 0;
+#define XX(COMPONENT, ID)                                                      \
+    vectors[i++] = (struct component_vector){                                  \
+        #COMPONENT, ID, this->COMPONENT##_vector, this->COMPONENT##_index,     \
+        &this->COMPONENT##_count};
+    RR_FOR_EACH_COMPONENT;
+#undef XX
+}
+
+// player_info is the only component that owns memory, it is never added
+// twice so it doesn't leak
+static void add_component(struct rr_simulation *this, EntityIdx entity,
+                          uint32_t id)
+{
+    if (id == 1 && rr_simulation_has_player_info(this, entity))
+        return;
+#define XX(COMPONENT, ID)                                                      \
+    if (id == ID)                                                              \
+        rr_simulation_add_##COMPONENT(this, entity);
+    RR_FOR_EACH_COMPONENT;
+#undef XX
+}
+
+static void remove_entity(struct rr_simulation *this, EntityIdx entity)
+{
+    if (rr_simulation_has_player_info(this, entity))
+        rr_component_player_info_free(
+            rr_simulation_get_player_info(this, entity), this);
+    __rr_simulation_pending_deletion_unset_entity(entity, this);
+}
+
+static void remove_entity_cb(uint64_t entity, void *captures)
+{
+    remove_entity(captures, entity);
+}
+
+static EntityIdx create_entity(struct rr_simulation *this)
+{
+    EntityIdx entity = rr_simulation_alloc_entity(this);
+    for (uint32_t id = 1; id <= COMPONENT_COUNT; ++id)
+        if (rand() % 4 == 0)
+            add_component(this, entity, id);
+    return entity;
+}
+
+// a live entity that isn't about to be deleted, or 0 if none was found
+static EntityIdx pick_entity(struct rr_simulation *this)
+{
+    uint32_t range = rr_simulation_get_entity_high_water_mark(this);
+    for (uint32_t tries = 0; tries < 16 && range > 1; ++tries)
+    {
+        EntityIdx entity = 1 + rand() % (range - 1);
+        if (rr_simulation_has_entity(this, entity) &&
+            !rr_bitset_get(this->pending_deletions, entity))
+            return entity;
+    }
+    return 0;
+}
+
+static uint8_t check_vectors(struct rr_simulation *this,
+                             struct component_vector *vectors, uint32_t tick)
+{
+    for (uint32_t c = 0; c < COMPONENT_COUNT; ++c)
+    {
+        struct component_vector *v = &vectors[c];
+        uint32_t count = 0;
+        for (EntityIdx entity = 1; entity < RR_MAX_ENTITY_COUNT; ++entity)
+            count += (this->entity_tracker[entity] & 1) &&
+                     (this->entity_tracker[entity] & (1 << v->id));
+        if (count != *v->count)
+        {
+            fprintf(stderr, "tick %u: %s count %u, tracker has %u\n", tick,
+                    v->name, *v->count, count);
+            return 0;
+        }
+        // the index maps back to each position, so no entity is in twice
+        for (uint32_t pos = 0; pos < *v->count; ++pos)
+        {
+            EntityIdx entity = v->vector[pos];
+            if (!(this->entity_tracker[entity] & 1) ||
+                !(this->entity_tracker[entity] & (1 << v->id)) ||
+                v->index[entity] != pos)
+            {
+                fprintf(stderr, "tick %u: %s[%u] = %u out of sync\n", tick,
+                        v->name, pos, entity);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// stays on the same position after removing, that is where the swap put
+// the last entity
+static uint8_t walk_and_remove(struct rr_simulation *this,
+                               struct component_vector *v, uint32_t tick,
+                               uint32_t *removed)
+{
+    memset(expected, 0, sizeof expected);
+    for (uint32_t pos = 0; pos < *v->count; ++pos)
+    {
+        rr_bitset_set(expected, v->vector[pos]);
+        visited[v->vector[pos]] = 0;
+    }
+    for (uint32_t pos = 0; pos < *v->count;)
+    {
+        EntityIdx entity = v->vector[pos];
+        if (!rr_bitset_get(expected, entity))
+        {
+            // added during the walk
+            ++pos;
+            continue;
+        }
+        if (visited[entity]++)
+        {
+            fprintf(stderr, "tick %u: walk over %s visited %u twice\n", tick,
+                    v->name, entity);
+            return 0;
+        }
+        if (rand() % 256 == 0)
+            add_component(this, create_entity(this), v->id);
+        if (rand() % 64 != 0 ||
+            rr_bitset_get(this->pending_deletions, entity))
+        {
+            ++pos;
+            continue;
+        }
+        remove_entity(this, entity);
+        rr_bitset_set(removed_in_walk, entity);
+        ++*removed;
+    }
+    for (EntityIdx entity = 1; entity < RR_MAX_ENTITY_COUNT; ++entity)
+        if (rr_bitset_get(expected, entity) && visited[entity] != 1)
+        {
+            fprintf(stderr, "tick %u: walk over %s skipped %u\n", tick,
+                    v->name, entity);
+            return 0;
+        }
+    return 1;
+}
+
+// rr_simulation_tick without the systems
+static void end_tick(struct rr_simulation *this)
+{
+    rr_simulation_release_entity_ids(this);
+    memcpy(this->deleted_last_tick, this->pending_deletions,
+           sizeof this->pending_deletions);
+    memset(this->pending_deletions, 0, sizeof this->pending_deletions);
+    rr_bitset_for_each_bit(this->deleted_last_tick,
+                           this->deleted_last_tick +
+                               RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT),
+                           this, remove_entity_cb);
+    // removed ids go through the same quarantine
+    for (uint32_t i = 0; i < RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT); ++i)
+        this->deleted_last_tick[i] |= removed_in_walk[i];
+    memset(removed_in_walk, 0, sizeof removed_in_walk);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t tick_count = argc > 1 ? atoi(argv[1]) : 2000;
+    uint32_t seed = argc > 2 ? atoi(argv[2]) : 1;
+    struct rr_simulation *simulation = calloc(1, sizeof *simulation);
+    simulation->entity_high_water_mark = 1;
+    struct component_vector vectors[COMPONENT_COUNT];
+    get_vectors(simulation, vectors);
+    srand(seed);
+
+    uint32_t created = 0;
+    uint32_t deleted = 0;
+    uint32_t removed = 0;
+    for (uint32_t tick = 0; tick < tick_count; ++tick)
+    {
+        for (uint32_t i = rand() % 64; i > 0; --i, ++created)
+            create_entity(simulation);
+        for (uint32_t i = 0; i < 32; ++i)
+        {
+            EntityIdx entity = pick_entity(simulation);
+            if (entity != 0)
+                add_component(simulation, entity,
+                              1 + rand() % COMPONENT_COUNT);
+        }
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            EntityIdx entity = pick_entity(simulation);
+            if (entity == 0)
+                continue;
+            rr_simulation_request_entity_deletion(simulation, entity);
+            ++deleted;
+        }
+        if (!check_vectors(simulation, vectors, tick) ||
+            !walk_and_remove(simulation,
+                             &vectors[rand() % COMPONENT_COUNT], tick,
+                             &removed) ||
+            !check_vectors(simulation, vectors, tick))
+            return 1;
+        end_tick(simulation);
+        if (!check_vectors(simulation, vectors, tick))
+            return 1;
+    }
+    uint32_t alive = 0;
+    for (EntityIdx entity = 1; entity < RR_MAX_ENTITY_COUNT; ++entity)
+        alive += rr_simulation_has_entity(simulation, entity);
+    printf("%u ticks, seed %u: %u created, %u deleted, %u removed while "
+           "walking, %u alive. vectors match\n",
+           tick_count, seed, created, deleted, removed, alive);
+    free(simulation);
+    return 0;
+}
@@ -0,0 +1,178 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// compares rr_craft against the attempt at a time loop it replaced. every
+// case is crafted many times with both and the means of the outcome have to
+// agree within a few standard errors, then the worst case of both is timed.
+// exits with 1 if any mean is off
+//
+// usage: rrolf-bench-crafting [trials]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <Server/Crafting.h>
+#include <Shared/StaticData.h>
+#include <Shared/Utilities.h>
+
+// standard errors a mean may be off by
+#define TOLERANCE (5)
+
+struct craft_case
+{
+    uint8_t rarity;
+    uint32_t count;
+    uint32_t fails;
+};
+
+static struct craft_case const CASES[] = {
+    {0, 5, 0},      {0, 9, 2},       {0, 1000, 0},     {2, 37, 4},
+    {3, 100, 0},    {4, 500, 30},    {6, 5000, 0},     {8, 2000, 200},
+    {10, 20000, 0}, {11, 20000, 3000}, {13, 100000, 0}, {15, 30000, 0},
+    {15, 200000, 5000}};
+
+static uint64_t get_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// the previous rr_server_client_craft_petal loop
+static void reference_craft(uint8_t rarity, uint32_t count, uint32_t fails,
+                            struct rr_craft_outcome *outcome)
+{
+    uint32_t now = count;
+    uint32_t success = 0;
+    uint32_t attempts = 0;
+    double base = RR_CRAFT_CHANCES[rarity];
+    while (now >= 5)
+    {
+        if (rr_frand() < base * (++fails))
+        {
+            ++success;
+            fails = 0;
+            now -= 5;
+        }
+        else
+            now -= 1 + rand() % 4;
+        ++attempts;
+    }
+    outcome->successes = success;
+    outcome->consumed = count - now;
+    outcome->attempts = attempts;
+    outcome->fails = fails;
+}
+
+struct moments
+{
+    double sum[4];
+    double square[4];
+};
+
+static void add(struct moments *moments, struct rr_craft_outcome *outcome)
+{
+    double values[4] = {outcome->successes, outcome->consumed,
+                        outcome->attempts, outcome->fails};
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        moments->sum[i] += values[i];
+        moments->square[i] += values[i] * values[i];
+    }
+}
+
+// the largest difference of the means in standard errors
+static double compare(struct moments *a, struct moments *b, uint32_t trials)
+{
+    double worst = 0;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        double mean_a = a->sum[i] / trials;
+        double mean_b = b->sum[i] / trials;
+        double variance_a = a->square[i] / trials - mean_a * mean_a;
+        double variance_b = b->square[i] / trials - mean_b * mean_b;
+        double error = sqrt((variance_a + variance_b) / trials);
+        double difference = fabs(mean_a - mean_b);
+        double deviations = error > 0 ? difference / error
+                            : difference > 1e-9 ? INFINITY
+                                                : 0;
+        if (deviations > worst)
+            worst = deviations;
+    }
+    return worst;
+}
+
+static uint8_t run_case(struct craft_case const *craft_case, uint32_t trials)
+{
+    struct moments moments[2] = {};
+    struct rr_craft_outcome outcome;
+    uint64_t times[2] = {0, 0};
+    for (uint32_t i = 0; i < trials; ++i)
+    {
+        uint64_t start = get_time();
+        reference_craft(craft_case->rarity, craft_case->count,
+                        craft_case->fails, &outcome);
+        times[0] += get_time() - start;
+        add(&moments[0], &outcome);
+        start = get_time();
+        rr_craft(craft_case->rarity, craft_case->count, craft_case->fails,
+                 &outcome);
+        times[1] += get_time() - start;
+        add(&moments[1], &outcome);
+    }
+    double deviations = compare(&moments[0], &moments[1], trials);
+    printf("%6u %10u %8u %12.2f %12.2f %12.1f %12.1f %10.2f %s\n",
+           craft_case->rarity, craft_case->count, craft_case->fails,
+           moments[0].sum[0] / trials, moments[1].sum[0] / trials,
+           times[0] / 1000.0 / trials, times[1] / 1000.0 / trials, deviations,
+           deviations > TOLERANCE ? "MISMATCH" : "");
+    return deviations <= TOLERANCE;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t trials = argc > 1 ? atoi(argv[1]) : 2000;
+    srand(time(NULL));
+    rr_static_data_init();
+    rr_crafting_init();
+
+    printf("%6s %10s %8s %12s %12s %12s %12s %10s\n", "rarity", "count",
+           "fails", "loop succ", "batch succ", "loop us", "batch us",
+           "max dev");
+    uint8_t passed = 1;
+    for (uint32_t i = 0; i < sizeof CASES / sizeof *CASES; ++i)
+        passed &= run_case(&CASES[i], trials);
+
+    // a full uint32 stack of every rarity, the loop is timed on a thousandth
+    // of it
+    printf("\n%6s %16s %16s %12s\n", "rarity", "loop ms (est)", "batch us",
+           "successes");
+    for (uint8_t rarity = 0; rarity < rr_rarity_id_max - 1; ++rarity)
+    {
+        struct rr_craft_outcome outcome;
+        uint64_t start = get_time();
+        reference_craft(rarity, UINT32_MAX / 1000, 0, &outcome);
+        double loop = (get_time() - start) * 1000 / 1e6;
+        start = get_time();
+        rr_craft(rarity, UINT32_MAX, 0, &outcome);
+        double batch = (get_time() - start) / 1e3;
+        printf("%6u %16.1f %16.1f %12u\n", rarity, loop, batch,
+               outcome.successes);
+    }
+    return !passed;
+}
@@ -0,0 +1,300 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// checks rr_encrypt against known answers and against the byte at a time
+// implementation it replaced, then compares their throughput. exits with 1
+// if any output differs
+//
+// usage: rrolf-bench-crypto [megabytes per size]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Shared/Crypto.h>
+
+struct known_answer
+{
+    uint64_t key;
+    uint32_t size;
+    uint64_t digest; // fnv-1a of the encrypted message
+};
+
+// the message is i * 7 + 3 for every byte i. the answers depend on the
+// secrets in Shared/MagicNumber.h through rr_get_hash, regenerate them with
+// reference_encrypt if those change
+static struct known_answer const KNOWN_ANSWERS[] = {
+    {0ull, 1, 0xaf64134c86024a01ull},
+    {0ull, 17, 0x3f11262bd68c0874ull},
+    {0ull, 64, 0xe954ec5d7e568f3eull},
+    {0ull, 100, 0x5dff3b8329c4b737ull},
+    {0ull, 1024, 0x020d5829c16e4d36ull},
+    {0ull, 4099, 0x3607a6496ac8cba1ull},
+    {1ull, 1, 0xaf64094c86023903ull},
+    {1ull, 17, 0x312c76c3e60ded61ull},
+    {1ull, 64, 0x00af13bb13f0d485ull},
+    {1ull, 100, 0x88c0474ac4007ceeull},
+    {1ull, 1024, 0x69c2b73b5d9c9babull},
+    {1ull, 4099, 0xc028580d638c41d1ull},
+    {21094093777837637ull, 1, 0xaf64544c8602b874ull},
+    {21094093777837637ull, 17, 0x9158ae10241d3feaull},
+    {21094093777837637ull, 64, 0x60bfb18f4130c867ull},
+    {21094093777837637ull, 100, 0xdc4c53e756de825aull},
+    {21094093777837637ull, 1024, 0x244b8d4bbab1f681ull},
+    {21094093777837637ull, 4099, 0x2e25f4f740be879aull},
+    {16045690984503098046ull, 1, 0xaf63a14c8601884bull},
+    {16045690984503098046ull, 17, 0x1ffd23cce0bff249ull},
+    {16045690984503098046ull, 64, 0x08c2619807c4849bull},
+    {16045690984503098046ull, 100, 0x0312f85541588ef7ull},
+    {16045690984503098046ull, 1024, 0x7cdb59561d7c3b22ull},
+    {16045690984503098046ull, 4099, 0x5a8512b48fe7052cull}};
+
+static uint32_t const SIZES[] = {16, 64, 256, 1024, 8192, 65536};
+
+// the previous implementation, unchanged apart from the names
+static inline void u32t8le(uint32_t v, uint8_t p[4])
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static inline uint32_t u8t32le(uint8_t p[4])
+{
+    uint32_t value = p[3];
+
+    value = (value << 8) | p[2];
+    value = (value << 8) | p[1];
+    value = (value << 8) | p[0];
+
+    return value;
+}
+
+static inline uint32_t rotl32(uint32_t x, int n)
+{
+    return x << n | (x >> (-n & 31));
+}
+
+static void chacha20_quarterround(uint32_t *x, int a, int b, int c, int d)
+{
+    x[a] += x[b];
+    x[d] = rotl32(x[d] ^ x[a], 16);
+    x[c] += x[d];
+    x[b] = rotl32(x[b] ^ x[c], 12);
+    x[a] += x[b];
+    x[d] = rotl32(x[d] ^ x[a], 8);
+    x[c] += x[d];
+    x[b] = rotl32(x[b] ^ x[c], 7);
+}
+
+static void chacha20_serialize(uint32_t in[16], uint8_t output[64])
+{
+    int i;
+    for (i = 0; i < 16; i++)
+    {
+        u32t8le(in[i], output + (i << 2));
+    }
+}
+
+static void chacha20_block(uint32_t in[16], uint8_t out[64], int num_rounds)
+{
+    int i;
+    uint32_t x[16];
+
+    memcpy(x, in, sizeof(uint32_t) * 16);
+
+    for (i = num_rounds; i > 0; i -= 2)
+    {
+        chacha20_quarterround(x, 0, 4, 8, 12);
+        chacha20_quarterround(x, 1, 5, 9, 13);
+        chacha20_quarterround(x, 2, 6, 10, 14);
+        chacha20_quarterround(x, 3, 7, 11, 15);
+        chacha20_quarterround(x, 1, 5, 10, 15);
+        chacha20_quarterround(x, 1, 6, 11, 14);
+        chacha20_quarterround(x, 2, 7, 8, 13);
+        chacha20_quarterround(x, 3, 4, 9, 14);
+    }
+
+    for (i = 0; i < 16; i++)
+    {
+        x[i] += in[i];
+    }
+
+    chacha20_serialize(x, out);
+}
+
+static void chacha20_init_state(uint32_t s[16], uint8_t key[32],
+                                uint32_t counter, uint8_t nonce[12])
+{
+    int i;
+
+    s[0] = 0x61707865 ^ 0xfeedface;
+    s[1] = 0x3320646e ^ 0xfacefeed;
+    s[2] = 0x79622d32 ^ 0xdeadbeef;
+    s[3] = 0x6b206574 ^ 0xbeefdaed;
+
+    for (i = 0; i < 8; i++)
+    {
+        s[4 + i] = u8t32le(key + i * 4);
+    }
+
+    s[12] = counter;
+
+    for (i = 0; i < 3; i++)
+    {
+        s[13 + i] = u8t32le(nonce + i * 4);
+    }
+}
+
+static void ChaCha20XOR(uint8_t key[32], uint32_t counter, uint8_t nonce[12],
+                        uint8_t *in, uint8_t *out, int inlen)
+{
+    int i, j;
+
+    uint32_t s[16];
+    uint8_t block[64];
+
+    chacha20_init_state(s, key, counter, nonce);
+
+    for (i = 0; i < inlen; i += 64)
+    {
+        chacha20_block(s, block, 20);
+        s[12]++;
+
+        for (j = i; j < i + 64; j++)
+        {
+            if (j >= inlen)
+            {
+                break;
+            }
+            out[j] = in[j] ^ block[j - i];
+        }
+    }
+}
+
+static void reference_encrypt(uint8_t *start, uint64_t size, uint64_t key)
+{
+    uint8_t *clone = malloc(size);
+    memcpy(clone, start, size);
+    uint64_t cipher_key[4];
+    uint32_t nonce[3];
+    uint32_t counter;
+    for (uint64_t i = 0; i < 4; i++)
+        cipher_key[i] = key = rr_get_hash(
+            rr_get_hash(rr_get_hash(rr_get_hash(rr_get_hash(key)))));
+    for (uint64_t i = 0; i < 3; i++)
+        nonce[i] = key = rr_get_hash(rr_get_hash(key));
+    counter = rr_get_hash(key);
+
+    ChaCha20XOR((uint8_t *)cipher_key, counter, (uint8_t *)nonce, clone, start,
+                size);
+    free(clone);
+}
+
+static uint64_t get_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static uint64_t fnv(uint8_t const *data, uint64_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (uint64_t i = 0; i < size; ++i)
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    return hash;
+}
+
+static uint32_t check_known_answers()
+{
+    uint8_t message[4099];
+    uint32_t failures = 0;
+    for (uint32_t i = 0; i < sizeof KNOWN_ANSWERS / sizeof *KNOWN_ANSWERS; ++i)
+    {
+        struct known_answer const *answer = &KNOWN_ANSWERS[i];
+        for (uint32_t j = 0; j < answer->size; ++j)
+            message[j] = j * 7 + 3;
+        rr_encrypt(message, answer->size, answer->key);
+        if (fnv(message, answer->size) == answer->digest)
+            continue;
+        printf("known answer %u (key %llu, %u bytes) differs\n", i,
+               (unsigned long long)answer->key, answer->size);
+        ++failures;
+    }
+    return failures;
+}
+
+// every size up to a few wide blocks past the 8 block stride, at every
+// alignment the network buffers could have
+static uint32_t check_reference()
+{
+    uint8_t *expected = malloc(4096 + 64);
+    uint8_t *actual = malloc(4096 + 64);
+    uint32_t failures = 0;
+    for (uint32_t size = 0; size <= 4096; ++size)
+    {
+        uint32_t offset = size % 61;
+        uint64_t key = rr_get_rand();
+        for (uint32_t i = 0; i < size; ++i)
+            expected[offset + i] = rr_get_rand();
+        memcpy(actual + offset, expected + offset, size);
+        reference_encrypt(expected + offset, size, key);
+        rr_encrypt(actual + offset, size, key);
+        if (memcmp(expected + offset, actual + offset, size) == 0)
+            continue;
+        if (failures++ < 8)
+            printf("%u byte message differs from the reference\n", size);
+    }
+    free(expected);
+    free(actual);
+    return failures;
+}
+
+static double throughput(void (*encrypt)(uint8_t *, uint64_t, uint64_t),
+                         uint8_t *buffer, uint32_t size, uint64_t total)
+{
+    uint64_t count = total / size + 1;
+    uint64_t start = get_time();
+    for (uint64_t i = 0; i < count; ++i)
+        encrypt(buffer, size, i);
+    return count * size / ((get_time() - start) * 1e-9) / (1024 * 1024);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t total = (argc > 1 ? atoi(argv[1]) : 64) * 1024ull * 1024;
+    uint32_t known_failures = check_known_answers();
+    uint32_t reference_failures = check_reference();
+    printf("known answers: %s, reference: %s\n",
+           known_failures ? "FAILED" : "ok",
+           reference_failures ? "FAILED" : "ok");
+
+    uint8_t *buffer = calloc(1, SIZES[sizeof SIZES / sizeof *SIZES - 1]);
+    printf("\n%-10s %14s %14s %10s\n", "bytes", "reference MB/s", "MB/s",
+           "speedup");
+    for (uint32_t i = 0; i < sizeof SIZES / sizeof *SIZES; ++i)
+    {
+        double before = throughput(reference_encrypt, buffer, SIZES[i], total);
+        double after = throughput(rr_encrypt, buffer, SIZES[i], total);
+        printf("%-10u %14.1f %14.1f %9.2fx\n", SIZES[i], before, after,
+               after / before);
+    }
+    free(buffer);
+    return known_failures || reference_failures;
+}
@@ -0,0 +1,122 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// compares the free list allocator against the linear scan it replaced, at
+// different occupancy levels with ~1% of the entities replaced every tick
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Server/EntityAllocation.h>
+#include <Server/Simulation.h>
+#include <Shared/Bitset.h>
+
+#define TICK_COUNT (1000)
+
+static EntityIdx scan_alloc_entity(struct rr_simulation *this)
+{
+    for (EntityIdx i = 1; i < RR_MAX_ENTITY_COUNT; i++)
+    {
+        if (!rr_simulation_has_entity(this, i))
+        {
+            if (rr_bitset_get_bit(this->deleted_last_tick, i))
+                continue;
+            this->entity_tracker[i] = 1;
+            ++this->entity_hash_tracker[i];
+            return i;
+        }
+    }
+    RR_UNREACHABLE("ran out of entity ids");
+}
+
+static void end_tick(struct rr_simulation *this, uint8_t free_list)
+{
+    if (free_list)
+        rr_simulation_release_entity_ids(this);
+    memcpy(this->deleted_last_tick, this->pending_deletions,
+           sizeof this->pending_deletions);
+    memset(this->pending_deletions, 0, sizeof this->pending_deletions);
+    for (EntityIdx i = 1; i < RR_MAX_ENTITY_COUNT; ++i)
+        if (rr_bitset_get(this->deleted_last_tick, i))
+            this->entity_tracker[i] = 0;
+}
+
+static uint64_t get_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static double run(struct rr_simulation *simulation, uint32_t live,
+                  uint8_t free_list)
+{
+    EntityIdx (*alloc)(struct rr_simulation *) =
+        free_list ? rr_simulation_alloc_entity : scan_alloc_entity;
+    EntityIdx *alive = malloc(live * sizeof *alive);
+    uint32_t *replaced = malloc(live * sizeof *replaced);
+    memset(simulation, 0, sizeof *simulation);
+    simulation->entity_high_water_mark = 1;
+    srand(1);
+    for (uint32_t i = 0; i < live; ++i)
+        alive[i] = alloc(simulation);
+    uint32_t churn = live / 100 + 1;
+    uint64_t elapsed = 0;
+    uint64_t allocations = 0;
+    for (uint32_t tick = 0; tick < TICK_COUNT; ++tick)
+    {
+        uint32_t replaced_count = 0;
+        for (uint32_t i = 0; i < churn; ++i)
+        {
+            uint32_t slot = rand() % live;
+            if (rr_bitset_get(simulation->pending_deletions, alive[slot]))
+                continue;
+            rr_bitset_set(simulation->pending_deletions, alive[slot]);
+            replaced[replaced_count++] = slot;
+        }
+        end_tick(simulation, free_list);
+        uint64_t start = get_time();
+        for (uint32_t i = 0; i < replaced_count; ++i)
+            alive[replaced[i]] = alloc(simulation);
+        elapsed += get_time() - start;
+        allocations += replaced_count;
+    }
+    if (free_list)
+        printf("    high water mark %u, free %u\n",
+               rr_simulation_get_entity_high_water_mark(simulation),
+               rr_simulation_get_free_entity_count(simulation));
+    free(alive);
+    free(replaced);
+    return (double)elapsed / allocations;
+}
+
+int main()
+{
+    struct rr_simulation *simulation = malloc(sizeof *simulation);
+    float occupancies[] = {0.1, 0.5, 0.9, 0.98};
+    for (uint32_t i = 0; i < sizeof occupancies / sizeof *occupancies; ++i)
+    {
+        uint32_t live = occupancies[i] * (RR_MAX_ENTITY_COUNT - 1);
+        printf("%u live entities (%.0f%%)\n", live, occupancies[i] * 100);
+        double scan = run(simulation, live, 0);
+        double free_list = run(simulation, live, 1);
+        printf("    scan %.1f ns/alloc, free list %.1f ns/alloc\n", scan,
+               free_list);
+    }
+    free(simulation);
+}
@@ -0,0 +1,618 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// replays one player trace against the maze spawner and the full recount it
+// replaced, each on its own server. player counts have to match cell for
+// cell every tick. spawns per mob id, rarity and region of the maze are
+// compared with two sample chi-square tests, spawns per stretch of time with
+// a paired t-test. the trace has flowers wandering the open cells, leaving,
+// rejoining elsewhere and levelling up. exits with 1 on a mismatch or a test
+// failing at the 0.1% level
+//
+// usage: rrolf-bench-spawn-grid [ticks] [flowers] [seed]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Server/Client.h>
+#include <Server/EntityAllocation.h>
+#include <Server/MazeCollision.h>
+#include <Server/MazeInfluence.h>
+#include <Server/Server.h>
+#include <Server/Simulation.h>
+#include <Server/Waves.h>
+#include <Shared/Bitset.h>
+#include <Shared/Utilities.h>
+#include <Shared/Vector.h>
+
+#define REGION_SIZE (10)
+#define WINDOW_TICKS (500)
+#define FLOWER_SPEED (16)
+
+struct trace_entry
+{
+    float x;
+    float y;
+    uint32_t level;
+    uint8_t present;
+};
+
+struct spawn_stats
+{
+    uint32_t *ids;
+    uint32_t *rarities;
+    uint32_t *regions;
+    uint32_t *windows;
+    uint32_t total;
+    uint64_t time;
+};
+
+static uint64_t get_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// the previous implementation, unchanged apart from the names
+#define PLAYER_COUNT_CAP (12)
+// spawn function results, as in Server/Simulation.c
+#define ALL_MOBS 255
+#define DIFFICULT_MOBS 254
+
+struct too_close_captures
+{
+    struct rr_simulation *simulation;
+    float x;
+    float y;
+    float closest_dist;
+    uint8_t done;
+};
+
+static void too_close_cb(EntityIdx potential, void *_captures)
+{
+    struct too_close_captures *captures = _captures;
+    if (captures->done)
+        return;
+    struct rr_simulation *simulation = captures->simulation;
+    if ((!rr_simulation_has_mob(simulation, potential) &&
+         !rr_simulation_has_flower(simulation, potential)) ||
+        rr_simulation_has_arena(simulation, potential))
+        return;
+    if (rr_simulation_get_relations(simulation, potential)->team ==
+        rr_simulation_team_id_mobs)
+        return;
+    if (rr_simulation_get_health(simulation, potential)->health == 0)
+        return;
+    struct rr_component_physical *t_physical =
+        rr_simulation_get_physical(simulation, potential);
+    struct rr_vector delta = {captures->x - t_physical->x,
+                              captures->y - t_physical->y};
+    float dist = rr_vector_get_magnitude(&delta);
+    if (dist > captures->closest_dist)
+        return;
+    captures->done = 1;
+}
+
+static int too_close(struct rr_simulation *this, float x, float y, float r)
+{
+    struct too_close_captures shg_captures = {this, x, y, r, 0};
+    struct rr_spatial_hash *shg =
+        &rr_simulation_get_arena(this, 1)->spatial_hash;
+    rr_spatial_hash_query(shg, x, y, r, r, &shg_captures, too_close_cb);
+    return shg_captures.done;
+}
+
+static void spawn_mob(struct rr_simulation *this, uint32_t grid_x,
+                      uint32_t grid_y)
+{
+    struct rr_component_arena *arena = rr_simulation_get_arena(this, 1);
+    struct rr_maze_grid *grid =
+        rr_component_arena_get_grid(arena, grid_x, grid_y);
+    uint8_t id;
+    if (grid->spawn_function != NULL && rr_frand() < 1)
+    {
+        id = grid->spawn_function();
+        if (id == ALL_MOBS)
+            id = get_spawn_id(RR_GLOBAL_BIOME, grid);
+        else if (id == DIFFICULT_MOBS)
+            id = get_difficult_spawn_id(RR_GLOBAL_BIOME);
+    }
+    else
+        id = get_spawn_id(RR_GLOBAL_BIOME, grid);
+    uint8_t rarity =
+        get_spawn_rarity(grid->difficulty + grid->local_difficulty * 0);
+    if (!should_spawn_at(id, rarity))
+        return;
+    for (uint32_t n = 0; n < 10; ++n)
+    {
+        struct rr_vector pos = {(grid_x + rr_frand()) * arena->maze->grid_size,
+                                (grid_y + rr_frand()) * arena->maze->grid_size};
+        if (too_close(this, pos.x, pos.y,
+                      RR_MOB_DATA[id].radius *
+                              RR_MOB_RARITY_SCALING[rarity].radius +
+                          500))
+            continue;
+        EntityIdx mob_id = rr_simulation_alloc_mob(
+            this, 1, pos.x, pos.y, id, rarity, rr_simulation_team_id_mobs);
+        rr_simulation_get_mob(this, mob_id)->zone = grid;
+        grid->grid_points += RR_MOB_DIFFICULTY_COEFFICIENTS[id];
+        grid->spawn_timer = 0;
+        break;
+    }
+}
+
+static void count_flower_vicinity(EntityIdx entity, void *_simulation)
+{
+    struct rr_simulation *this = _simulation;
+    struct rr_component_arena *arena = rr_simulation_get_arena(this, 1);
+    struct rr_component_physical *physical =
+        rr_simulation_get_physical(this, entity);
+    struct rr_component_relations *relations =
+        rr_simulation_get_relations(this, entity);
+    struct rr_component_player_info *player_info =
+        rr_simulation_get_player_info(this, relations->owner);
+    if (is_dead_flower(this, entity))
+        return;
+    if (physical->bubbling_to_death)
+        return;
+    if (player_info->client->disconnected)
+        return;
+    if (dev_cheat_enabled(this, entity, no_grid_influence))
+        return;
+#define FOV 3072
+    uint32_t sx = rr_fclamp((physical->x - FOV) / arena->maze->grid_size, 0,
+                            arena->maze->maze_dim - 1);
+    uint32_t sy = rr_fclamp((physical->y - FOV) / arena->maze->grid_size, 0,
+                            arena->maze->maze_dim - 1);
+    uint32_t ex = rr_fclamp((physical->x + FOV) / arena->maze->grid_size, 0,
+                            arena->maze->maze_dim - 1);
+    uint32_t ey = rr_fclamp((physical->y + FOV) / arena->maze->grid_size, 0,
+                            arena->maze->maze_dim - 1);
+#undef FOV
+    uint32_t level = rr_simulation_get_flower(_simulation, entity)->level;
+    for (uint32_t x = sx; x <= ex; ++x)
+        for (uint32_t y = sy; y <= ey; ++y)
+        {
+            struct rr_maze_grid *grid =
+                rr_component_arena_get_grid(arena, x, y);
+            grid->player_count += grid->player_count < PLAYER_COUNT_CAP;
+            grid->local_difficulty +=
+                rr_fclamp((level - (grid->difficulty - 1) * 2.1) / 10, -1, 1);
+        }
+}
+
+static void despawn_mob(EntityIdx entity, void *_simulation)
+{
+    struct rr_simulation *this = _simulation;
+    struct rr_component_physical *physical =
+        rr_simulation_get_physical(this, entity);
+    if (physical->arena != 1)
+        return;
+    if (rr_simulation_has_arena(this, entity))
+        return;
+    struct rr_component_arena *arena = rr_simulation_get_arena(this, 1);
+    struct rr_component_mob *mob = rr_simulation_get_mob(this, entity);
+    if (mob->player_spawned)
+        return;
+    if (rr_component_arena_get_grid(
+            arena,
+            rr_fclamp(physical->x / arena->maze->grid_size, 0,
+                      arena->maze->maze_dim - 1),
+            rr_fclamp(physical->y / arena->maze->grid_size, 0,
+                      arena->maze->maze_dim - 1))
+            ->player_count == 0)
+    {
+        if (mob->ticks_to_despawn > 30 * 25)
+            mob->ticks_to_despawn = 30 * 25;
+        if (--mob->ticks_to_despawn == 0)
+        {
+            mob->no_drop = 0;
+            rr_simulation_request_entity_deletion(this, entity);
+        }
+    }
+    else
+        mob->ticks_to_despawn = 30 * 25;
+}
+
+static float get_max_points(struct rr_simulation *this,
+                            struct rr_maze_grid *grid)
+{
+    float coeff = rr_simulation_get_arena(this, 1)->pvp ? 0.3 : 3;
+    return coeff * (0.2 + (grid->player_count) * 1.2) *
+           powf(1.1, grid->overload_factor);
+}
+static int tick_grid(struct rr_simulation *this, struct rr_maze_grid *grid,
+                     uint32_t grid_x, uint32_t grid_y)
+{
+    if (grid->value == 0 || (grid->value & 8))
+        return 0;
+    grid->local_difficulty =
+        rr_fclamp(grid->local_difficulty, -0.5, PLAYER_COUNT_CAP);
+    if (grid->local_difficulty > 0)
+    {
+        grid->overload_factor = rr_fclamp(
+            grid->overload_factor + 0.005 * grid->local_difficulty / 25, 0,
+            1.5 * grid->local_difficulty);
+    }
+    else
+    {
+        grid->overload_factor = rr_fclamp(grid->overload_factor - 0.025 / 25, 0,
+                                          grid->overload_factor);
+    }
+    float player_modifier = 1 + grid->player_count * 4.0 / 3;
+    float difficulty_modifier = 150 + 3 * grid->difficulty;
+    float overload_modifier =
+        powf(1.2, grid->local_difficulty + grid->overload_factor);
+    float max_points = get_max_points(this, grid);
+    if (grid->grid_points >= max_points)
+        return 0;
+    float base_modifier = (max_points) / (max_points - grid->grid_points);
+    float spawn_at = base_modifier * difficulty_modifier * overload_modifier /
+                     (player_modifier);
+    if (grid->player_count == 0)
+    {
+        grid->overload_factor =
+            rr_fclamp(grid->overload_factor - 0.025 / 25, 0, 15);
+        grid->spawn_timer = rr_frand() * 0.75 * spawn_at;
+    }
+    else if (grid->spawn_timer >= spawn_at)
+    {
+        spawn_mob(this, grid_x, grid_y);
+        return 1;
+    }
+    else
+        ++grid->spawn_timer;
+    return 0;
+}
+
+static void reference_tick_maze(struct rr_simulation *this)
+{
+    struct rr_component_arena *arena = rr_simulation_get_arena(this, 1);
+    for (uint32_t i = 0; i < arena->maze->maze_dim * arena->maze->maze_dim; ++i)
+        arena->maze->maze[i].local_difficulty =
+            arena->maze->maze[i].player_count = 0;
+
+    rr_simulation_for_each_flower(this, this, count_flower_vicinity);
+    rr_simulation_for_each_mob(this, this, despawn_mob);
+    for (uint32_t grid_x = 0; grid_x < arena->maze->maze_dim; grid_x += 2)
+    {
+        for (uint32_t grid_y = 0; grid_y < arena->maze->maze_dim; grid_y += 2)
+        {
+            struct rr_maze_grid *nw =
+                rr_component_arena_get_grid(arena, grid_x, grid_y);
+            struct rr_maze_grid *ne =
+                rr_component_arena_get_grid(arena, grid_x + 1, grid_y);
+            struct rr_maze_grid *sw =
+                rr_component_arena_get_grid(arena, grid_x, grid_y + 1);
+            struct rr_maze_grid *se =
+                rr_component_arena_get_grid(arena, grid_x + 1, grid_y + 1);
+            float max_overall =
+                get_max_points(this, nw) + get_max_points(this, ne) +
+                get_max_points(this, sw) + get_max_points(this, se);
+            if (nw->grid_points + ne->grid_points + sw->grid_points +
+                    se->grid_points >
+                max_overall)
+                continue;
+            if (tick_grid(this, nw, grid_x, grid_y))
+                continue;
+            if (tick_grid(this, ne, grid_x + 1, grid_y))
+                continue;
+            if (tick_grid(this, sw, grid_x, grid_y + 1))
+                continue;
+            if (tick_grid(this, se, grid_x + 1, grid_y + 1))
+                continue;
+        }
+    }
+}
+
+#undef PLAYER_COUNT_CAP
+#undef ALL_MOBS
+#undef DIFFICULT_MOBS
+
+static uint8_t is_open(float x, float y)
+{
+    struct rr_maze_collision *collision = &RR_MAZE_COLLISIONS[RR_GLOBAL_BIOME];
+    return rr_maze_collision_get_shape(collision,
+                                       floorf(x / collision->grid_size),
+                                       floorf(y / collision->grid_size))
+               ->tile == 1;
+}
+
+static void random_open_position(float *x, float *y)
+{
+    struct rr_maze_collision *collision = &RR_MAZE_COLLISIONS[RR_GLOBAL_BIOME];
+    do
+    {
+        *x = rr_frand() * collision->maze_dim * collision->grid_size;
+        *y = rr_frand() * collision->maze_dim * collision->grid_size;
+    } while (!is_open(*x, *y));
+}
+
+// flowers keep a heading for a while and pick a new one at walls. they stay
+// for a few minutes at a time and come back somewhere else
+static struct trace_entry *record_trace(uint32_t ticks, uint32_t flowers)
+{
+    struct trace_entry *trace = calloc(ticks * flowers, sizeof *trace);
+    for (uint32_t f = 0; f < flowers; ++f)
+    {
+        float x = 0;
+        float y = 0;
+        float angle = 0;
+        uint32_t level = 1 + rand() % 150;
+        int32_t phase_left = rand() % 500;
+        uint8_t present = 0;
+        for (uint32_t t = 0; t < ticks; ++t)
+        {
+            if (--phase_left <= 0)
+            {
+                present ^= 1;
+                phase_left = present ? 500 + rand() % 3500 : rand() % 500;
+                if (present)
+                    random_open_position(&x, &y);
+            }
+            if (rand() % 100 == 0)
+                angle = rr_frand() * M_PI * 2;
+            float next_x = x + cosf(angle) * FLOWER_SPEED;
+            float next_y = y + sinf(angle) * FLOWER_SPEED;
+            if (is_open(next_x, next_y))
+            {
+                x = next_x;
+                y = next_y;
+            }
+            else
+                angle = rr_frand() * M_PI * 2;
+            if (present && rand() % 300 == 0)
+                ++level;
+            trace[t * flowers + f] =
+                (struct trace_entry){x, y, level, present};
+        }
+    }
+    return trace;
+}
+
+static void add_flower(struct rr_server *server, uint32_t pos)
+{
+    struct rr_server_client *client = &server->clients[pos];
+    rr_server_client_init(client);
+    client->server = server;
+    client->in_use = 1;
+    client->verified = 1;
+    rr_bitset_set(server->clients_in_use, pos);
+    rr_client_join_squad(server, client, pos / RR_SQUAD_MEMBER_COUNT);
+    rr_squad_get_client_slot(server, client)->playing = 1;
+}
+
+static void replay(struct rr_server *server, struct trace_entry *entries,
+                   uint32_t flowers)
+{
+    struct rr_simulation *simulation = &server->simulation;
+    for (uint32_t f = 0; f < flowers; ++f)
+    {
+        struct rr_server_client *client = &server->clients[f];
+        if (!entries[f].present)
+        {
+            if (client->player_info != NULL)
+            {
+                rr_simulation_request_entity_deletion(
+                    simulation, client->player_info->parent_id);
+                client->player_info = NULL;
+            }
+            continue;
+        }
+        if (client->player_info == NULL)
+            rr_server_client_create_player_info(server, client);
+        if (!rr_simulation_entity_alive(simulation,
+                                        client->player_info->flower_id))
+            rr_simulation_alloc_player(simulation, 1,
+                                       client->player_info->parent_id);
+        EntityIdx flower = client->player_info->flower_id;
+        struct rr_component_physical *physical =
+            rr_simulation_get_physical(simulation, flower);
+        rr_component_physical_set_x(physical, entries[f].x);
+        rr_component_physical_set_y(physical, entries[f].y);
+        rr_component_flower_set_level(
+            rr_simulation_get_flower(simulation, flower), entries[f].level);
+    }
+}
+
+static void delete_drop(EntityIdx entity, void *simulation)
+{
+    rr_simulation_request_entity_deletion(simulation, entity);
+}
+
+// the end of rr_simulation_tick, the rest of it isn't run. nothing picks up
+// the drops of despawned mobs either
+static void end_tick(struct rr_simulation *this)
+{
+    rr_simulation_for_each_drop(this, this, delete_drop);
+    rr_simulation_release_entity_ids(this);
+    memcpy(this->deleted_last_tick, this->pending_deletions,
+           sizeof this->pending_deletions);
+    memset(this->pending_deletions, 0, sizeof this->pending_deletions);
+    rr_bitset_for_each_bit(
+        this->deleted_last_tick,
+        this->deleted_last_tick + RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT), this,
+        __rr_simulation_pending_deletion_free_components);
+    rr_bitset_for_each_bit(
+        this->deleted_last_tick,
+        this->deleted_last_tick + RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT), this,
+        __rr_simulation_pending_deletion_unset_entity);
+}
+
+static void count_spawns(struct rr_simulation *this, EntityIdx before,
+                         struct spawn_stats *stats, uint32_t window)
+{
+    struct rr_component_arena *arena = rr_simulation_get_arena(this, 1);
+    uint32_t regions = arena->maze->maze_dim / REGION_SIZE;
+    for (EntityIdx i = before; i < this->mob_count; ++i)
+    {
+        EntityIdx mob = this->mob_vector[i];
+        struct rr_component_physical *physical =
+            rr_simulation_get_physical(this, mob);
+        uint32_t x = physical->x / arena->maze->grid_size / REGION_SIZE;
+        uint32_t y = physical->y / arena->maze->grid_size / REGION_SIZE;
+        ++stats->ids[rr_simulation_get_mob(this, mob)->id];
+        ++stats->rarities[rr_simulation_get_mob(this, mob)->rarity];
+        ++stats->regions[y * regions + x];
+        ++stats->windows[window];
+        ++stats->total;
+    }
+}
+
+// wilson-hilferty approximation of the 99.9th percentile
+static double critical_value(uint32_t degrees)
+{
+    double spread = 2.0 / (9 * degrees);
+    return degrees * pow(1 - spread + 3.09 * sqrt(spread), 3);
+}
+
+static uint8_t compare(char const *name, uint32_t *a, uint32_t *b,
+                       uint32_t count)
+{
+    double total_a = 0;
+    double total_b = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        total_a += a[i];
+        total_b += b[i];
+    }
+    double statistic = 0;
+    uint32_t bins = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (a[i] + b[i] == 0)
+            continue;
+        double difference =
+            sqrt(total_b / total_a) * a[i] - sqrt(total_a / total_b) * b[i];
+        statistic += difference * difference / (a[i] + b[i]);
+        ++bins;
+    }
+    double critical = bins > 1 ? critical_value(bins - 1) : 0;
+    uint8_t passed = bins <= 1 || statistic <= critical;
+    printf("%-12s %6u %10.2f %10.2f %s\n", name, bins, statistic, critical,
+           passed ? "" : "MISMATCH");
+    return passed;
+}
+
+// both runs follow the same trace, so the spawns of a stretch of time are
+// compared pairwise. a t-test on the differences catches a change in rate
+// that the chi-square tests are too forgiving for
+static uint8_t compare_rate(uint32_t *a, uint32_t *b, uint32_t count)
+{
+    double mean = 0;
+    for (uint32_t i = 0; i < count; ++i)
+        mean += ((double)b[i] - a[i]) / count;
+    double variance = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        double difference = (double)b[i] - a[i] - mean;
+        variance += difference * difference / (count - 1);
+    }
+    double statistic = variance > 0 ? mean / sqrt(variance / count) : 0;
+    // two sided 0.1%
+    uint8_t passed = count < 2 || fabs(statistic) <= 3.29;
+    printf("%-12s %6u %10.2f %10.2f %s\n", "rate (t)", count, statistic, 3.29,
+           passed ? "" : "MISMATCH");
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t tick_count = argc > 1 ? atoi(argv[1]) : 30000;
+    uint32_t flower_count = argc > 2 ? atoi(argv[2]) : 24;
+    uint32_t seed = argc > 3 ? atoi(argv[3]) : 1;
+    if (flower_count > RR_MAX_CLIENT_COUNT)
+        flower_count = RR_MAX_CLIENT_COUNT;
+
+    rr_static_data_init();
+    srand(seed);
+    struct trace_entry *trace = record_trace(tick_count, flower_count);
+    struct rr_server *servers[2];
+    struct spawn_stats stats[2];
+    uint32_t maze_dim = RR_MAZES[RR_GLOBAL_BIOME].maze_dim;
+    uint32_t region_count =
+        (maze_dim / REGION_SIZE) * (maze_dim / REGION_SIZE);
+    uint32_t window_count = (tick_count + WINDOW_TICKS - 1) / WINDOW_TICKS;
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        servers[i] = calloc(1, sizeof *servers[i]);
+        rr_server_init(servers[i], NULL, 0);
+        for (uint32_t f = 0; f < flower_count; ++f)
+            add_flower(servers[i], f);
+        memset(&stats[i], 0, sizeof stats[i]);
+        stats[i].ids = calloc(rr_mob_id_max, sizeof *stats[i].ids);
+        stats[i].rarities = calloc(rr_rarity_id_max, sizeof *stats[i].rarities);
+        stats[i].regions = calloc(region_count, sizeof *stats[i].regions);
+        stats[i].windows = calloc(window_count, sizeof *stats[i].windows);
+    }
+
+    uint32_t count_mismatches = 0;
+    for (uint32_t tick = 0; tick < tick_count; ++tick)
+    {
+        // 0 is the reference
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            struct rr_simulation *simulation = &servers[i]->simulation;
+            replay(servers[i], &trace[tick * flower_count], flower_count);
+            EntityIdx before = simulation->mob_count;
+            uint64_t start = get_time();
+            if (i == 0)
+                reference_tick_maze(simulation);
+            else
+                rr_simulation_tick_maze(simulation);
+            stats[i].time += get_time() - start;
+            count_spawns(simulation, before, &stats[i], tick / WINDOW_TICKS);
+            end_tick(simulation);
+        }
+        struct rr_maze_grid *expected = servers[0]->simulation.mazes[RR_GLOBAL_BIOME].maze;
+        struct rr_maze_grid *got = servers[1]->simulation.mazes[RR_GLOBAL_BIOME].maze;
+        for (uint32_t i = 0; i < maze_dim * maze_dim; ++i)
+        {
+            float a = rr_fclamp(expected[i].local_difficulty, -0.5,
+                                RR_MAZE_PLAYER_COUNT_CAP);
+            float b = rr_fclamp(got[i].local_difficulty, -0.5,
+                                RR_MAZE_PLAYER_COUNT_CAP);
+            if (expected[i].player_count == got[i].player_count &&
+                fabsf(a - b) < 1e-3)
+                continue;
+            if (count_mismatches++ < 8)
+                printf("tick %u cell %u: %u players, %.4f difficulty instead "
+                       "of %u, %.4f\n",
+                       tick, i, got[i].player_count, b,
+                       expected[i].player_count, a);
+        }
+    }
+
+    printf("%u ticks, %u flowers: %u spawns, previously %u\n", tick_count,
+           flower_count, stats[1].total, stats[0].total);
+    printf("spawn tick: %.1fus, previously %.1fus (%.2fx)\n",
+           stats[1].time * 1e-3 / tick_count, stats[0].time * 1e-3 / tick_count,
+           (double)stats[0].time / stats[1].time);
+    printf("%u player count mismatches\n", count_mismatches);
+    printf("%-12s %6s %10s %10s\n", "spawns by", "bins", "chi^2", "critical");
+    uint8_t passed = count_mismatches == 0;
+    passed &= compare("mob id", stats[0].ids, stats[1].ids, rr_mob_id_max);
+    passed &= compare("rarity", stats[0].rarities, stats[1].rarities,
+                      rr_rarity_id_max);
+    passed &= compare("region", stats[0].regions, stats[1].regions,
+                      region_count);
+    passed &= compare_rate(stats[0].windows, stats[1].windows, window_count);
+    return !passed;
+}
@@ -0,0 +1,166 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// compares the alias table spawn sampling against the functions it replaced.
+// both draw the same number of samples and a two sample chi-square test
+// checks that they come from the same distribution, then both are timed.
+// exits with 1 if any test fails at the 0.1% level
+//
+// usage: rrolf-bench-spawns [samples]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Server/Waves.h>
+#include <Shared/StaticData.h>
+#include <Shared/Utilities.h>
+
+// the kind of draw, biome or difficulty is the parameter
+enum draw
+{
+    draw_id,
+    draw_difficult_id,
+    draw_rarity
+};
+
+static uint64_t get_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// the previous implementations, unchanged apart from the names
+static uint32_t reference_spawn_rarity(float difficulty)
+{
+    if (difficulty < 1)
+        difficulty = 1;
+    double rarity_seed = rr_frand();
+    uint32_t rarity_cap = rr_rarity_id_common + (difficulty + 8) / 8;
+    if (rarity_cap > rr_rarity_id_unique)
+        rarity_cap = rr_rarity_id_unique;
+    uint32_t rarity = rarity_cap >= 2 ? rarity_cap - 2 : 0;
+    for (; rarity < rarity_cap; ++rarity)
+        if (pow(1 - (1 - RR_MOB_WAVE_RARITY_COEFFICIENTS[rarity + 1]) * 0.3,
+                pow(1.5, difficulty)) >= rarity_seed)
+            break;
+    return rarity;
+}
+
+static uint8_t reference_spawn_id(uint8_t biome)
+{
+    double *table = biome == 0 ? RR_HELL_CREEK_MOB_ID_RARITY_COEFFICIENTS
+                               : RR_GARDEN_MOB_ID_RARITY_COEFFICIENTS;
+    double seed = rr_frand();
+    uint8_t id = 0;
+    for (; id < rr_mob_id_max - 1; ++id)
+        if (seed <= table[id])
+            break;
+    return id;
+}
+
+static uint8_t reference_difficult_spawn_id(uint8_t biome)
+{
+    uint8_t id;
+    for (uint8_t i = 0; i < 10; ++i)
+    {
+        id = reference_spawn_id(biome);
+        if (id != rr_mob_id_dakotaraptor && id != rr_mob_id_ornithomimus &&
+            id != rr_mob_id_triceratops && id != rr_mob_id_fern &&
+            id != rr_mob_id_meteor && id != rr_mob_id_golden_meteor)
+            break;
+    }
+    return id;
+}
+
+static uint32_t sample(enum draw draw, uint8_t reference, uint32_t parameter)
+{
+    switch (draw)
+    {
+    case draw_id:
+        return reference ? reference_spawn_id(parameter)
+                         : get_spawn_id(parameter, NULL);
+    case draw_difficult_id:
+        return reference ? reference_difficult_spawn_id(parameter)
+                         : get_difficult_spawn_id(parameter);
+    default:
+        return reference ? reference_spawn_rarity(parameter)
+                         : get_spawn_rarity(parameter);
+    }
+}
+
+// wilson-hilferty approximation of the 99.9th percentile
+static double critical_value(uint32_t degrees)
+{
+    double spread = 2.0 / (9 * degrees);
+    return degrees * pow(1 - spread + 3.09 * sqrt(spread), 3);
+}
+
+static uint8_t run(char const *name, enum draw draw, uint32_t parameter,
+                   uint32_t samples)
+{
+    uint32_t counts[2][rr_mob_id_max];
+    uint64_t times[2];
+    memset(counts, 0, sizeof counts);
+    for (uint8_t reference = 0; reference < 2; ++reference)
+    {
+        uint64_t start = get_time();
+        for (uint32_t i = 0; i < samples; ++i)
+            ++counts[reference][sample(draw, reference, parameter)];
+        times[reference] = get_time() - start;
+    }
+    // equal sample counts, so every bin adds (a - b)^2 / (a + b)
+    double statistic = 0;
+    uint32_t bins = 0;
+    for (uint32_t i = 0; i < rr_mob_id_max; ++i)
+    {
+        double a = counts[0][i];
+        double b = counts[1][i];
+        if (a + b == 0)
+            continue;
+        statistic += (a - b) * (a - b) / (a + b);
+        ++bins;
+    }
+    double critical = bins > 1 ? critical_value(bins - 1) : 0;
+    uint8_t passed = statistic <= critical;
+    printf("%-16s %6u %6u %10.2f %10.2f %10.1f %10.1f %8.2fx %s\n", name,
+           parameter, bins, statistic, critical, times[1] / (double)samples,
+           times[0] / (double)samples, times[1] / (double)times[0],
+           passed ? "" : "MISMATCH");
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t samples = argc > 1 ? atoi(argv[1]) : 2000000;
+    srand(time(NULL));
+    rr_static_data_init();
+    printf("%-16s %6s %6s %10s %10s %10s %10s %9s\n", "draw", "param",
+           "bins", "chi^2", "critical", "old ns", "alias ns", "speedup");
+    uint8_t passed = 1;
+    for (uint8_t biome = 0; biome < 2; ++biome)
+    {
+        passed &= run("id", draw_id, biome, samples);
+        passed &= run("difficult id", draw_difficult_id, biome, samples);
+    }
+    uint32_t const difficulties[] = {0, 1, 3, 8, 15, 24, 37, 60, 100, 200};
+    for (uint32_t i = 0; i < sizeof difficulties / sizeof *difficulties; ++i)
+        passed &= run("rarity", draw_rarity, difficulties[i], samples);
+    return !passed;
+}
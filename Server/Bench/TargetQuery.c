@@ -0,0 +1,496 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// checks the partitioned target queries against the full cell scans they
+// replaced. synthetic players wander arena 1, a quarter of them on pvp
+// teams, and after every tick the spatial hashes are refilled the way
+// collision detection fills them. every flower and mob then looks for its
+// nearest enemy and friend and picks a nearby enemy at a few ranges, with
+// and without a filter. both have to return the same entity. exits with 1
+// on a mismatch
+//
+// usage: rrolf-bench-target-query [flowers] [ticks] [seed]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Server/EntityAllocation.h>
+#include <Server/EntityDetection.h>
+#include <Server/Server.h>
+#include <Server/Simulation.h>
+#include <Server/SpatialHash.h>
+#include <Shared/Utilities.h>
+#include <Shared/Vector.h>
+
+#define PLAYER_LEVEL (150)
+#define WANDER_TICKS (100)
+#define MAX_ENTITY_CHOOSE_COUNT 256
+
+static uint8_t const LOADOUT[] = {
+    rr_petal_id_basic, rr_petal_id_stinger, rr_petal_id_seed,
+    rr_petal_id_web,   rr_petal_id_peas,    rr_petal_id_egg,
+    rr_petal_id_beak,  rr_petal_id_nest,    rr_petal_id_magnet};
+
+static float const RANGES[] = {150, 600, 1500, 4000};
+
+static uint64_t get_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// the previous implementation, unchanged apart from the names
+struct reference_finder_captures
+{
+    struct rr_simulation *simulation;
+    void *captures;
+    uint8_t (*filter)(struct rr_simulation *, EntityIdx, EntityIdx, void *);
+    EntityIdx closest;
+    EntityIdx seeker;
+    uint8_t seeker_team;
+    float closest_dist;
+    float x;
+    float y;
+};
+
+struct reference_chooser_captures
+{
+    struct rr_simulation *simulation;
+    void *captures;
+    uint8_t (*filter)(struct rr_simulation *, EntityIdx, EntityIdx, void *);
+    EntityIdx seeker;
+    uint8_t seeker_team;
+    float range;
+    float x;
+    float y;
+    EntityIdx potential_vector[MAX_ENTITY_CHOOSE_COUNT];
+    float dist_vector[MAX_ENTITY_CHOOSE_COUNT];
+    uint32_t potential_count;
+};
+
+static void reference_cb_enemy(EntityIdx potential, void *_captures)
+{
+    struct reference_finder_captures *captures = _captures;
+    struct rr_simulation *simulation = captures->simulation;
+    uint8_t allow =
+        !rr_simulation_has_arena(simulation, potential) &&
+        (rr_simulation_has_flower(simulation, potential) ||
+         rr_simulation_has_mob(simulation, potential) ||
+         (rr_simulation_has_petal(simulation, potential) &&
+          (rr_simulation_get_petal(simulation, potential)->id ==
+               rr_petal_id_seed ||
+           rr_simulation_get_petal(simulation, potential)->id ==
+               rr_petal_id_nest) &&
+          rr_simulation_get_petal(simulation, potential)->detached));
+    if (!allow)
+        return;
+    if (dev_cheat_enabled(simulation, potential, no_aggro))
+        return;
+    if (is_same_team(rr_simulation_get_relations(simulation, potential)->team,
+                     captures->seeker_team))
+        return;
+    if (rr_simulation_get_health(simulation, potential)->health == 0)
+        return;
+    struct rr_component_physical *t_physical =
+        rr_simulation_get_physical(simulation, potential);
+    struct rr_vector delta = {captures->x - t_physical->x,
+                              captures->y - t_physical->y};
+    float dist =
+        rr_vector_get_magnitude(&delta) * t_physical->aggro_range_multiplier -
+        t_physical->radius;
+    if (rr_simulation_has_petal(simulation, potential))
+        dist *= 2;
+    if (dist > captures->closest_dist)
+        return;
+    if (!captures->filter(simulation, captures->seeker, potential,
+                          captures->captures))
+        return;
+    captures->closest_dist = dist;
+    captures->closest = potential;
+}
+
+static void reference_cb_friend(EntityIdx potential, void *_captures)
+{
+    struct reference_finder_captures *captures = _captures;
+    struct rr_simulation *simulation = captures->simulation;
+    if ((!rr_simulation_has_mob(simulation, potential) &&
+         !rr_simulation_has_flower(simulation, potential)) ||
+        rr_simulation_has_arena(simulation, potential))
+        return;
+    if (!is_same_team(rr_simulation_get_relations(simulation, potential)->team,
+                      captures->seeker_team))
+        return;
+    if (rr_simulation_get_health(simulation, potential)->health == 0)
+        return;
+    struct rr_component_physical *t_physical =
+        rr_simulation_get_physical(simulation, potential);
+    struct rr_vector delta = {captures->x - t_physical->x,
+                              captures->y - t_physical->y};
+    float dist =
+        rr_vector_get_magnitude(&delta) * t_physical->aggro_range_multiplier -
+        t_physical->radius;
+    if (dist > captures->closest_dist)
+        return;
+    if (!captures->filter(simulation, captures->seeker, potential,
+                          captures->captures))
+        return;
+    captures->closest_dist = dist;
+    captures->closest = potential;
+}
+
+static void reference_cb_rand_enemy(EntityIdx potential, void *_captures)
+{
+    struct reference_chooser_captures *captures = _captures;
+    struct rr_simulation *simulation = captures->simulation;
+    uint8_t allow =
+        !rr_simulation_has_arena(simulation, potential) &&
+        (rr_simulation_has_flower(simulation, potential) ||
+         rr_simulation_has_mob(simulation, potential) ||
+         (rr_simulation_has_petal(simulation, potential) &&
+          (rr_simulation_get_petal(simulation, potential)->id ==
+               rr_petal_id_seed ||
+           rr_simulation_get_petal(simulation, potential)->id ==
+               rr_petal_id_nest) &&
+          rr_simulation_get_petal(simulation, potential)->detached));
+    if (!allow)
+        return;
+    if (dev_cheat_enabled(simulation, potential, no_aggro))
+        return;
+    if (is_same_team(rr_simulation_get_relations(simulation, potential)->team,
+                     captures->seeker_team))
+        return;
+    if (rr_simulation_get_health(simulation, potential)->health == 0)
+        return;
+    struct rr_component_physical *t_physical =
+        rr_simulation_get_physical(simulation, potential);
+    struct rr_vector delta = {captures->x - t_physical->x,
+                              captures->y - t_physical->y};
+    float dist =
+        rr_vector_get_magnitude(&delta) * t_physical->aggro_range_multiplier -
+        t_physical->radius;
+    if (rr_simulation_has_petal(simulation, potential))
+        dist *= 2;
+    if (dist > captures->range)
+        return;
+    if (!captures->filter(simulation, captures->seeker, potential,
+                          captures->captures))
+        return;
+    if (captures->potential_count < MAX_ENTITY_CHOOSE_COUNT)
+    {
+        captures->potential_vector[captures->potential_count] = potential;
+        captures->dist_vector[captures->potential_count] = dist;
+        captures->potential_count += 1;
+    }
+    else
+    {
+        float farthest_dist = 0;
+        uint32_t farthest_pos;
+        for (uint32_t i = 0; i < captures->potential_count; ++i)
+        {
+            if (captures->dist_vector[i] > farthest_dist)
+            {
+                farthest_dist = captures->dist_vector[i];
+                farthest_pos = i;
+            }
+        }
+        if (dist < farthest_dist)
+        {
+            captures->potential_vector[farthest_pos] = potential;
+            captures->dist_vector[farthest_pos] = dist;
+        }
+    }
+}
+
+static EntityIdx reference_find_nearest(
+    struct rr_simulation *simulation, EntityIdx seeker, float x, float y,
+    float min_dist, void *captures,
+    uint8_t (*filter)(struct rr_simulation *, EntityIdx, EntityIdx, void *),
+    void (*cb)(EntityIdx, void *))
+{
+    struct rr_component_physical *physical =
+        rr_simulation_get_physical(simulation, seeker);
+    struct reference_finder_captures shg_captures;
+    shg_captures.simulation = simulation;
+    shg_captures.captures = captures;
+    shg_captures.filter = filter;
+    shg_captures.closest = RR_NULL_ENTITY;
+    shg_captures.seeker = seeker;
+    shg_captures.closest_dist = min_dist;
+    shg_captures.x = x;
+    shg_captures.y = y;
+    shg_captures.seeker_team =
+        rr_simulation_get_relations(simulation, seeker)->team;
+    rr_spatial_hash_query(
+        &rr_simulation_get_arena(simulation, physical->arena)->spatial_hash, x,
+        y, min_dist, min_dist, &shg_captures, cb);
+    return shg_captures.closest;
+}
+
+static EntityIdx reference_choose_nearby_enemy(
+    struct rr_simulation *simulation, EntityIdx seeker, float x, float y,
+    float min_dist, void *captures,
+    uint8_t (*filter)(struct rr_simulation *, EntityIdx, EntityIdx, void *))
+{
+    struct rr_component_physical *physical =
+        rr_simulation_get_physical(simulation, seeker);
+    static struct reference_chooser_captures shg_captures;
+    shg_captures.simulation = simulation;
+    shg_captures.captures = captures;
+    shg_captures.filter = filter;
+    shg_captures.seeker = seeker;
+    shg_captures.range = min_dist;
+    shg_captures.x = x;
+    shg_captures.y = y;
+    shg_captures.seeker_team =
+        rr_simulation_get_relations(simulation, seeker)->team;
+    shg_captures.potential_count = 0;
+    rr_spatial_hash_query(
+        &rr_simulation_get_arena(simulation, physical->arena)->spatial_hash, x,
+        y, min_dist, min_dist, &shg_captures, reference_cb_rand_enemy);
+
+    float sum = 0;
+    for (uint32_t i = 0; i < shg_captures.potential_count; ++i)
+        sum += 1 / shg_captures.dist_vector[i];
+    float seed = rr_frand() * sum;
+    for (uint32_t i = 0; i < shg_captures.potential_count; ++i)
+        if ((seed -= 1 / shg_captures.dist_vector[i]) < 0)
+            return shg_captures.potential_vector[i];
+    return RR_NULL_ENTITY;
+}
+
+// rejects about a third of the candidates so ties and later matches matter
+static uint8_t some_filter(struct rr_simulation *simulation, EntityIdx seeker,
+                           EntityIdx target, void *captures)
+{
+    return (seeker * 7 + target) % 3 != 0;
+}
+
+static void add_client(struct rr_server *server, uint32_t pos)
+{
+    struct rr_server_client *client = &server->clients[pos];
+    rr_server_client_init(client);
+    client->server = server;
+    client->in_use = 1;
+    client->verified = 1;
+    client->experience = xp_to_reach_level(PLAYER_LEVEL);
+    rr_bitset_set(server->clients_in_use, pos);
+    rr_client_join_squad(server, client, pos / RR_SQUAD_MEMBER_COUNT);
+    struct rr_squad_member *member = rr_squad_get_client_slot(server, client);
+    snprintf(member->nickname, sizeof member->nickname, "bench %u", pos);
+    for (uint32_t i = 0; i < RR_MAX_SLOT_COUNT * 2; ++i)
+    {
+        member->loadout[i].id =
+            LOADOUT[(i + pos) % (sizeof LOADOUT / sizeof *LOADOUT)];
+        member->loadout[i].rarity = rr_rarity_id_ultimate;
+    }
+    member->playing = 1;
+}
+
+static void spawn_flower(struct rr_server *server, uint32_t pos)
+{
+    struct rr_simulation *simulation = &server->simulation;
+    struct rr_server_client *client = &server->clients[pos];
+    rr_server_client_create_player_info(server, client);
+    EntityIdx flower = rr_simulation_alloc_player(
+        simulation, 1, client->player_info->parent_id);
+    struct rr_maze_declaration *decl = &RR_MAZES[RR_GLOBAL_BIOME];
+    uint32_t zone = rand() % 4;
+    struct rr_component_physical *physical =
+        rr_simulation_get_physical(simulation, flower);
+    rr_component_physical_set_x(
+        physical, 2 * decl->grid_size * (decl->spawn_zones[zone].x + rr_frand()));
+    rr_component_physical_set_y(
+        physical, 2 * decl->grid_size * (decl->spawn_zones[zone].y + rr_frand()));
+    if (pos % 4 == 1)
+        rr_component_relations_set_team(
+            rr_simulation_get_relations(simulation, flower),
+            rr_simulation_team_id_pvp + pos / 4 % 3);
+}
+
+static void drive_clients(struct rr_server *server, uint32_t client_count,
+                          uint32_t tick, float *angles)
+{
+    struct rr_simulation *simulation = &server->simulation;
+    for (uint32_t i = 0; i < client_count; ++i)
+    {
+        struct rr_server_client *client = &server->clients[i];
+        if (client->player_info == NULL)
+        {
+            spawn_flower(server, i);
+            continue;
+        }
+        EntityHash flower = client->player_info->flower_id;
+        if (!rr_simulation_entity_alive(simulation, flower) ||
+            is_dead_flower(simulation, flower))
+        {
+            rr_simulation_request_entity_deletion(
+                simulation, client->player_info->parent_id);
+            client->player_info = NULL;
+            continue;
+        }
+        if ((tick + i * 7) % WANDER_TICKS == 0)
+            angles[i] = rr_frand() * M_PI * 2;
+        rr_vector_from_polar(
+            &rr_simulation_get_physical(simulation, flower)->acceleration,
+            RR_PLAYER_SPEED, angles[i]);
+        client->player_info->input = ((tick / 50 + i) & 1);
+    }
+}
+
+// what collision detection does to the hashes at the start of a tick
+static void reset_hash(EntityIdx entity, void *captures)
+{
+    rr_spatial_hash_reset(
+        &rr_simulation_get_arena(captures, entity)->spatial_hash);
+}
+
+static void insert_entity(EntityIdx entity, void *captures)
+{
+    struct rr_simulation *simulation = captures;
+    rr_spatial_hash_insert(
+        &rr_simulation_get_arena(
+             simulation, rr_simulation_get_physical(simulation, entity)->arena)
+             ->spatial_hash,
+        entity);
+}
+
+static void build_hash(EntityIdx entity, void *captures)
+{
+    rr_spatial_hash_build(
+        &rr_simulation_get_arena(captures, entity)->spatial_hash);
+}
+
+struct query_captures
+{
+    struct rr_simulation *simulation;
+    uint64_t queries;
+    uint64_t found;
+    uint64_t mismatches;
+    uint64_t reference_time;
+    uint64_t time;
+};
+
+static void check(struct query_captures *captures, char const *kind,
+                  EntityIdx seeker, float range, EntityIdx expected,
+                  EntityIdx got)
+{
+    ++captures->queries;
+    captures->found += got != RR_NULL_ENTITY;
+    if (expected == got)
+        return;
+    if (captures->mismatches++ < 10)
+        printf("%s for %u at range %.0f: expected %u got %u\n", kind, seeker,
+               range, expected, got);
+}
+
+static void run_queries(EntityIdx seeker, void *_captures)
+{
+    struct query_captures *captures = _captures;
+    struct rr_simulation *simulation = captures->simulation;
+    if (!rr_simulation_has_mob(simulation, seeker) &&
+        !rr_simulation_has_flower(simulation, seeker))
+        return;
+    if (rr_simulation_has_arena(simulation, seeker))
+        return;
+    struct rr_component_physical *physical =
+        rr_simulation_get_physical(simulation, seeker);
+    for (uint32_t i = 0; i < sizeof RANGES / sizeof *RANGES; ++i)
+        for (uint32_t f = 0; f < 2; ++f)
+        {
+            uint8_t (*filter)(struct rr_simulation *, EntityIdx, EntityIdx,
+                              void *) = f ? some_filter : no_filter;
+            float range = RANGES[i] + physical->radius;
+            float x = physical->x;
+            float y = physical->y;
+            EntityIdx expected[3];
+            EntityIdx got[3];
+            uint32_t seed = rand();
+
+            uint64_t start = get_time();
+            expected[0] = reference_find_nearest(simulation, seeker, x, y,
+                                                 range, NULL, filter,
+                                                 reference_cb_enemy);
+            expected[1] = reference_find_nearest(simulation, seeker, x, y,
+                                                 range, NULL, filter,
+                                                 reference_cb_friend);
+            srand(seed);
+            expected[2] = reference_choose_nearby_enemy(simulation, seeker, x,
+                                                        y, range, NULL, filter);
+            captures->reference_time += get_time() - start;
+
+            start = get_time();
+            got[0] = rr_simulation_find_nearest_enemy(simulation, seeker,
+                                                      RANGES[i], NULL, filter);
+            got[1] = rr_simulation_find_nearest_friend(simulation, seeker,
+                                                       RANGES[i], NULL, filter);
+            srand(seed);
+            got[2] = rr_simulation_choose_nearby_enemy(simulation, seeker,
+                                                       RANGES[i], NULL, filter);
+            captures->time += get_time() - start;
+
+            check(captures, "nearest enemy", seeker, range, expected[0],
+                  got[0]);
+            check(captures, "nearest friend", seeker, range, expected[1],
+                  got[1]);
+            check(captures, "chosen enemy", seeker, range, expected[2],
+                  got[2]);
+        }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t client_count = argc > 1 ? atoi(argv[1]) : 32;
+    uint32_t tick_count = argc > 2 ? atoi(argv[2]) : 600;
+    uint32_t seed = argc > 3 ? atoi(argv[3]) : 1;
+    if (client_count > RR_MAX_CLIENT_COUNT)
+        client_count = RR_MAX_CLIENT_COUNT;
+
+    rr_static_data_init();
+    struct rr_server *server = calloc(1, sizeof *server);
+    rr_server_init(server, NULL, 0);
+    srand(seed);
+    struct rr_simulation *simulation = &server->simulation;
+    float *angles = calloc(client_count, sizeof *angles);
+    for (uint32_t i = 0; i < client_count; ++i)
+        add_client(server, i);
+
+    struct query_captures captures = {simulation};
+    for (uint32_t tick = 0; tick < tick_count; ++tick)
+    {
+        drive_clients(server, client_count, tick, angles);
+        rr_simulation_tick(simulation);
+        rr_simulation_for_each_arena(simulation, simulation, reset_hash);
+        rr_simulation_for_each_physical(simulation, simulation, insert_entity);
+        rr_simulation_for_each_arena(simulation, simulation, build_hash);
+        rr_simulation_for_each_physical(simulation, &captures, run_queries);
+    }
+
+    printf("%u flowers, %u ticks, seed %u, %u mobs at the end\n", client_count,
+           tick_count, seed, simulation->mob_count);
+    printf("%llu queries, %llu found something, %llu mismatches\n",
+           (unsigned long long)captures.queries,
+           (unsigned long long)captures.found,
+           (unsigned long long)captures.mismatches);
+    printf("full cell scan %8.1f ns per query\n",
+           captures.reference_time / (double)captures.queries);
+    printf("target index   %8.1f ns per query\n",
+           captures.time / (double)captures.queries);
+    return captures.mismatches != 0;
+}
@@ -0,0 +1,378 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// headless server tick. synthetic players with full loadouts wander around
+// arena 1 while the maze spawner fills up, then every system, the whole tick
+// and the per client update encoding are timed. no sockets or api involved
+//
+// usage: rrolf-bench [flowers] [ticks] [warmup ticks] [seed] [update budget]
+// RR_SIMULATION_WORKERS and the RR_AI_LOD_ settings are honored the same way
+// as in the real server
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Server/EntityAllocation.h>
+#include <Server/Server.h>
+#include <Server/Simulation.h>
+#include <Server/SpatialHash.h>
+#include <Server/UpdateProtocol.h>
+#include <Shared/Bitset.h>
+#include <Shared/Component/Flower.h>
+#include <Shared/pb.h>
+
+#define MAX_SYSTEM_COUNT (64)
+#define PLAYER_LEVEL (150)
+#define PLAYER_RARITY (rr_rarity_id_ultimate)
+#define WANDER_TICKS (100)
+
+static uint8_t const LOADOUT[] = {
+    rr_petal_id_basic,     rr_petal_id_stinger,  rr_petal_id_gravel,
+    rr_petal_id_pellet,    rr_petal_id_berry,    rr_petal_id_leaf,
+    rr_petal_id_lightning, rr_petal_id_web,      rr_petal_id_bubble,
+    rr_petal_id_magnet,    rr_petal_id_fireball, rr_petal_id_beak,
+    rr_petal_id_shell,     rr_petal_id_peas,     rr_petal_id_egg,
+    rr_petal_id_azalea,    rr_petal_id_bone,     rr_petal_id_seed,
+    rr_petal_id_club,      rr_petal_id_crest,    rr_petal_id_droplet,
+    rr_petal_id_uranium,   rr_petal_id_feather,  rr_petal_id_mandible};
+
+struct samples
+{
+    char const *name;
+    uint64_t *values;
+    uint32_t count;
+};
+
+static struct samples system_samples[MAX_SYSTEM_COUNT];
+static uint32_t system_count;
+// index of the measured tick, warmup ticks are not recorded
+static int64_t measured_tick = -1;
+static uint32_t measured_tick_count;
+
+static uint64_t get_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void samples_init(struct samples *this, char const *name,
+                         uint32_t capacity)
+{
+    this->name = name;
+    this->values = calloc(capacity, sizeof *this->values);
+    this->count = 0;
+}
+
+static int compare_uint64(void const *a, void const *b)
+{
+    uint64_t x = *(uint64_t const *)a;
+    uint64_t y = *(uint64_t const *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(uint64_t *sorted, uint32_t count, double p)
+{
+    if (count == 0)
+        return 0;
+    return sorted[(uint32_t)(p * (count - 1) + 0.5)];
+}
+
+// times are printed in microseconds, everything else as is
+static void samples_print(struct samples *this, double scale)
+{
+    qsort(this->values, this->count, sizeof *this->values, compare_uint64);
+    double sum = 0;
+    for (uint32_t i = 0; i < this->count; ++i)
+        sum += this->values[i];
+    printf("%-24s %10.1f %10.1f %10.1f %10.1f %10.1f\n", this->name,
+           this->count ? sum / this->count * scale : 0,
+           percentile(this->values, this->count, 0.5) * scale,
+           percentile(this->values, this->count, 0.9) * scale,
+           percentile(this->values, this->count, 0.99) * scale,
+           percentile(this->values, this->count, 1) * scale);
+}
+
+static void system_timer(uint32_t index,
+                         struct rr_scheduler_system const *system,
+                         uint64_t nanoseconds, void *captures)
+{
+    if (measured_tick < 0 || index >= MAX_SYSTEM_COUNT)
+        return;
+    // each system only ever writes its own slot so workers don't race here
+    struct samples *samples = &system_samples[index];
+    if (samples->values == NULL)
+        samples_init(samples, system->name, measured_tick_count);
+    samples->values[samples->count++] = nanoseconds;
+    if (index >= system_count)
+        system_count = index + 1;
+}
+
+static void add_client(struct rr_server *server, uint32_t pos)
+{
+    struct rr_server_client *client = &server->clients[pos];
+    rr_server_client_init(client);
+    client->server = server;
+    client->in_use = 1;
+    client->verified = 1;
+    client->experience = xp_to_reach_level(PLAYER_LEVEL);
+    rr_bitset_set(server->clients_in_use, pos);
+    rr_client_join_squad(server, client, pos / RR_SQUAD_MEMBER_COUNT);
+    struct rr_squad_member *member = rr_squad_get_client_slot(server, client);
+    snprintf(member->nickname, sizeof member->nickname, "bench %u", pos);
+    for (uint32_t i = 0; i < RR_MAX_SLOT_COUNT * 2; ++i)
+    {
+        member->loadout[i].id =
+            LOADOUT[(i + pos) % (sizeof LOADOUT / sizeof *LOADOUT)];
+        member->loadout[i].rarity = PLAYER_RARITY;
+    }
+    member->playing = 1;
+}
+
+// rr_server_client_create_flower without the api message
+static void spawn_flower(struct rr_server *server,
+                         struct rr_server_client *client)
+{
+    struct rr_simulation *simulation = &server->simulation;
+    rr_server_client_create_player_info(server, client);
+    EntityIdx flower = rr_simulation_alloc_player(
+        simulation, 1, client->player_info->parent_id);
+    uint32_t spawn_zone = client->player_info->level / 25 > 3
+                              ? 3
+                              : client->player_info->level / 25;
+    struct rr_maze_declaration *decl = &RR_MAZES[RR_GLOBAL_BIOME];
+    struct rr_component_physical *physical =
+        rr_simulation_get_physical(simulation, flower);
+    rr_component_physical_set_x(
+        physical,
+        2 * decl->grid_size * (decl->spawn_zones[spawn_zone].x + rr_frand()));
+    rr_component_physical_set_y(
+        physical,
+        2 * decl->grid_size * (decl->spawn_zones[spawn_zone].y + rr_frand()));
+}
+
+// dead players respawn on the next tick, alive ones pick a new direction
+// every so often and attack half of the time
+static uint32_t drive_clients(struct rr_server *server, uint32_t client_count,
+                              uint32_t tick, float *angles)
+{
+    struct rr_simulation *simulation = &server->simulation;
+    uint32_t deaths = 0;
+    for (uint32_t i = 0; i < client_count; ++i)
+    {
+        struct rr_server_client *client = &server->clients[i];
+        if (client->player_info == NULL)
+        {
+            spawn_flower(server, client);
+            continue;
+        }
+        EntityHash flower = client->player_info->flower_id;
+        if (!rr_simulation_entity_alive(simulation, flower) ||
+            is_dead_flower(simulation, flower))
+        {
+            rr_simulation_request_entity_deletion(
+                simulation, client->player_info->parent_id);
+            client->player_info = NULL;
+            ++deaths;
+            continue;
+        }
+        if ((tick + i * 7) % WANDER_TICKS == 0)
+            angles[i] = rr_frand() * M_PI * 2;
+        rr_vector_from_polar(
+            &rr_simulation_get_physical(simulation, flower)->acceleration,
+            RR_PLAYER_SPEED, angles[i]);
+        client->player_info->input = ((tick / 50 + i) & 1);
+        client->player_info->drops_this_tick_size = 0;
+    }
+    return deaths;
+}
+
+struct encode_captures
+{
+    struct rr_server *server;
+    uint8_t **buffers;
+    uint64_t *times;
+    uint64_t *sizes;
+};
+
+// same split as the server's broadcast, one client per chunk
+static void encode_clients(uint32_t begin, uint32_t end, void *_captures)
+{
+    struct encode_captures *captures = _captures;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        struct rr_server_client *client = &captures->server->clients[i];
+        captures->sizes[i] = 0;
+        if (client->player_info == NULL)
+            continue;
+        struct proto_bug encoder;
+        proto_bug_init(&encoder, captures->buffers[i]);
+        uint64_t start = get_time();
+        rr_simulation_write_binary(&captures->server->simulation,
+                                   &captures->server->entity_cache, &encoder,
+                                   client->player_info);
+        captures->times[i] = get_time() - start;
+        captures->sizes[i] = encoder.current - encoder.start;
+    }
+}
+
+static void reset_protocol_state(EntityIdx entity, void *captures)
+{
+    struct rr_simulation *this = captures;
+#define XX(COMPONENT, ID)                                                      \
+    if (rr_simulation_has_##COMPONENT(this, entity))                           \
+        rr_simulation_get_##COMPONENT(this, entity)->protocol_state = 0;
+    RR_FOR_EACH_COMPONENT
+#undef XX
+    if (rr_simulation_has_physical(this, entity))
+        rr_component_physical_mark_sent(
+            rr_simulation_get_physical(this, entity));
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t client_count = argc > 1 ? atoi(argv[1]) : 16;
+    uint32_t tick_count = argc > 2 ? atoi(argv[2]) : 1500;
+    uint32_t warmup_count = argc > 3 ? atoi(argv[3]) : 750;
+    uint32_t seed = argc > 4 ? atoi(argv[4]) : 1;
+    // fixed per client, there are no sockets to adapt it to
+    uint32_t budget = argc > 5 ? atoi(argv[5]) : RR_UPDATE_BUDGET_MAX;
+    if (client_count > RR_MAX_CLIENT_COUNT)
+        client_count = RR_MAX_CLIENT_COUNT;
+
+    rr_static_data_init();
+    struct rr_server *server = calloc(1, sizeof *server);
+    rr_server_init(server, NULL, 0);
+    srand(seed);
+    struct rr_simulation *simulation = &server->simulation;
+    server->scheduler.system_timer = system_timer;
+    measured_tick_count = tick_count;
+
+    float *angles = calloc(client_count, sizeof *angles);
+    for (uint32_t i = 0; i < client_count; ++i)
+    {
+        add_client(server, i);
+        server->clients[i].update_budget = budget;
+    }
+    struct encode_captures encode;
+    encode.server = server;
+    encode.buffers = calloc(client_count, sizeof *encode.buffers);
+    encode.times = calloc(client_count, sizeof *encode.times);
+    encode.sizes = calloc(client_count, sizeof *encode.sizes);
+    for (uint32_t i = 0; i < client_count; ++i)
+        encode.buffers[i] = malloc(MESSAGE_BUFFER_SIZE);
+
+    struct samples tick_samples;
+    struct samples broadcast_samples;
+    struct samples encode_samples;
+    struct samples bytes_samples;
+    struct samples cache_samples;
+    struct samples entity_samples;
+    struct samples mob_samples;
+    struct samples lod_samples[rr_ai_lod_max];
+    struct samples petal_samples;
+    samples_init(&tick_samples, "tick", tick_count);
+    samples_init(&broadcast_samples, "broadcast", tick_count);
+    samples_init(&encode_samples, "encode per client", tick_count * client_count);
+    samples_init(&bytes_samples, "bytes per client", tick_count * client_count);
+    samples_init(&cache_samples, "entity cache hits (%)", tick_count);
+    samples_init(&entity_samples, "entities", tick_count);
+    samples_init(&mob_samples, "mobs", tick_count);
+    samples_init(&lod_samples[rr_ai_lod_full], "mobs at full ai", tick_count);
+    samples_init(&lod_samples[rr_ai_lod_reduced], "mobs at reduced ai",
+                 tick_count);
+    samples_init(&lod_samples[rr_ai_lod_frozen], "frozen mobs", tick_count);
+    samples_init(&petal_samples, "petals", tick_count);
+    uint32_t deaths = 0;
+
+    for (uint32_t tick = 0; tick < warmup_count + tick_count; ++tick)
+    {
+        uint8_t measuring = tick >= warmup_count;
+        measured_tick = measuring ? (int64_t)tick - warmup_count : -1;
+        deaths += drive_clients(server, client_count, tick, angles) * measuring;
+
+        uint64_t start = get_time();
+        rr_simulation_tick(simulation);
+        if (measuring)
+            tick_samples.values[tick_samples.count++] = get_time() - start;
+
+        // the server builds the spatial hashes before fanning out too
+        start = get_time();
+        for (uint32_t i = 0; i < simulation->arena_count; ++i)
+            rr_spatial_hash_build(
+                &rr_simulation_get_arena(simulation,
+                                         simulation->arena_vector[i])
+                     ->spatial_hash);
+        rr_entity_cache_begin_tick(&server->entity_cache);
+        rr_scheduler_parallel_for(&server->scheduler, client_count, 1, &encode,
+                                  encode_clients);
+        if (measuring)
+            broadcast_samples.values[broadcast_samples.count++] =
+                get_time() - start;
+        for (uint32_t i = 0; measuring && i < client_count; ++i)
+        {
+            if (server->clients[i].player_info == NULL)
+                continue;
+            encode_samples.values[encode_samples.count++] = encode.times[i];
+            bytes_samples.values[bytes_samples.count++] = encode.sizes[i];
+        }
+        rr_simulation_for_each_entity(simulation, simulation,
+                                      reset_protocol_state);
+        simulation->animation_length = 0;
+
+        if (!measuring)
+            continue;
+        uint64_t hits = atomic_load(&server->entity_cache.hits);
+        uint64_t misses = atomic_load(&server->entity_cache.misses);
+        if (hits + misses != 0)
+            cache_samples.values[cache_samples.count++] =
+                hits * 100 / (hits + misses);
+        entity_samples.values[entity_samples.count++] =
+            RR_MAX_ENTITY_COUNT - 1 -
+            rr_simulation_get_free_entity_count(simulation);
+        mob_samples.values[mob_samples.count++] = simulation->mob_count;
+        for (uint32_t i = 0; i < rr_ai_lod_max; ++i)
+            lod_samples[i].values[lod_samples[i].count++] =
+                simulation->ai_lod_counts[i];
+        petal_samples.values[petal_samples.count++] = simulation->petal_count;
+    }
+
+    printf("\n%u flowers, %u ticks after %u warmup, seed %u, %u workers, "
+           "%u deaths, %u byte budget\n\n",
+           client_count, tick_count, warmup_count, seed,
+           server->scheduler.worker_count, deaths, budget);
+    printf("%-24s %10s %10s %10s %10s %10s\n", "us", "mean", "p50", "p90",
+           "p99", "max");
+    for (uint32_t i = 0; i < system_count; ++i)
+        if (system_samples[i].values != NULL)
+            samples_print(&system_samples[i], 1e-3);
+    samples_print(&tick_samples, 1e-3);
+    samples_print(&broadcast_samples, 1e-3);
+    samples_print(&encode_samples, 1e-3);
+    printf("\n%-24s %10s %10s %10s %10s %10s\n", "", "mean", "p50", "p90",
+           "p99", "max");
+    samples_print(&bytes_samples, 1);
+    samples_print(&cache_samples, 1);
+    samples_print(&entity_samples, 1);
+    samples_print(&mob_samples, 1);
+    for (uint32_t i = 0; i < rr_ai_lod_max; ++i)
+        samples_print(&lod_samples[i], 1);
+    samples_print(&petal_samples, 1);
+    return 0;
+}
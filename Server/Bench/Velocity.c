@@ -0,0 +1,371 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// checks the precomputed maze collision against the wall resolution it
+// replaced on random circles near every cell of every maze, both have to
+// land on the same bits. then times both on the positions of wandering mobs
+// and times the whole velocity system with them. exits with 1 on a mismatch
+//
+// usage: rrolf-bench-velocity [mobs] [ticks] [seed]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Server/EntityAllocation.h>
+#include <Server/MazeCollision.h>
+#include <Server/Server.h>
+#include <Server/Simulation.h>
+#include <Server/System/System.h>
+#include <Shared/Utilities.h>
+#include <Shared/Vector.h>
+
+#define QUERIES_PER_CELL (64)
+
+struct query
+{
+    float x;
+    float y;
+    int32_t grid_x;
+    int32_t grid_y;
+    float radius;
+};
+
+static uint64_t get_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// the previous implementation, unchanged apart from the name
+static void reference_resolve(struct rr_component_arena *arena, float test_x,
+                              float test_y, int32_t x, int32_t y,
+                              struct rr_component_physical *physical)
+{
+    // add a check for in-wall
+    uint32_t size = arena->maze->maze_dim;
+    float maze_dim = arena->maze->grid_size;
+#define offset(a, b)                                                           \
+    ((x + a < 0 || y + b < 0 || x + a >= size || y + b >= size)                \
+         ? 0                                                                   \
+         : rr_component_arena_get_grid(arena, x + a, y + b)->value)
+
+#define curve_check                                                            \
+    {                                                                          \
+        struct rr_vector dist = {test_x - cx, test_y - cy};                    \
+        if (rr_vector_magnitude_cmp(&dist, maze_dim - physical->radius) ==     \
+                1 &&                                                           \
+            inverse == 0)                                                      \
+        {                                                                      \
+            rr_vector_set_magnitude(&dist, maze_dim - physical->radius);       \
+            rr_component_physical_set_x(physical, cx + dist.x);                \
+            rr_component_physical_set_y(physical, cy + dist.y);                \
+            rr_vector_set(&physical->wall_collision, -dist.x, -dist.y);        \
+            return;                                                            \
+        }                                                                      \
+        if (rr_vector_magnitude_cmp(&dist, maze_dim + physical->radius) ==     \
+                -1 &&                                                          \
+            inverse == 1)                                                      \
+        {                                                                      \
+            rr_vector_set_magnitude(&dist, maze_dim + physical->radius);       \
+            rr_component_physical_set_x(physical, cx + dist.x);                \
+            rr_component_physical_set_y(physical, cy + dist.y);                \
+            rr_vector_set(&physical->wall_collision, dist.x, dist.y);          \
+            return;                                                            \
+        }                                                                      \
+    }
+
+    if (offset(0, 0) != 1)
+    {
+        // tile can't be 0 (that would be illegal)
+        uint8_t tile = offset(0, 0);
+        if (tile == 0)
+            return;
+        uint8_t left = (tile >> 1) & 1;
+        uint8_t top = tile & 1;
+        uint8_t inverse = ((tile >> 3) & 1);
+        float cx = (x + left) * maze_dim;
+        float cy = (y + top) * maze_dim;
+        curve_check;
+    }
+    if (offset(-1, 0) != 1 && test_x - x * maze_dim < physical->radius)
+    {
+        uint8_t tile = offset(-1, 0);
+        if (tile == 0)
+        {
+            test_x = x * maze_dim + physical->radius;
+            rr_component_physical_set_x(physical, test_x);
+            rr_component_physical_set_y(physical, test_y);
+            rr_vector_set(&physical->wall_collision, 1, 0);
+            return;
+        }
+        else
+        {
+            uint8_t left = (tile >> 1) & 1;
+            uint8_t top = tile & 1;
+            uint8_t inverse = ((tile >> 3) & 1);
+            float cx = (x - 1 + left) * maze_dim;
+            float cy = (y + top) * maze_dim;
+            curve_check;
+        }
+    }
+    if (offset(0, -1) != 1 && test_y - y * maze_dim < physical->radius)
+    {
+        uint8_t tile = offset(0, -1);
+        if (tile == 0)
+        {
+            test_y = y * maze_dim + physical->radius;
+            rr_component_physical_set_x(physical, test_x);
+            rr_component_physical_set_y(physical, test_y);
+            rr_vector_set(&physical->wall_collision, 0, 1);
+            return;
+        }
+        else
+        {
+            uint8_t left = (tile >> 1) & 1;
+            uint8_t top = tile & 1;
+            uint8_t inverse = ((tile >> 3) & 1);
+            float cx = (x + left) * maze_dim;
+            float cy = (y - 1 + top) * maze_dim;
+            curve_check;
+        }
+    }
+    if (offset(1, 0) != 1 && (x + 1) * maze_dim - test_x < physical->radius)
+    {
+        uint8_t tile = offset(1, 0);
+        if (tile == 0)
+        {
+            test_x = (x + 1) * maze_dim - physical->radius;
+            rr_component_physical_set_x(physical, test_x);
+            rr_component_physical_set_y(physical, test_y);
+            rr_vector_set(&physical->wall_collision, -1, 0);
+            return;
+        }
+        else
+        {
+            uint8_t left = (tile >> 1) & 1;
+            uint8_t top = tile & 1;
+            uint8_t inverse = ((tile >> 3) & 1);
+            float cx = (x + 1 + left) * maze_dim;
+            float cy = (y + top) * maze_dim;
+            curve_check;
+        }
+    }
+    if (offset(0, 1) != 1 && (y + 1) * maze_dim - test_y < physical->radius)
+    {
+        uint8_t tile = offset(0, 1);
+        if (tile == 0)
+        {
+            test_y = (y + 1) * maze_dim - physical->radius;
+            rr_component_physical_set_x(physical, test_x);
+            rr_component_physical_set_y(physical, test_y);
+            rr_vector_set(&physical->wall_collision, 0, -1);
+            return;
+        }
+        else
+        {
+            uint8_t left = (tile >> 1) & 1;
+            uint8_t top = tile & 1;
+            uint8_t inverse = ((tile >> 3) & 1);
+            float cx = (x + left) * maze_dim;
+            float cy = (y + 1 + top) * maze_dim;
+            curve_check;
+        }
+    }
+    rr_component_physical_set_x(physical, test_x);
+    rr_component_physical_set_y(physical, test_y);
+#undef offset
+#undef curve_check
+}
+
+static void reset_physical(struct rr_component_physical *physical,
+                           struct query *query)
+{
+    memset(physical, 0, sizeof *physical);
+    physical->radius = query->radius;
+    // a sentinel so that not moving at all is also compared
+    physical->x = physical->y = -12345;
+}
+
+static uint8_t same_result(struct rr_component_physical *a,
+                           struct rr_component_physical *b)
+{
+    return memcmp(&a->x, &b->x, sizeof a->x) == 0 &&
+           memcmp(&a->y, &b->y, sizeof a->y) == 0 &&
+           memcmp(&a->wall_collision, &b->wall_collision,
+                  sizeof a->wall_collision) == 0;
+}
+
+// circles anywhere from well inside a cell to reaching over its faces,
+// including the ring of cells just outside the maze
+static uint32_t check_biome(uint8_t biome)
+{
+    struct rr_maze_declaration *maze = &RR_MAZES[biome];
+    struct rr_component_arena arena;
+    memset(&arena, 0, sizeof arena);
+    arena.maze = maze;
+    arena.collision = &RR_MAZE_COLLISIONS[biome];
+    float size = maze->grid_size;
+    uint32_t mismatches = 0;
+    struct rr_component_physical expected;
+    struct rr_component_physical got;
+    for (int32_t y = -2; y < (int32_t)maze->maze_dim + 2; ++y)
+        for (int32_t x = -2; x < (int32_t)maze->maze_dim + 2; ++x)
+            for (uint32_t i = 0; i < QUERIES_PER_CELL; ++i)
+            {
+                struct query query = {(x + rr_frand() * 1.2f - 0.1f) * size,
+                                      (y + rr_frand() * 1.2f - 0.1f) * size,
+                                      x, y, 1 + rr_frand() * size * 0.5f};
+                reset_physical(&expected, &query);
+                reset_physical(&got, &query);
+                reference_resolve(&arena, query.x, query.y, x, y, &expected);
+                rr_maze_collision_resolve(arena.collision, query.x, query.y,
+                                          x, y, &got);
+                if (same_result(&expected, &got))
+                    continue;
+                if (mismatches++ < 8)
+                    printf("mismatch biome %u cell %d %d at %.3f %.3f r %.3f: "
+                           "%.3f %.3f (%.3f %.3f) instead of %.3f %.3f "
+                           "(%.3f %.3f)\n",
+                           biome, x, y, query.x, query.y, query.radius, got.x,
+                           got.y, got.wall_collision.x, got.wall_collision.y,
+                           expected.x, expected.y, expected.wall_collision.x,
+                           expected.wall_collision.y);
+            }
+    printf("biome %u: %u cells, %u shapes, %u mismatches\n", biome,
+           maze->maze_dim * maze->maze_dim, RR_MAZE_COLLISIONS[biome].shape_count,
+           mismatches);
+    return mismatches;
+}
+
+static EntityIdx spawn_mob(struct rr_simulation *simulation, EntityIdx arena_id)
+{
+    struct rr_component_arena *arena =
+        rr_simulation_get_arena(simulation, arena_id);
+    float size = arena->maze->grid_size;
+    while (1)
+    {
+        int32_t x = rand() % arena->maze->maze_dim;
+        int32_t y = rand() % arena->maze->maze_dim;
+        if (rr_maze_collision_get_shape(arena->collision, x, y)->tile != 1)
+            continue;
+        return rr_simulation_alloc_mob(
+            simulation, arena_id, (x + rr_frand()) * size,
+            (y + rr_frand()) * size, rr_mob_id_triceratops,
+            rr_rarity_id_common, rr_simulation_team_id_mobs);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t mob_count = argc > 1 ? atoi(argv[1]) : 5000;
+    uint32_t tick_count = argc > 2 ? atoi(argv[2]) : 500;
+    uint32_t seed = argc > 3 ? atoi(argv[3]) : 1;
+
+    rr_static_data_init();
+    srand(seed);
+    uint32_t mismatches = 0;
+    for (uint8_t biome = 0; biome < rr_biome_id_max; ++biome)
+        mismatches += check_biome(biome);
+
+    struct rr_server *server = calloc(1, sizeof *server);
+    rr_server_init(server, NULL, 0);
+    struct rr_simulation *simulation = &server->simulation;
+    EntityIdx arena_id = simulation->arena_vector[0];
+    struct rr_component_arena *arena =
+        rr_simulation_get_arena(simulation, arena_id);
+    EntityIdx *mobs = malloc(mob_count * sizeof *mobs);
+    float *angles = malloc(mob_count * sizeof *angles);
+    for (uint32_t i = 0; i < mob_count; ++i)
+    {
+        mobs[i] = spawn_mob(simulation, arena_id);
+        angles[i] = rr_frand() * M_PI * 2;
+    }
+
+    // the positions the mobs walk through, fed to both resolvers afterwards
+    struct query *queries = malloc(mob_count * tick_count * sizeof *queries);
+    uint32_t query_count = 0;
+    uint64_t system_time = 0;
+    uint32_t wall_hits = 0;
+    for (uint32_t tick = 0; tick < tick_count; ++tick)
+    {
+        for (uint32_t i = 0; i < mob_count; ++i)
+        {
+            struct rr_component_physical *physical =
+                rr_simulation_get_physical(simulation, mobs[i]);
+            // walls turn the mobs around, otherwise they drift
+            if (physical->wall_collision.x || physical->wall_collision.y)
+                angles[i] = rr_vector_theta(&physical->wall_collision) +
+                            (rr_frand() - 0.5f) * M_PI;
+            else
+                angles[i] += (rr_frand() - 0.5f) * 0.2f;
+            rr_vector_from_polar(&physical->acceleration, 5, angles[i]);
+        }
+        uint64_t start = get_time();
+        rr_system_velocity_tick(simulation);
+        system_time += get_time() - start;
+        for (uint32_t i = 0; i < mob_count; ++i)
+        {
+            struct rr_component_physical *physical =
+                rr_simulation_get_physical(simulation, mobs[i]);
+            wall_hits +=
+                physical->wall_collision.x || physical->wall_collision.y;
+            struct query *query = &queries[query_count++];
+            query->x = physical->x + physical->velocity.x;
+            query->y = physical->y + physical->velocity.y;
+            query->grid_x = floorf(query->x / arena->maze->grid_size);
+            query->grid_y = floorf(query->y / arena->maze->grid_size);
+            query->radius = physical->radius;
+        }
+    }
+
+    struct rr_component_physical *expected =
+        malloc(query_count * sizeof *expected);
+    struct rr_component_physical *got = malloc(query_count * sizeof *got);
+    for (uint32_t i = 0; i < query_count; ++i)
+    {
+        reset_physical(&expected[i], &queries[i]);
+        reset_physical(&got[i], &queries[i]);
+    }
+    uint64_t start = get_time();
+    for (uint32_t i = 0; i < query_count; ++i)
+        reference_resolve(arena, queries[i].x, queries[i].y,
+                          queries[i].grid_x, queries[i].grid_y, &expected[i]);
+    uint64_t reference_time = get_time() - start;
+    start = get_time();
+    for (uint32_t i = 0; i < query_count; ++i)
+        rr_maze_collision_resolve(arena->collision, queries[i].x,
+                                  queries[i].y, queries[i].grid_x,
+                                  queries[i].grid_y, &got[i]);
+    uint64_t resolve_time = get_time() - start;
+    uint32_t walk_mismatches = 0;
+    for (uint32_t i = 0; i < query_count; ++i)
+        walk_mismatches += !same_result(&expected[i], &got[i]);
+    mismatches += walk_mismatches;
+
+    printf("%u mobs, %u ticks, %.1f%% of moves hit a wall\n", mob_count,
+           tick_count, 100.0 * wall_hits / query_count);
+    printf("velocity system: %.1fus per tick\n", system_time * 1e-3 / tick_count);
+    printf("wall resolution: %.1fns per call, previously %.1fns (%.2fx), %u "
+           "mismatches\n",
+           (double)resolve_time / query_count,
+           (double)reference_time / query_count,
+           (double)reference_time / resolve_time, walk_mismatches);
+    return mismatches != 0;
+}
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <Server/Crafting.h>
 #include <Server/EntityAllocation.h>
 #include <Server/Server.h>
 #include <Server/Simulation.h>
@@ -48,6 +49,7 @@ void rr_server_client_init(struct rr_server_client *this)
     memset(&this->dev_cheats, 0, sizeof(struct rr_server_client_dev_cheats));
     this->dev_cheats.speed_percent = 1;
     this->dev_cheats.fov_percent = 1;
+    this->update_budget = RR_UPDATE_BUDGET_MAX;
 }
 
 void rr_server_client_create_flower(struct rr_server_client *this)
@@ -78,7 +80,7 @@ void rr_server_client_create_flower(struct rr_server_client *this)
         2 * decl->grid_size * (decl->spawn_zones[spawn_zone].y +
                                rr_frand()));
     struct rr_binary_encoder encoder;
-    rr_binary_encoder_init(&encoder, outgoing_message);
+    rr_binary_encoder_init(&encoder, this->server->outgoing_message);
     rr_binary_encoder_write_uint8(&encoder, 3);
     for (uint64_t i = 0; i < RR_MAX_SLOT_COUNT; i++)
     {
@@ -95,44 +97,83 @@ void rr_server_client_create_flower(struct rr_server_client *this)
         rr_binary_encoder_write_uint8(&encoder, slot->rarity);
     }
     rr_binary_encoder_write_uint8(&encoder, 0);
-    lws_write(this->server->api_client, encoder.start,
-              encoder.at - encoder.start, LWS_WRITE_BINARY);
+    rr_server_write_to_api(this->server, encoder.start,
+                           encoder.at - encoder.start);
 }
 
-void rr_server_client_write_message(struct rr_server_client *this,
-                                    uint8_t *data, uint64_t size)
+static uint8_t begin_message(struct rr_server_client *this,
+                             struct proto_bug *encoder, uint32_t limit)
 {
-    if (this->message_length++ >= 512)
+    uint8_t *frame = NULL;
+    if (this->session != NULL &&
+        rr_frame_pool_size(&this->session->frames) < limit)
+        frame = rr_frame_pool_acquire(&this->session->frames);
+    proto_bug_init(encoder, frame ? frame : this->server->outgoing_message);
+    return frame != NULL;
+}
+
+uint8_t rr_server_client_begin_message(struct rr_server_client *this,
+                                       struct proto_bug *encoder)
+{
+    if (begin_message(this, encoder, RR_SESSION_FRAME_COUNT))
+        return 1;
+    if (this->session != NULL && !this->pending_kick)
     {
+        // the socket isn't keeping up
+        printf("<rr_server::frames_full::%s>\n", this->rivet_account.uuid);
         this->pending_kick = 1;
-        lws_callback_on_writable(this->socket_handle);
-        return;
     }
+    return 0;
+}
+
+uint8_t rr_server_client_begin_droppable_message(struct rr_server_client *this,
+                                                 struct proto_bug *encoder)
+{
+    return begin_message(this, encoder, RR_SESSION_DROPPABLE_FRAMES);
+}
+
+void rr_server_client_end_message(struct rr_server_client *this,
+                                  struct proto_bug *encoder)
+{
+    if (encoder->start == this->server->outgoing_message)
+        return;
+    uint64_t size = encoder->current - encoder->start;
     if (this->received_first_packet)
     {
         this->clientbound_encryption_key =
             rr_get_hash(this->clientbound_encryption_key);
-        rr_encrypt(data, size, this->clientbound_encryption_key);
+        rr_encrypt(encoder->start, size, this->clientbound_encryption_key);
     }
-    struct rr_server_client_message *message = malloc(sizeof *message);
-    uint8_t *packet = malloc(LWS_PRE + size);
-    memcpy(packet + LWS_PRE, data, size);
-    message->next = NULL;
-    message->len = size;
-    message->packet = packet;
-    if (this->message_root == NULL)
-        this->message_root = message;
-    else
-        this->message_at->next = message;
-    this->message_at = message;
-    lws_callback_on_writable(this->socket_handle);
-    // lws_write(this->socket_handle, data, size, LWS_WRITE_BINARY);
+    rr_frame_pool_commit(&this->session->frames, size);
+}
+
+void rr_server_client_update_budget(struct rr_server_client *this)
+{
+    struct rr_frame_pool *frames = &this->session->frames;
+    uint64_t drained = rr_frame_pool_drained(frames);
+    this->drain_rate =
+        (this->drain_rate * 7 + (drained - this->frames_drained)) / 8;
+    this->frames_drained = drained;
+    if (rr_frame_pool_size(frames) <= 1)
+    {
+        // keeping up, what it drained is just what it was given so probe for
+        // more
+        this->update_budget += this->update_budget / 16;
+        if (this->update_budget > RR_UPDATE_BUDGET_MAX)
+            this->update_budget = RR_UPDATE_BUDGET_MAX;
+        return;
+    }
+    // leave some of the drain rate for the backlog and the other messages
+    uint32_t budget = this->drain_rate * 3 / 4;
+    if (budget < this->update_budget)
+        this->update_budget =
+            budget < RR_UPDATE_BUDGET_MIN ? RR_UPDATE_BUDGET_MIN : budget;
 }
 
 void rr_server_client_write_account(struct rr_server_client *client)
 {
     struct proto_bug encoder;
-    proto_bug_init(&encoder, outgoing_message);
+    rr_server_client_begin_message(client, &encoder);
     proto_bug_write_uint8(&encoder, rr_clientbound_account_result, "header");
     proto_bug_write_string(&encoder, client->rivet_account.uuid,
                            sizeof client->rivet_account.uuid, "uuid");
@@ -170,8 +211,207 @@ void rr_server_client_write_account(struct rr_server_client *client)
                                     "count");
         }
     proto_bug_write_uint8(&encoder, 0, "id");
-    rr_server_client_write_message(client, encoder.start,
-                                   encoder.current - encoder.start);
+    rr_server_client_end_message(client, &encoder);
+}
+
+static uint32_t (*account_table(struct rr_server_client *this,
+                                uint8_t table))[rr_rarity_id_max]
+{
+    if (table == rr_account_table_inventory)
+        return this->inventory;
+    if (table == rr_account_table_craft_fails)
+        return this->craft_fails;
+    return this->mob_gallery;
+}
+
+// the api computes the same, so it can only use 32 bit multiplies
+static uint32_t account_cell_hash(uint8_t table, uint8_t id, uint8_t rarity,
+                                  uint32_t count)
+{
+    uint32_t hash = ((table << 16 | id << 8 | rarity) * 0x9e3779b1u) ^ count;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static void reset_account_changes(struct rr_server_client *this)
+{
+    memset(&this->api_changes, 0, sizeof this->api_changes);
+    memset(&this->client_changes, 0, sizeof this->client_changes);
+    this->account_resync = 0;
+    this->account_hash = 0;
+    for (uint8_t table = 0; table < rr_account_table_max; ++table)
+    {
+        uint32_t(*cells)[rr_rarity_id_max] = account_table(this, table);
+        uint8_t id_count = table == rr_account_table_mob_gallery
+                               ? rr_mob_id_max
+                               : rr_petal_id_max;
+        for (uint8_t id = 0; id < id_count; ++id)
+            for (uint8_t rarity = 0; rarity < rr_rarity_id_max; ++rarity)
+                if (cells[id][rarity])
+                    this->account_hash += account_cell_hash(
+                        table, id, rarity, cells[id][rarity]);
+    }
+}
+
+static void note_change(struct rr_server_client_account_changes *changes,
+                        uint32_t interval)
+{
+    ++changes->count;
+    if (changes->ticks_to_flush == 0)
+        changes->ticks_to_flush = interval;
+}
+
+static void set_account_cell(struct rr_server_client *this, uint8_t table,
+                             uint8_t id, uint8_t rarity, uint32_t count,
+                             uint8_t to_client)
+{
+    uint32_t *cell = &account_table(this, table)[id][rarity];
+    if (*cell == count)
+        return;
+    if (*cell)
+        this->account_hash -= account_cell_hash(table, id, rarity, *cell);
+    if (count)
+        this->account_hash += account_cell_hash(table, id, rarity, count);
+    *cell = count;
+    uint64_t index = id * rr_rarity_id_max + rarity;
+    rr_bitset_set(this->api_changes.cells[table], index);
+    note_change(&this->api_changes, RR_ACCOUNT_API_FLUSH_TICKS);
+    if (!to_client)
+        return;
+    rr_bitset_set(this->client_changes.cells[table], index);
+    note_change(&this->client_changes, RR_ACCOUNT_CLIENT_FLUSH_TICKS);
+}
+
+void rr_server_client_set_inventory(struct rr_server_client *this, uint8_t id,
+                                    uint8_t rarity, uint32_t count)
+{
+    set_account_cell(this, rr_account_table_inventory, id, rarity, count, 1);
+}
+
+void rr_server_client_set_mob_gallery(struct rr_server_client *this,
+                                      uint8_t id, uint8_t rarity,
+                                      uint32_t count)
+{
+    set_account_cell(this, rr_account_table_mob_gallery, id, rarity, count,
+                     1);
+}
+
+void rr_server_client_account_changed(struct rr_server_client *this)
+{
+    note_change(&this->api_changes, RR_ACCOUNT_API_FLUSH_TICKS);
+}
+
+struct write_cell_captures
+{
+    struct rr_binary_encoder *api_encoder;
+    struct proto_bug *client_encoder;
+    uint32_t (*cells)[rr_rarity_id_max];
+    uint8_t id_offset;
+};
+
+static void write_cell(uint64_t index, void *_captures)
+{
+    struct write_cell_captures *captures = _captures;
+    uint8_t id = index / rr_rarity_id_max;
+    uint8_t rarity = index % rr_rarity_id_max;
+    uint32_t count = captures->cells[id][rarity];
+    if (captures->api_encoder != NULL)
+    {
+        rr_binary_encoder_write_uint8(captures->api_encoder,
+                                      id + captures->id_offset);
+        rr_binary_encoder_write_uint8(captures->api_encoder, rarity);
+        rr_binary_encoder_write_varuint(captures->api_encoder, count);
+        return;
+    }
+    proto_bug_write_uint8(captures->client_encoder, id + captures->id_offset,
+                          "id");
+    proto_bug_write_uint8(captures->client_encoder, rarity, "rarity");
+    proto_bug_write_varuint(captures->client_encoder, count, "count");
+}
+
+// lists every changed cell of every table the way the full writes do, zero
+// counts included
+static void write_changed_cells(struct rr_server_client *this,
+                                struct rr_server_client_account_changes *changes,
+                                struct write_cell_captures *captures)
+{
+    for (uint8_t table = 0; table < rr_account_table_max; ++table)
+    {
+        captures->cells = account_table(this, table);
+        captures->id_offset = table == rr_account_table_mob_gallery;
+        rr_bitset_for_each_set(changes->cells[table],
+                               sizeof changes->cells[table], captures,
+                               write_cell);
+        if (captures->api_encoder != NULL)
+            rr_binary_encoder_write_uint8(captures->api_encoder, 0);
+        else
+            proto_bug_write_uint8(captures->client_encoder, 0, "id");
+    }
+}
+
+static void write_api_delta(struct rr_server_client *this)
+{
+    if (this->account_resync)
+    {
+        this->account_resync = 0;
+        rr_server_client_write_to_api(this);
+        return;
+    }
+    if (this->dev)
+        return;
+    struct rr_binary_encoder encoder;
+    rr_binary_encoder_init(&encoder, this->server->outgoing_message);
+    rr_binary_encoder_write_uint8(&encoder, 4);
+    rr_binary_encoder_write_nt_string(&encoder, this->rivet_account.uuid);
+    rr_binary_encoder_write_float64(&encoder, this->experience);
+    rr_binary_encoder_write_uint8(&encoder, this->checkpoint);
+    struct write_cell_captures captures = {&encoder, NULL};
+    write_changed_cells(this, &this->api_changes, &captures);
+    // the api reads varuints as 32 bit ints
+    rr_binary_encoder_write_varuint(&encoder, this->account_hash & 65535);
+    rr_binary_encoder_write_varuint(&encoder, this->account_hash >> 16);
+    rr_server_write_to_api(this->server, encoder.start,
+                           encoder.at - encoder.start);
+}
+
+static void write_client_delta(struct rr_server_client *this)
+{
+    struct proto_bug encoder;
+    rr_server_client_begin_message(this, &encoder);
+    proto_bug_write_uint8(&encoder, rr_clientbound_account_delta, "header");
+    struct write_cell_captures captures = {NULL, &encoder};
+    write_changed_cells(this, &this->client_changes, &captures);
+    rr_server_client_end_message(this, &encoder);
+}
+
+static uint8_t flush_due(struct rr_server_client_account_changes *changes,
+                         uint8_t force)
+{
+    if (changes->count == 0)
+        return 0;
+    if (force || changes->count >= RR_ACCOUNT_FLUSH_CHANGES)
+        return 1;
+    return --changes->ticks_to_flush == 0;
+}
+
+void rr_server_client_flush_account(struct rr_server_client *this,
+                                    uint8_t force)
+{
+    if (flush_due(&this->api_changes, force))
+    {
+        write_api_delta(this);
+        memset(&this->api_changes, 0, sizeof this->api_changes);
+    }
+    if (flush_due(&this->client_changes, force))
+    {
+        if (this->session != NULL)
+            write_client_delta(this);
+        memset(&this->client_changes, 0, sizeof this->client_changes);
+    }
 }
 
 void rr_server_client_craft_petal(struct rr_server_client *this,
@@ -184,32 +424,37 @@ void rr_server_client_craft_petal(struct rr_server_client *this,
         return;
     if (this->inventory[id][rarity] < count)
         return;
-    uint32_t now = count;
-    uint32_t success = 0;
-    double base = RR_CRAFT_CHANCES[rarity];
-    double xp_gain = 0;
-    while (now >= 5)
+    struct rr_craft_outcome outcome;
+    if (id == rr_petal_id_basic)
     {
-        if (id == rr_petal_id_basic ||
-            rr_frand() < base * (++this->craft_fails[id][rarity]))
-        {
-            ++success;
-            this->craft_fails[id][rarity] = 0;
-            now -= 5;
-        }
-        else
-            now -= 1 + rand() % 4;
-        xp_gain += CRAFT_XP_GAINS[rarity];
+        // never fails
+        outcome.successes = outcome.attempts = count / 5;
+        outcome.consumed = outcome.successes * 5;
+        outcome.fails = 0;
     }
+    else
+        rr_craft(rarity, count, this->craft_fails[id][rarity], &outcome);
+    uint32_t now = count - outcome.consumed;
+    uint32_t success = outcome.successes;
+    uint32_t fails = outcome.fails;
+    double xp_gain = outcome.attempts * CRAFT_XP_GAINS[rarity];
     if (success > 0)
         printf("[craft] %s: %s %s x%u\n", this->rivet_account.uuid,
                RR_RARITY_NAMES[rarity + 1], RR_PETAL_NAMES[id], success);
-    this->inventory[id][rarity] -= (count - now);
-    this->inventory[id][rarity + 1] += success;
+    // the client applies the craft result itself
+    set_account_cell(this, rr_account_table_craft_fails, id, rarity, fails, 0);
+    set_account_cell(this, rr_account_table_inventory, id, rarity,
+                     this->inventory[id][rarity] - (count - now), 0);
+    set_account_cell(this, rr_account_table_inventory, id, rarity + 1,
+                     this->inventory[id][rarity + 1] + success, 0);
     this->experience += xp_gain;
+    rr_server_client_account_changed(this);
     uint32_t level = level_from_xp(this->experience);
     if (this->in_squad)
+    {
         rr_squad_get_client_slot(server, this)->level = level;
+        rr_client_squad_changed(server, this);
+    }
     if (this->player_info != NULL)
     {
         this->player_info->level = level;
@@ -226,10 +471,9 @@ void rr_server_client_craft_petal(struct rr_server_client *this,
             health->damage = health->max_health * 0.1;
         }
     }
-    rr_server_client_write_to_api(this);
 
     struct proto_bug encoder;
-    proto_bug_init(&encoder, outgoing_message);
+    rr_server_client_begin_message(this, &encoder);
     proto_bug_write_uint8(&encoder, rr_clientbound_craft_result, "header");
     proto_bug_write_uint8(&encoder, id, "craft id");
     proto_bug_write_uint8(&encoder, rarity, "craft rarity");
@@ -238,8 +482,7 @@ void rr_server_client_craft_petal(struct rr_server_client *this,
     proto_bug_write_varuint(&encoder, this->craft_fails[id][rarity],
                             "attempts");
     proto_bug_write_float64(&encoder, xp_gain, "craft xp");
-    rr_server_client_write_message(this, encoder.start,
-                                   encoder.current - encoder.start);
+    rr_server_client_end_message(this, &encoder);
 }
 
 int rr_server_client_read_from_api(struct rr_server_client *this,
@@ -264,6 +507,7 @@ int rr_server_client_read_from_api(struct rr_server_client *this,
         for (uint8_t id = 0; id < rr_mob_id_max; ++id)
             for (uint8_t rarity = 0; rarity < rr_rarity_id_max; ++rarity)
                 this->mob_gallery[id][rarity] = 1;
+        reset_account_changes(this);
         return 1;
     }
     this->experience = rr_binary_encoder_read_float64(encoder);
@@ -299,6 +543,7 @@ int rr_server_client_read_from_api(struct rr_server_client *this,
             this->mob_gallery[id - 1][rarity] = count;
         id = rr_binary_encoder_read_uint8(encoder);
     }
+    reset_account_changes(this);
     return 1;
 }
 
@@ -307,7 +552,7 @@ void rr_server_client_write_to_api(struct rr_server_client *this)
     if (this->dev)
         return;
     struct rr_binary_encoder encoder;
-    rr_binary_encoder_init(&encoder, outgoing_message);
+    rr_binary_encoder_init(&encoder, this->server->outgoing_message);
     rr_binary_encoder_write_uint8(&encoder, 2);
     rr_binary_encoder_write_nt_string(&encoder, this->rivet_account.uuid);
     rr_binary_encoder_write_float64(&encoder, this->experience);
@@ -345,6 +590,6 @@ void rr_server_client_write_to_api(struct rr_server_client *this)
                                             this->mob_gallery[id][rarity]);
         }
     rr_binary_encoder_write_uint8(&encoder, 0);
-    lws_write(this->server->api_client, encoder.start,
-              encoder.at - encoder.start, LWS_WRITE_BINARY);
-}
\ No newline at end of file
+    rr_server_write_to_api(this->server, encoder.start,
+                           encoder.at - encoder.start);
+}
@@ -29,14 +29,25 @@
             rr_simulation_get_relations(simulation, entity)->root_owner)       \
                 ->client->dev_cheats.cheat_name)
 
-struct rr_binary_encoder;
+// bytes of entity updates a client gets per tick. the budget grows while its
+// socket keeps up and falls back to what the socket actually drains once
+// frames start queueing
+#define RR_UPDATE_BUDGET_MIN (2048)
+#define RR_UPDATE_BUDGET_MAX (65536)
+// an entity is only updated once its accumulated priority reaches the
+// client's threshold, which rises while updates are over budget. at the
+// highest threshold the least important entities still go out about once a
+// second
+#define RR_UPDATE_THRESHOLD_MAX (1024)
+// account changes are sent as deltas of the cells that changed. they are
+// held back until this many cells changed or the interval since the first
+// change ran out, the api only needs them eventually but the client shows them
+#define RR_ACCOUNT_FLUSH_CHANGES (64)
+#define RR_ACCOUNT_API_FLUSH_TICKS (10 * 25)
+#define RR_ACCOUNT_CLIENT_FLUSH_TICKS (5)
 
-struct rr_server_client_message
-{
-    struct rr_server_client_message *next;
-    uint64_t len;
-    uint8_t *packet;
-};
+struct rr_binary_encoder;
+struct proto_bug;
 
 struct rr_server_client_dev_cheats
 {
@@ -50,6 +61,24 @@ struct rr_server_client_dev_cheats
     float fov_percent;
 };
 
+enum rr_account_table
+{
+    rr_account_table_inventory,
+    rr_account_table_craft_fails,
+    rr_account_table_mob_gallery,
+    rr_account_table_max
+};
+
+// cells are id * rr_rarity_id_max + rarity
+struct rr_server_client_account_changes
+{
+    uint8_t cells[rr_account_table_max]
+                 [RR_BITSET_ROUND(rr_petal_id_max * rr_rarity_id_max)];
+    uint32_t count;
+    // 0 while there is nothing to flush
+    uint32_t ticks_to_flush;
+};
+
 struct rr_server_client
 {
     struct rr_rivet_account rivet_account;
@@ -57,11 +86,9 @@ struct rr_server_client
     uint64_t serverbound_encryption_key;
     uint64_t requested_verification;
     uint8_t quick_verification;
-    uint64_t message_length;
     struct rr_server *server;
-    struct lws *socket_handle;
-    struct rr_server_client_message *message_root;
-    struct rr_server_client_message *message_at;
+    // NULL while disconnected
+    struct rr_server_session *session;
     struct rr_component_player_info *player_info;
     struct rr_server_client_dev_cheats dev_cheats;
     double experience;
@@ -72,12 +99,36 @@ struct rr_server_client
     uint32_t inventory[rr_petal_id_max][rr_rarity_id_max];
     uint32_t craft_fails[rr_petal_id_max][rr_rarity_id_max];
     uint32_t mob_gallery[rr_mob_id_max][rr_rarity_id_max];
+    // what changed since the api and the client last heard of the account
+    struct rr_server_client_account_changes api_changes;
+    struct rr_server_client_account_changes client_changes;
+    // order independent hash of the tables above, the api checks its copy
+    // against it after every delta
+    uint32_t account_hash;
     uint32_t ticks_to_next_squad_action;
     uint32_t ticks_to_next_kick_vote;
     uint32_t disconnected_ticks;
     uint32_t afk_ticks;
     uint8_t joined_squad_before[RR_BITSET_ROUND(RR_SQUAD_COUNT)];
     uint8_t blocked_clients[RR_BITSET_ROUND(RR_MAX_CLIENT_COUNT)];
+    // what the last squad dump this client got was based on. a fresh client
+    // has revision 0 everywhere and gets every squad
+    uint32_t squad_revisions[RR_SQUAD_COUNT];
+    uint8_t squad_overlays[RR_SQUAD_COUNT];
+    int8_t squad_dump_kick_vote_pos;
+    uint8_t squad_dump_dev;
+    // priority accumulated by every entity since it was last sent, and which
+    // ones changed while held back and need a full update
+    uint16_t entity_priority[RR_MAX_ENTITY_COUNT];
+    uint8_t entities_stale[RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT)];
+    // entity_hash_tracker of every id when its creation was sent. with
+    // dropped updates an id can be freed and reused before the client
+    // hears about the deletion
+    uint16_t entity_generations[RR_MAX_ENTITY_COUNT];
+    uint64_t frames_drained;
+    uint32_t drain_rate; // bytes per tick, smoothed
+    uint32_t update_budget;
+    uint16_t update_threshold;
     uint8_t squad_pos;
     uint8_t squad;
     uint8_t checkpoint;
@@ -89,16 +140,40 @@ struct rr_server_client
     uint8_t in_use : 1;
     uint8_t pending_quick_join : 1;
     uint8_t disconnected : 1;
+    // the api's copy drifted, the next flush is a full write
+    uint8_t account_resync : 1;
 };
 
 void rr_server_client_init(struct rr_server_client *);
 void rr_server_client_create_flower(struct rr_server_client *);
 
-void rr_server_client_write_message(struct rr_server_client *, uint8_t *,
-                                    uint64_t);
+// points the encoder at the client's next free frame. when the message can't
+// be sent it points at the server's scratch buffer instead and returns 0, so
+// callers only have to check if they want to skip the encoding. only one
+// message per client can be open at a time
+uint8_t rr_server_client_begin_message(struct rr_server_client *,
+                                       struct proto_bug *);
+// same but also gives up once the socket is falling behind
+uint8_t rr_server_client_begin_droppable_message(struct rr_server_client *,
+                                                 struct proto_bug *);
+// encrypts the frame in place and hands it to the network thread
+void rr_server_client_end_message(struct rr_server_client *,
+                                  struct proto_bug *);
+// once per tick, adapts the update budget to how fast the socket drains
+void rr_server_client_update_budget(struct rr_server_client *);
 void rr_server_client_write_account(struct rr_server_client *);
 void rr_server_client_craft_petal(struct rr_server_client *, struct rr_server *,
                                   uint8_t, uint8_t, uint32_t);
 int rr_server_client_read_from_api(struct rr_server_client *,
                                    struct rr_binary_encoder *);
-void rr_server_client_write_to_api(struct rr_server_client *);
\ No newline at end of file
+void rr_server_client_write_to_api(struct rr_server_client *);
+// the setters keep the hash up to date and queue the cell for the next flush
+void rr_server_client_set_inventory(struct rr_server_client *, uint8_t,
+                                    uint8_t, uint32_t);
+void rr_server_client_set_mob_gallery(struct rr_server_client *, uint8_t,
+                                      uint8_t, uint32_t);
+// for changes to the xp or checkpoint, which every delta carries
+void rr_server_client_account_changed(struct rr_server_client *);
+// once per tick and before the client goes away, flushes whatever is due or
+// everything if forced
+void rr_server_client_flush_account(struct rr_server_client *, uint8_t);
\ No newline at end of file
@@ -0,0 +1,87 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Server/ContactPool.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+void rr_contact_pool_init(struct rr_contact_pool *this)
+{
+    memset(this, 0, sizeof *this);
+    this->column = malloc(RR_MAX_ENTITY_COUNT * sizeof *this->column);
+    this->start = malloc(RR_MAX_ENTITY_COUNT * sizeof *this->start);
+    this->count = calloc(RR_MAX_ENTITY_COUNT, sizeof *this->count);
+}
+
+void rr_contact_pool_free(struct rr_contact_pool *this)
+{
+    for (uint32_t i = 0; i < this->column_count; ++i)
+        free(this->columns[i].contacts);
+    free(this->columns);
+    free(this->column);
+    free(this->start);
+    free(this->count);
+    memset(this, 0, sizeof *this);
+}
+
+void rr_contact_pool_reset(struct rr_contact_pool *this, uint32_t column_count)
+{
+    // entities allocated after the sweep must not see an old entity's run
+    memset(this->count, 0, RR_MAX_ENTITY_COUNT * sizeof *this->count);
+    if (column_count > this->column_count)
+    {
+        this->columns = realloc(this->columns,
+                                column_count * sizeof *this->columns);
+        memset(this->columns + this->column_count, 0,
+               (column_count - this->column_count) * sizeof *this->columns);
+        this->column_count = column_count;
+    }
+    for (uint32_t i = 0; i < this->column_count; ++i)
+    {
+        this->columns[i].count = 0;
+        this->columns[i].last = RR_NULL_ENTITY;
+    }
+}
+
+void rr_contact_pool_add(struct rr_contact_pool *this, uint32_t column,
+                         EntityIdx a, EntityIdx b)
+{
+    struct rr_contact_column *list = &this->columns[column];
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->contacts =
+            realloc(list->contacts, list->capacity * sizeof *list->contacts);
+    }
+    if (list->last != a)
+    {
+        list->last = a;
+        this->column[a] = column;
+        this->start[a] = list->count;
+    }
+    ++this->count[a];
+    list->contacts[list->count++] = b;
+}
+
+EntityIdx *rr_contact_pool_get(struct rr_contact_pool *this, EntityIdx entity,
+                               uint32_t *count)
+{
+    *count = this->count[entity];
+    if (*count == 0)
+        return NULL;
+    return this->columns[this->column[entity]].contacts + this->start[entity];
+}
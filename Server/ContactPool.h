@@ -0,0 +1,55 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <Shared/Entity.h>
+
+// entities that touch an entity, found by collision detection and read by
+// the systems after it. the sweep goes column by column, so every column
+// gets its own list and columns swept on different threads never share
+// one. all contacts of an entity come out of one column in a row, an entity
+// only remembers where its run starts
+struct rr_contact_column
+{
+    EntityIdx *contacts;
+    uint32_t count;
+    uint32_t capacity;
+    // entity the last run belongs to
+    EntityIdx last;
+};
+
+struct rr_contact_pool
+{
+    struct rr_contact_column *columns;
+    uint32_t column_count;
+    uint16_t *column;
+    uint32_t *start;
+    uint32_t *count;
+};
+
+void rr_contact_pool_init(struct rr_contact_pool *);
+void rr_contact_pool_free(struct rr_contact_pool *);
+// forgets every contact, column_count is the widest grid swept this tick
+void rr_contact_pool_reset(struct rr_contact_pool *, uint32_t);
+// b touches a, a is in column. only one thread at a time may add to a column
+void rr_contact_pool_add(struct rr_contact_pool *, uint32_t, EntityIdx,
+                         EntityIdx);
+// contacts of the entity in the order they were added, *count of them
+EntityIdx *rr_contact_pool_get(struct rr_contact_pool *, EntityIdx,
+                               uint32_t *);
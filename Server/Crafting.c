@@ -0,0 +1,222 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Server/Crafting.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <Shared/StaticData.h>
+
+// fail costs of up to this many failures are rolled one by one, longer runs
+// use the normal approximation of their sum
+#define EXACT_FAIL_COUNT (32)
+// below this many expected successes cycles are sampled one at a time
+#define BATCH_SUCCESS_COUNT (64)
+// the survival table stops once the rest of the distribution is below what
+// uniform() can resolve
+#define SURVIVAL_CUTOFF (1e-15)
+
+// survival[k] is the chance that a fresh counter takes more than k attempts
+// to succeed
+struct attempt_distribution
+{
+    double *survival;
+    uint32_t length;
+    double mean;
+    double variance;
+};
+
+static struct attempt_distribution distributions[rr_rarity_id_max - 1];
+
+void rr_crafting_init()
+{
+    for (uint8_t rarity = 0; rarity < rr_rarity_id_max - 1; ++rarity)
+    {
+        struct attempt_distribution *distribution = &distributions[rarity];
+        double base = RR_CRAFT_CHANCES[rarity];
+        uint32_t capacity = 16;
+        double *survival = malloc(capacity * sizeof *survival);
+        survival[0] = 1;
+        uint32_t k = 1;
+        for (;; ++k)
+        {
+            if (k == capacity)
+                survival = realloc(survival, (capacity *= 2) * sizeof *survival);
+            survival[k] = survival[k - 1] * (1 - fmin(1, base * k));
+            if (survival[k] < SURVIVAL_CUTOFF)
+            {
+                survival[k] = 0;
+                break;
+            }
+        }
+        distribution->survival = survival;
+        distribution->length = k + 1;
+        // E[K] = sum of P(K > k), E[K^2] = sum of (2k + 1) P(K > k)
+        double mean = 0;
+        double square = 0;
+        for (uint32_t i = 0; i < k; ++i)
+        {
+            mean += survival[i];
+            square += (2.0 * i + 1) * survival[i];
+        }
+        distribution->mean = mean;
+        distribution->variance = square - mean * mean;
+    }
+}
+
+static double uniform() { return (rand() + 0.5) / ((double)RAND_MAX + 1); }
+
+static double normal()
+{
+    return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+static uint32_t fail_cost() { return 1 + rand() % 4; }
+
+// the attempt the counter succeeds at, given it is at fails now
+static uint32_t sample_success(uint8_t rarity, uint32_t fails)
+{
+    struct attempt_distribution *distribution = &distributions[rarity];
+    if (fails + 1 >= distribution->length)
+    {
+        // only reachable through an absurd stored counter
+        double base = RR_CRAFT_CHANCES[rarity];
+        while (uniform() >= base * ++fails)
+            ;
+        return fails;
+    }
+    // smallest k with P(K > k | K > fails) <= u
+    double target = uniform() * distribution->survival[fails];
+    uint32_t low = fails + 1;
+    uint32_t high = distribution->length - 1;
+    while (low < high)
+    {
+        uint32_t middle = (low + high) / 2;
+        if (distribution->survival[middle] <= target)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return low;
+}
+
+// sum of count fail costs
+static uint64_t sample_fail_costs(uint64_t count)
+{
+    if (count <= EXACT_FAIL_COUNT)
+    {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < count; ++i)
+            sum += fail_cost();
+        return sum;
+    }
+    double sum = round(2.5 * count + sqrt(1.25 * count) * normal());
+    if (sum < count)
+        return count;
+    if (sum > 4.0 * count)
+        return 4 * count;
+    return sum;
+}
+
+// one success or the attempts until the petals run out. returns 0 once there
+// is nothing left to craft
+static uint8_t craft_cycle(uint8_t rarity, uint64_t *left,
+                           struct rr_craft_outcome *outcome)
+{
+    uint32_t success = sample_success(rarity, outcome->fails);
+    uint64_t fail_count = success - outcome->fails - 1;
+    // the cycle can only run out of petals if even the most expensive
+    // failures wouldn't leave 5, only then does every cost matter
+    if (fail_count > EXACT_FAIL_COUNT && 4 * fail_count + 5 <= *left)
+    {
+        *left -= sample_fail_costs(fail_count) + 5;
+        outcome->attempts += fail_count + 1;
+        ++outcome->successes;
+        outcome->fails = 0;
+        return 1;
+    }
+    for (uint64_t i = 0; i < fail_count; ++i)
+    {
+        if (*left < 5)
+            return 0;
+        uint32_t cost = fail_cost();
+        *left -= cost;
+        ++outcome->attempts;
+        ++outcome->fails;
+    }
+    if (*left < 5)
+        return 0;
+    *left -= 5;
+    ++outcome->attempts;
+    ++outcome->successes;
+    outcome->fails = 0;
+    return 1;
+}
+
+// many fresh cycles at once. the total number of attempts is drawn first,
+// the fail costs follow from it. returns 0 if there are too few petals for a
+// batch to be worth it
+static uint8_t craft_batch(uint8_t rarity, uint64_t *left,
+                           struct rr_craft_outcome *outcome)
+{
+    struct attempt_distribution *distribution = &distributions[rarity];
+    double cycle_mean = 5 + 2.5 * (distribution->mean - 1);
+    double cycle_variance = 1.25 * (distribution->mean - 1) +
+                            6.25 * distribution->variance;
+    // far enough below the petals that the batch practically never overruns
+    double expected = *left / cycle_mean;
+    double margin = 6 * sqrt(expected * cycle_variance);
+    if (*left < margin)
+        return 0;
+    uint64_t cycles = (*left - margin) / cycle_mean;
+    if (cycles < BATCH_SUCCESS_COUNT)
+        return 0;
+    while (1)
+    {
+        double attempts =
+            round(cycles * distribution->mean +
+                  sqrt(cycles * distribution->variance) * normal());
+        if (attempts < cycles)
+            attempts = cycles;
+        uint64_t fail_count = attempts - cycles;
+        uint64_t consumed = 5 * cycles + sample_fail_costs(fail_count);
+        if (consumed > *left)
+            continue;
+        *left -= consumed;
+        outcome->attempts += attempts;
+        outcome->successes += cycles;
+        return 1;
+    }
+}
+
+void rr_craft(uint8_t rarity, uint32_t count, uint32_t fails,
+              struct rr_craft_outcome *outcome)
+{
+    outcome->successes = 0;
+    outcome->attempts = 0;
+    outcome->fails = fails;
+    uint64_t left = count;
+    // the first cycle continues the stored counter, every later one is fresh
+    if (left >= 5 && craft_cycle(rarity, &left, outcome))
+    {
+        while (craft_batch(rarity, &left, outcome))
+            ;
+        while (left >= 5 && craft_cycle(rarity, &left, outcome))
+            ;
+    }
+    outcome->consumed = count - left;
+}
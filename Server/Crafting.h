@@ -0,0 +1,38 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+
+// every attempt increments the rarity's fail counter and succeeds with
+// RR_CRAFT_CHANCES[rarity] times the counter. a success takes 5 petals and
+// resets the counter, a failure takes 1 to 4. attempts go on while at least
+// 5 petals are left
+struct rr_craft_outcome
+{
+    uint32_t successes;
+    uint32_t consumed;
+    uint32_t attempts;
+    // the fail counter afterwards
+    uint32_t fails;
+};
+
+// builds the attempt distributions, rr_static_data_init has to have run
+void rr_crafting_init();
+// samples the outcome of crafting count petals of a rarity starting at a
+// fail counter, in time that barely depends on count
+void rr_craft(uint8_t, uint32_t, uint32_t, struct rr_craft_outcome *);
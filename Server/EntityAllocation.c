@@ -19,6 +19,7 @@
 #include <Server/Simulation.h>
 #include <Server/Waves.h>
 
+#include <assert.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,8 +27,6 @@
 #include <Shared/Squad.h>
 #include <Shared/Utilities.h>
 
-static struct rr_maze_grid DEFAULT_GRID = {0};
-
 static void set_respawn_zone(struct rr_component_arena *arena, uint32_t x,
                              uint32_t y)
 {
@@ -153,7 +152,7 @@ static EntityIdx rr_simulation_alloc_mob_non_recursive(
     struct rr_component_arena *arena = rr_simulation_get_arena(this, 1);
 
     struct rr_component_mob *mob = rr_simulation_add_mob(this, entity);
-    mob->zone = &DEFAULT_GRID;
+    mob->zone = &this->default_grid;
     struct rr_component_physical *physical =
         rr_simulation_add_physical(this, entity);
     struct rr_component_health *health = rr_simulation_add_health(this, entity);
@@ -206,7 +205,7 @@ EntityIdx rr_simulation_alloc_mob(struct rr_simulation *this,
         rr_simulation_add_relations(this, entity);
     struct rr_component_ai *ai = rr_simulation_add_ai(this, entity);
     // init team elsewhere
-    mob->zone = &DEFAULT_GRID;
+    mob->zone = &this->default_grid;
     rr_component_mob_set_id(mob, mob_id);
     rr_component_mob_set_rarity(mob, rarity_id);
     struct rr_mob_rarity_scale const *rarity_scale =
@@ -309,20 +308,53 @@ EntityIdx rr_simulation_alloc_mob(struct rr_simulation *this,
 
 EntityIdx rr_simulation_alloc_entity(struct rr_simulation *this)
 {
-    for (EntityIdx i = 1; i < RR_MAX_ENTITY_COUNT; i++)
+    EntityIdx i;
+    if (this->free_entities_count > 0)
     {
-        if (!rr_simulation_has_entity(this, i))
-        {
-            if (rr_bitset_get_bit(this->deleted_last_tick, i))
-                continue;
-            this->entity_tracker[i] = 1;
-            ++this->entity_hash_tracker[i];
+        i = this->free_entities[this->free_entities_start];
+        this->free_entities_start =
+            (this->free_entities_start + 1) & (RR_MAX_ENTITY_COUNT - 1);
+        --this->free_entities_count;
+    }
+    else if (this->entity_high_water_mark < RR_MAX_ENTITY_COUNT)
+        i = this->entity_high_water_mark++;
+    else
+        RR_UNREACHABLE("ran out of entity ids");
+    assert(!rr_simulation_has_entity(this, i));
+    this->entity_tracker[i] = 1;
+    ++this->entity_hash_tracker[i];
 #ifndef NDEBUG
-            printf("<rr_simulation::entity_create::%d>\n", i);
+    printf("<rr_simulation::entity_create::%d>\n", i);
 #endif
-            return i;
-        }
-    }
+    return i;
+}
 
-    RR_UNREACHABLE("ran out of entity ids");
+static void release_entity_id(uint64_t i, void *captures)
+{
+    struct rr_simulation *this = captures;
+    this->free_entities[(this->free_entities_start +
+                         this->free_entities_count++) &
+                        (RR_MAX_ENTITY_COUNT - 1)] = i;
+}
+
+// ids in deleted_last_tick have been gone for a whole tick. a client whose
+// updates were dropped may not have heard about the deletion yet, it gets a
+// deletion and a creation once it sees the id with a new generation
+void rr_simulation_release_entity_ids(struct rr_simulation *this)
+{
+    rr_bitset_for_each_bit(this->deleted_last_tick,
+                           this->deleted_last_tick +
+                               RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT),
+                           this, release_entity_id);
+}
+
+uint32_t rr_simulation_get_entity_high_water_mark(struct rr_simulation *this)
+{
+    return this->entity_high_water_mark;
+}
+
+uint32_t rr_simulation_get_free_entity_count(struct rr_simulation *this)
+{
+    return this->free_entities_count + RR_MAX_ENTITY_COUNT -
+           this->entity_high_water_mark;
 }
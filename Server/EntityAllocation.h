@@ -19,6 +19,9 @@
 #include <Shared/SimulationCommon.h>
 
 EntityIdx rr_simulation_alloc_entity(struct rr_simulation *);
+void rr_simulation_release_entity_ids(struct rr_simulation *);
+uint32_t rr_simulation_get_entity_high_water_mark(struct rr_simulation *);
+uint32_t rr_simulation_get_free_entity_count(struct rr_simulation *);
 EntityIdx rr_simulation_alloc_petal(struct rr_simulation *, EntityIdx, float,
                                     float, uint8_t, uint8_t, EntityIdx);
 EntityIdx rr_simulation_alloc_mob(struct rr_simulation *, EntityIdx, float,
@@ -0,0 +1,107 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Server/EntityCache.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <Shared/Entity.h>
+
+#define ENTRY_COUNT (RR_MAX_ENTITY_COUNT * 2)
+#define FILLING (1)
+#define READY (2)
+#define UNAVAILABLE (3)
+
+void rr_entity_cache_init(struct rr_entity_cache *this, uint64_t capacity)
+{
+    // only the pages a tick actually writes to get committed
+    this->memory = mmap(NULL, capacity, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (this->memory == MAP_FAILED)
+    {
+        perror("<rr_entity_cache::mmap>");
+        abort();
+    }
+    this->entries = calloc(ENTRY_COUNT, sizeof *this->entries);
+    this->capacity = capacity;
+    // entries start out at generation 0, which is never current
+    this->generation = 1;
+    atomic_init(&this->used, 0);
+    atomic_init(&this->hits, 0);
+    atomic_init(&this->misses, 0);
+}
+
+void rr_entity_cache_free(struct rr_entity_cache *this)
+{
+    munmap(this->memory, this->capacity);
+    free(this->entries);
+    this->memory = NULL;
+    this->entries = NULL;
+}
+
+void rr_entity_cache_begin_tick(struct rr_entity_cache *this)
+{
+    if (++this->generation == 1u << 30)
+    {
+        // the state only has room for 30 bits of it
+        memset(this->entries, 0, ENTRY_COUNT * sizeof *this->entries);
+        this->generation = 1;
+    }
+    atomic_store_explicit(&this->used, 0, memory_order_relaxed);
+    atomic_store_explicit(&this->hits, 0, memory_order_relaxed);
+    atomic_store_explicit(&this->misses, 0, memory_order_relaxed);
+}
+
+uint8_t *rr_entity_cache_get(struct rr_entity_cache *this, uint32_t key,
+                             uint32_t *size, uint8_t *claimed)
+{
+    struct rr_entity_cache_entry *entry = &this->entries[key];
+    uint32_t current = this->generation << 2;
+    uint32_t state = atomic_load_explicit(&entry->state, memory_order_acquire);
+    *claimed = 0;
+    if (state == (current | READY))
+    {
+        *size = entry->size;
+        return this->memory + entry->offset;
+    }
+    if ((state & ~3u) != current)
+        *claimed = atomic_compare_exchange_strong_explicit(
+            &entry->state, &state, current | FILLING, memory_order_relaxed,
+            memory_order_relaxed);
+    return NULL;
+}
+
+void rr_entity_cache_store(struct rr_entity_cache *this, uint32_t key,
+                           uint8_t const *data, uint32_t size)
+{
+    struct rr_entity_cache_entry *entry = &this->entries[key];
+    uint32_t current = this->generation << 2;
+    uint64_t offset =
+        atomic_fetch_add_explicit(&this->used, size, memory_order_relaxed);
+    if (offset + size > this->capacity)
+    {
+        atomic_store_explicit(&entry->state, current | UNAVAILABLE,
+                              memory_order_relaxed);
+        return;
+    }
+    memcpy(this->memory + offset, data, size);
+    entry->offset = offset;
+    entry->size = size;
+    atomic_store_explicit(&entry->state, current | READY, memory_order_release);
+}
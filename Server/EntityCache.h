@@ -0,0 +1,56 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// every client that sees an entity in a tick gets the same bytes for its
+// components unless it just started seeing it, so they are encoded once per
+// tick and copied after that. the first client to encode an entity fills the
+// entry, a client racing it encodes on its own instead of waiting
+struct rr_entity_cache_entry
+{
+    atomic_uint state; // generation << 2 | filling, ready or unavailable
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct rr_entity_cache
+{
+    uint8_t *memory;
+    // two per entity, the update and the full encoding
+    struct rr_entity_cache_entry *entries;
+    uint64_t capacity;
+    atomic_ullong used;
+    uint32_t generation;
+    // summed up by the encoders, reset every tick
+    atomic_ullong hits;
+    atomic_ullong misses;
+};
+
+void rr_entity_cache_init(struct rr_entity_cache *, uint64_t);
+void rr_entity_cache_free(struct rr_entity_cache *);
+// serial, forgets everything encoded last tick
+void rr_entity_cache_begin_tick(struct rr_entity_cache *);
+// returns the cached encoding of key and its size, or NULL. if *claimed is
+// set the caller has to encode it and hand the bytes to
+// rr_entity_cache_store, before the tick ends
+uint8_t *rr_entity_cache_get(struct rr_entity_cache *, uint32_t, uint32_t *,
+                             uint8_t *);
+void rr_entity_cache_store(struct rr_entity_cache *, uint32_t, uint8_t const *,
+                           uint32_t);
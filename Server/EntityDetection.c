@@ -28,10 +28,8 @@ struct entity_finder_captures
     struct rr_simulation *simulation;
     void *captures;
     uint8_t (*filter)(struct rr_simulation *, EntityIdx, EntityIdx, void *);
-    EntityIdx closest;
     EntityIdx seeker;
     uint8_t seeker_team;
-    float closest_dist;
     float x;
     float y;
 };
@@ -51,27 +49,47 @@ struct entity_chooser_captures
     uint32_t potential_count;
 };
 
-void shg_cb_enemy(EntityIdx potential, void *_captures)
+// buckets that can hold an enemy or a friend of the team. only the bodies of
+// friends count
+static uint32_t enemy_partitions(uint8_t team)
+{
+    if (team == rr_simulation_team_id_mobs)
+        return rr_spatial_hash_target_team_bits(rr_simulation_team_id_players) |
+               rr_spatial_hash_target_team_bits(rr_simulation_team_id_pvp);
+    if (team == rr_simulation_team_id_players)
+        return rr_spatial_hash_target_team_bits(rr_simulation_team_id_mobs);
+    return rr_spatial_hash_target_team_bits(rr_simulation_team_id_mobs) |
+           rr_spatial_hash_target_team_bits(rr_simulation_team_id_pvp);
+}
+
+static uint32_t friend_partitions(uint8_t team)
+{
+    if (team == rr_simulation_team_id_mobs)
+        return rr_spatial_hash_target_bit(rr_simulation_team_id_mobs,
+                                          rr_spatial_hash_target_kind_body);
+    return rr_spatial_hash_target_bit(rr_simulation_team_id_players,
+                                      rr_spatial_hash_target_kind_body) |
+           rr_spatial_hash_target_bit(rr_simulation_team_id_pvp,
+                                      rr_spatial_hash_target_kind_body);
+}
+
+// the target partitions already rule out everything but flowers, mobs and
+// seed or nest petals
+static uint8_t shg_cb_enemy(EntityIdx potential, float closest_dist,
+                            float *out_dist, void *_captures)
 {
     struct entity_finder_captures *captures = _captures;
     struct rr_simulation *simulation = captures->simulation;
-    uint8_t allow =
-        !rr_simulation_has_arena(simulation, potential) &&
-        (rr_simulation_has_flower(simulation, potential) ||
-         rr_simulation_has_mob(simulation, potential) ||
-         (rr_simulation_has_petal(simulation, potential) &&
-          (rr_simulation_get_petal(simulation, potential)->id == rr_petal_id_seed ||
-           rr_simulation_get_petal(simulation, potential)->id == rr_petal_id_nest) &&
-          rr_simulation_get_petal(simulation, potential)->detached));
-    if (!allow)
-        return;
+    if (rr_simulation_has_petal(simulation, potential) &&
+        !rr_simulation_get_petal(simulation, potential)->detached)
+        return 0;
     if (dev_cheat_enabled(simulation, potential, no_aggro))
-        return;
+        return 0;
     if (is_same_team(rr_simulation_get_relations(simulation, potential)->team,
                      captures->seeker_team))
-        return;
+        return 0;
     if (rr_simulation_get_health(simulation, potential)->health == 0)
-        return;
+        return 0;
     struct rr_component_physical *t_physical =
         rr_simulation_get_physical(simulation, potential);
     struct rr_vector delta = {captures->x - t_physical->x,
@@ -81,28 +99,25 @@ void shg_cb_enemy(EntityIdx potential, void *_captures)
         t_physical->radius;
     if (rr_simulation_has_petal(simulation, potential))
         dist *= 2;
-    if (dist > captures->closest_dist)
-        return;
+    if (dist > closest_dist)
+        return 0;
     if (!captures->filter(simulation, captures->seeker, potential,
                           captures->captures))
-        return;
-    captures->closest_dist = dist;
-    captures->closest = potential;
+        return 0;
+    *out_dist = dist;
+    return 1;
 }
 
-void shg_cb_friend(EntityIdx potential, void *_captures)
+static uint8_t shg_cb_friend(EntityIdx potential, float closest_dist,
+                             float *out_dist, void *_captures)
 {
     struct entity_finder_captures *captures = _captures;
     struct rr_simulation *simulation = captures->simulation;
-    if (!rr_simulation_has_mob(simulation, potential) &&
-            !rr_simulation_has_flower(simulation, potential) ||
-        rr_simulation_has_arena(simulation, potential))
-        return;
     if (!is_same_team(rr_simulation_get_relations(simulation, potential)->team,
                       captures->seeker_team))
-        return;
+        return 0;
     if (rr_simulation_get_health(simulation, potential)->health == 0)
-        return;
+        return 0;
     struct rr_component_physical *t_physical =
         rr_simulation_get_physical(simulation, potential);
     struct rr_vector delta = {captures->x - t_physical->x,
@@ -110,28 +125,21 @@ void shg_cb_friend(EntityIdx potential, void *_captures)
     float dist =
         rr_vector_get_magnitude(&delta) * t_physical->aggro_range_multiplier -
         t_physical->radius;
-    if (dist > captures->closest_dist)
-        return;
+    if (dist > closest_dist)
+        return 0;
     if (!captures->filter(simulation, captures->seeker, potential,
                           captures->captures))
-        return;
-    captures->closest_dist = dist;
-    captures->closest = potential;
+        return 0;
+    *out_dist = dist;
+    return 1;
 }
 
-void shg_cb_rand_enemy(EntityIdx potential, void *_captures)
+static void shg_cb_rand_enemy(EntityIdx potential, void *_captures)
 {
     struct entity_chooser_captures *captures = _captures;
     struct rr_simulation *simulation = captures->simulation;
-    uint8_t allow =
-        !rr_simulation_has_arena(simulation, potential) &&
-        (rr_simulation_has_flower(simulation, potential) ||
-         rr_simulation_has_mob(simulation, potential) ||
-         (rr_simulation_has_petal(simulation, potential) &&
-          (rr_simulation_get_petal(simulation, potential)->id == rr_petal_id_seed ||
-           rr_simulation_get_petal(simulation, potential)->id == rr_petal_id_nest) &&
-          rr_simulation_get_petal(simulation, potential)->detached));
-    if (!allow)
+    if (rr_simulation_has_petal(simulation, potential) &&
+        !rr_simulation_get_petal(simulation, potential)->detached)
         return;
     if (dev_cheat_enabled(simulation, potential, no_aggro))
         return;
@@ -198,7 +206,6 @@ EntityIdx rr_simulation_find_nearest_enemy_custom_pos(
     float min_dist, void *captures,
     uint8_t (*filter)(struct rr_simulation *, EntityIdx, EntityIdx, void *))
 {
-    EntityIdx target = RR_NULL_ENTITY;
     struct rr_component_physical *physical =
         rr_simulation_get_physical(simulation, seeker);
     struct rr_component_relations *relations =
@@ -207,18 +214,15 @@ EntityIdx rr_simulation_find_nearest_enemy_custom_pos(
     shg_captures.simulation = simulation;
     shg_captures.captures = captures;
     shg_captures.filter = filter;
-    shg_captures.closest = target;
     shg_captures.seeker = seeker;
-    shg_captures.closest_dist = min_dist;
     shg_captures.x = x;
     shg_captures.y = y;
     shg_captures.seeker_team = relations->team;
     struct rr_spatial_hash *shg =
         &rr_simulation_get_arena(simulation, physical->arena)->spatial_hash;
-    rr_spatial_hash_query(shg, x, y, min_dist, min_dist, &shg_captures,
-                          shg_cb_enemy);
-
-    return shg_captures.closest;
+    return rr_spatial_hash_find_nearest_target(
+        shg, x, y, min_dist, enemy_partitions(relations->team), &shg_captures,
+        shg_cb_enemy);
 }
 
 EntityIdx rr_simulation_find_nearest_friend(
@@ -239,7 +243,6 @@ EntityIdx rr_simulation_find_nearest_friend_custom_pos(
     float min_dist, void *captures,
     uint8_t (*filter)(struct rr_simulation *, EntityIdx, EntityIdx, void *))
 {
-    EntityIdx target = RR_NULL_ENTITY;
     struct rr_component_physical *physical =
         rr_simulation_get_physical(simulation, seeker);
     struct rr_component_relations *relations =
@@ -248,18 +251,15 @@ EntityIdx rr_simulation_find_nearest_friend_custom_pos(
     shg_captures.simulation = simulation;
     shg_captures.captures = captures;
     shg_captures.filter = filter;
-    shg_captures.closest = target;
     shg_captures.seeker = seeker;
-    shg_captures.closest_dist = min_dist;
     shg_captures.x = x;
     shg_captures.y = y;
     shg_captures.seeker_team = relations->team;
     struct rr_spatial_hash *shg =
         &rr_simulation_get_arena(simulation, physical->arena)->spatial_hash;
-    rr_spatial_hash_query(shg, x, y, min_dist, min_dist, &shg_captures,
-                          shg_cb_friend);
-
-    return shg_captures.closest;
+    return rr_spatial_hash_find_nearest_target(
+        shg, x, y, min_dist, friend_partitions(relations->team), &shg_captures,
+        shg_cb_friend);
 }
 
 EntityIdx rr_simulation_choose_nearby_enemy(
@@ -296,8 +296,9 @@ EntityIdx rr_simulation_choose_nearby_enemy_custom_pos(
     shg_captures.potential_count = 0;
     struct rr_spatial_hash *shg =
         &rr_simulation_get_arena(simulation, physical->arena)->spatial_hash;
-    rr_spatial_hash_query(shg, x, y, min_dist, min_dist, &shg_captures,
-                          shg_cb_rand_enemy);
+    rr_spatial_hash_query_targets(shg, x, y, min_dist, min_dist,
+                                  enemy_partitions(relations->team),
+                                  &shg_captures, shg_cb_rand_enemy);
 
     float sum = 0;
     for (uint32_t i = 0; i < shg_captures.potential_count; ++i)
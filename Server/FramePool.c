@@ -0,0 +1,113 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Server/FramePool.h>
+
+#include <libwebsockets.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#define PAGE_SIZE (4096)
+
+void rr_frame_pool_init(struct rr_frame_pool *this, uint32_t capacity,
+                        uint64_t frame_size)
+{
+    uint32_t size = 1;
+    while (size < capacity)
+        size *= 2;
+    // every frame starts on its own page so a small one never commits the
+    // tail of a big neighbour
+    this->stride = (LWS_PRE + frame_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1ull);
+    this->memory = mmap(NULL, size * this->stride, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (this->memory == MAP_FAILED)
+    {
+        perror("<rr_frame_pool::mmap>");
+        abort();
+    }
+    this->sizes = calloc(size, sizeof *this->sizes);
+    this->capacity = size;
+    atomic_init(&this->head, 0);
+    atomic_init(&this->drained, 0);
+    atomic_init(&this->tail, 0);
+}
+
+void rr_frame_pool_free(struct rr_frame_pool *this)
+{
+    munmap(this->memory, this->capacity * this->stride);
+    free(this->sizes);
+    this->memory = NULL;
+    this->sizes = NULL;
+}
+
+uint8_t *rr_frame_pool_acquire(struct rr_frame_pool *this)
+{
+    uint32_t tail = atomic_load_explicit(&this->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&this->head, memory_order_acquire) ==
+        this->capacity)
+        return NULL;
+    return this->memory + (tail & (this->capacity - 1)) * this->stride +
+           LWS_PRE;
+}
+
+void rr_frame_pool_commit(struct rr_frame_pool *this, uint32_t size)
+{
+    uint32_t tail = atomic_load_explicit(&this->tail, memory_order_relaxed);
+    this->sizes[tail & (this->capacity - 1)] = size;
+    atomic_store_explicit(&this->tail, tail + 1, memory_order_release);
+}
+
+uint8_t *rr_frame_pool_peek(struct rr_frame_pool *this, uint32_t *size)
+{
+    uint32_t head = atomic_load_explicit(&this->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&this->tail, memory_order_acquire))
+        return NULL;
+    *size = this->sizes[head & (this->capacity - 1)];
+    return this->memory + (head & (this->capacity - 1)) * this->stride +
+           LWS_PRE;
+}
+
+void rr_frame_pool_release(struct rr_frame_pool *this)
+{
+    uint32_t head = atomic_load_explicit(&this->head, memory_order_relaxed);
+    uint32_t size = this->sizes[head & (this->capacity - 1)];
+    // the producer can't touch the frame before head moves past it, so a
+    // burst of big messages doesn't keep its pages for the whole session
+    uint64_t used = (LWS_PRE + (uint64_t)size + PAGE_SIZE - 1) &
+                    ~(PAGE_SIZE - 1ull);
+    if (used > RR_FRAME_POOL_HIGH_WATER)
+        madvise(this->memory + (head & (this->capacity - 1)) * this->stride +
+                    RR_FRAME_POOL_HIGH_WATER,
+                used - RR_FRAME_POOL_HIGH_WATER, MADV_DONTNEED);
+    // single writer like head
+    atomic_store_explicit(
+        &this->drained,
+        atomic_load_explicit(&this->drained, memory_order_relaxed) + size,
+        memory_order_relaxed);
+    atomic_store_explicit(&this->head, head + 1, memory_order_release);
+}
+
+uint32_t rr_frame_pool_size(struct rr_frame_pool *this)
+{
+    return atomic_load_explicit(&this->tail, memory_order_acquire) -
+           atomic_load_explicit(&this->head, memory_order_acquire);
+}
+
+uint64_t rr_frame_pool_drained(struct rr_frame_pool *this)
+{
+    return atomic_load_explicit(&this->drained, memory_order_relaxed);
+}
@@ -0,0 +1,53 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// bytes at the start of every frame that stay committed once it is released.
+// whatever a bigger message touched past this is handed back to the kernel
+#define RR_FRAME_POOL_HIGH_WATER (64 * 1024)
+
+// ring of preallocated websocket frames for exactly one producer thread and
+// one consumer thread. every frame has LWS_PRE bytes of headroom and room for
+// the biggest message, so encoders write straight into it. the memory is
+// reserved up front but pages are only committed once they are written to
+struct rr_frame_pool
+{
+    uint8_t *memory;
+    uint32_t *sizes;
+    uint64_t stride;
+    uint32_t capacity; // power of two
+    _Alignas(64) atomic_uint head;
+    atomic_ullong drained; // bytes of every frame released so far
+    _Alignas(64) atomic_uint tail;
+};
+
+void rr_frame_pool_init(struct rr_frame_pool *, uint32_t, uint64_t);
+void rr_frame_pool_free(struct rr_frame_pool *);
+// producer only, returns NULL if every frame is in use. nothing is sent
+// until the frame is committed, acquiring again hands out the same frame
+uint8_t *rr_frame_pool_acquire(struct rr_frame_pool *);
+void rr_frame_pool_commit(struct rr_frame_pool *, uint32_t);
+// consumer only, returns NULL if nothing is committed. the frame stays valid
+// until it is released
+uint8_t *rr_frame_pool_peek(struct rr_frame_pool *, uint32_t *);
+void rr_frame_pool_release(struct rr_frame_pool *);
+// frames committed but not yet released, exact on either side
+uint32_t rr_frame_pool_size(struct rr_frame_pool *);
+uint64_t rr_frame_pool_drained(struct rr_frame_pool *);
@@ -77,8 +77,8 @@ int main()
 #else
 
 #endif
-    struct rr_server *s = calloc(1, sizeof *s);
-    rr_server_init(s);
-    rr_server_run(s);
-    rr_server_free(s);
+    struct rr_server_host *host = calloc(1, sizeof *host);
+    rr_server_host_init(host);
+    rr_server_host_run(host);
+    rr_server_host_free(host);
 }
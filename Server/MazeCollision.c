@@ -0,0 +1,206 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Server/MazeCollision.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <Shared/Component/Physical.h>
+#include <Shared/Vector.h>
+
+struct rr_maze_collision RR_MAZE_COLLISIONS[rr_biome_id_max];
+
+static struct rr_maze_cell_shape const solid_shape = {
+    0, 1, {{rr_maze_wall_inside, rr_maze_side_none, 0, 0}}};
+
+// indexed by rr_maze_side
+static int8_t const side_offsets[5][2] = {
+    {0, 0}, {-1, 0}, {0, -1}, {1, 0}, {0, 1}};
+
+static uint8_t get_tile(struct rr_maze_declaration const *maze, int32_t x,
+                        int32_t y)
+{
+    if (x < 0 || y < 0 || x >= (int32_t)maze->maze_dim ||
+        y >= (int32_t)maze->maze_dim)
+        return 0;
+    return maze->maze[y * maze->maze_dim + x].value;
+}
+
+// tile 1 is open and 0 is solid. anything else is a rounded corner: bit 0
+// is the bottom half, bit 1 the right half and bit 3 flips which side of the
+// arc is open
+static void build_shape(struct rr_maze_declaration const *maze, int32_t x,
+                        int32_t y, struct rr_maze_cell_shape *shape)
+{
+    memset(shape, 0, sizeof *shape);
+    shape->tile = get_tile(maze, x, y);
+    for (uint8_t side = rr_maze_side_none; side <= rr_maze_side_bottom;
+         ++side)
+    {
+        int8_t dx = side_offsets[side][0];
+        int8_t dy = side_offsets[side][1];
+        uint8_t tile = get_tile(maze, x + dx, y + dy);
+        if (tile == 1)
+            continue;
+        struct rr_maze_wall *wall = &shape->walls[shape->wall_count++];
+        wall->side = side;
+        if (tile == 0)
+        {
+            // nothing after a solid cell is ever looked at
+            if (side == rr_maze_side_none)
+            {
+                wall->kind = rr_maze_wall_inside;
+                return;
+            }
+            wall->kind = rr_maze_wall_flat;
+            wall->x = -dx;
+            wall->y = -dy;
+        }
+        else
+        {
+            wall->kind = (tile >> 3) & 1 ? rr_maze_wall_arc_outer
+                                         : rr_maze_wall_arc_inner;
+            wall->x = dx + ((tile >> 1) & 1);
+            wall->y = dy + (tile & 1);
+        }
+    }
+}
+
+static void build_collision(struct rr_maze_collision *this,
+                            struct rr_maze_declaration const *maze)
+{
+    uint32_t cell_count = maze->maze_dim * maze->maze_dim;
+    this->maze_dim = maze->maze_dim;
+    this->grid_size = maze->grid_size;
+    this->cells = malloc(cell_count * sizeof *this->cells);
+    // at worst every cell has a shape of its own
+    struct rr_maze_cell_shape *shapes = malloc(cell_count * sizeof *shapes);
+    uint32_t shape_count = 0;
+    for (int32_t y = 0; y < (int32_t)maze->maze_dim; ++y)
+        for (int32_t x = 0; x < (int32_t)maze->maze_dim; ++x)
+        {
+            struct rr_maze_cell_shape shape;
+            build_shape(maze, x, y, &shape);
+            uint32_t i = 0;
+            while (i < shape_count && memcmp(&shapes[i], &shape, sizeof shape))
+                ++i;
+            if (i == shape_count)
+                shapes[shape_count++] = shape;
+            this->cells[y * maze->maze_dim + x] = i;
+        }
+    this->shapes = realloc(shapes, shape_count * sizeof *shapes);
+    this->shape_count = shape_count;
+}
+
+void rr_maze_collision_init()
+{
+    for (uint32_t biome = 0; biome < rr_biome_id_max; ++biome)
+    {
+        // biomes can share a maze
+        uint32_t same = 0;
+        while (same < biome && RR_MAZES[same].maze != RR_MAZES[biome].maze)
+            ++same;
+        if (same < biome)
+            RR_MAZE_COLLISIONS[biome] = RR_MAZE_COLLISIONS[same];
+        else
+            build_collision(&RR_MAZE_COLLISIONS[biome], &RR_MAZES[biome]);
+    }
+}
+
+struct rr_maze_cell_shape const *
+rr_maze_collision_get_shape(struct rr_maze_collision const *this, int32_t x,
+                            int32_t y)
+{
+    if (x < 0 || y < 0 || x >= (int32_t)this->maze_dim ||
+        y >= (int32_t)this->maze_dim)
+        return &solid_shape;
+    return &this->shapes[this->cells[y * this->maze_dim + x]];
+}
+
+void rr_maze_collision_resolve(struct rr_maze_collision const *this,
+                               float test_x, float test_y, int32_t x,
+                               int32_t y,
+                               struct rr_component_physical *physical)
+{
+    struct rr_maze_cell_shape const *shape =
+        rr_maze_collision_get_shape(this, x, y);
+    float size = this->grid_size;
+    float radius = physical->radius;
+    for (uint8_t i = 0; i < shape->wall_count; ++i)
+    {
+        struct rr_maze_wall const *wall = &shape->walls[i];
+        // neighbours only count when the circle reaches over the face
+        switch (wall->side)
+        {
+        case rr_maze_side_left:
+            if (!(test_x - x * size < radius))
+                continue;
+            break;
+        case rr_maze_side_top:
+            if (!(test_y - y * size < radius))
+                continue;
+            break;
+        case rr_maze_side_right:
+            if (!((x + 1) * size - test_x < radius))
+                continue;
+            break;
+        case rr_maze_side_bottom:
+            if (!((y + 1) * size - test_y < radius))
+                continue;
+            break;
+        }
+        if (wall->kind == rr_maze_wall_inside)
+            return;
+        if (wall->kind == rr_maze_wall_flat)
+        {
+            if (wall->side == rr_maze_side_left)
+                test_x = x * size + radius;
+            else if (wall->side == rr_maze_side_top)
+                test_y = y * size + radius;
+            else if (wall->side == rr_maze_side_right)
+                test_x = (x + 1) * size - radius;
+            else
+                test_y = (y + 1) * size - radius;
+            rr_component_physical_set_x(physical, test_x);
+            rr_component_physical_set_y(physical, test_y);
+            rr_vector_set(&physical->wall_collision, wall->x, wall->y);
+            return;
+        }
+        float cx = (x + wall->x) * size;
+        float cy = (y + wall->y) * size;
+        struct rr_vector dist = {test_x - cx, test_y - cy};
+        if (wall->kind == rr_maze_wall_arc_inner)
+        {
+            if (rr_vector_magnitude_cmp(&dist, size - radius) != 1)
+                continue;
+            rr_vector_set_magnitude(&dist, size - radius);
+            rr_component_physical_set_x(physical, cx + dist.x);
+            rr_component_physical_set_y(physical, cy + dist.y);
+            rr_vector_set(&physical->wall_collision, -dist.x, -dist.y);
+            return;
+        }
+        if (rr_vector_magnitude_cmp(&dist, size + radius) != -1)
+            continue;
+        rr_vector_set_magnitude(&dist, size + radius);
+        rr_component_physical_set_x(physical, cx + dist.x);
+        rr_component_physical_set_y(physical, cy + dist.y);
+        rr_vector_set(&physical->wall_collision, dist.x, dist.y);
+        return;
+    }
+    rr_component_physical_set_x(physical, test_x);
+    rr_component_physical_set_y(physical, test_y);
+}
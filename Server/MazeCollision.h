@@ -0,0 +1,86 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <Shared/StaticData.h>
+
+struct rr_component_physical;
+
+enum rr_maze_wall_kind
+{
+    // the cell itself is solid, nothing moves
+    rr_maze_wall_inside,
+    rr_maze_wall_flat,
+    // rounded corner, open inside the quarter circle
+    rr_maze_wall_arc_inner,
+    // rounded corner, open outside the quarter circle
+    rr_maze_wall_arc_outer
+};
+
+enum rr_maze_side
+{
+    rr_maze_side_none,
+    rr_maze_side_left,
+    rr_maze_side_top,
+    rr_maze_side_right,
+    rr_maze_side_bottom
+};
+
+// x and y are the arc center in cells from the cell's top left, or the
+// normal of a flat wall
+struct rr_maze_wall
+{
+    uint8_t kind;
+    uint8_t side;
+    int8_t x;
+    int8_t y;
+};
+
+// walls in the order they are resolved, the first one hit wins
+struct rr_maze_cell_shape
+{
+    uint8_t tile;
+    uint8_t wall_count;
+    struct rr_maze_wall walls[5];
+};
+
+// cells share their shape with every other cell that has the same
+// surroundings, so the per cell part is just an index
+struct rr_maze_collision
+{
+    uint32_t maze_dim;
+    float grid_size;
+    uint16_t *cells;
+    struct rr_maze_cell_shape *shapes;
+    uint32_t shape_count;
+};
+
+extern struct rr_maze_collision RR_MAZE_COLLISIONS[rr_biome_id_max];
+
+// built from RR_MAZES, called by rr_static_data_init
+void rr_maze_collision_init();
+// cells outside of the maze are solid
+struct rr_maze_cell_shape const *
+rr_maze_collision_get_shape(struct rr_maze_collision const *, int32_t,
+                            int32_t);
+// moves the physical to the test position, pushed out of the walls of the
+// given cell and the faces it touches. sets wall_collision on a hit
+void rr_maze_collision_resolve(struct rr_maze_collision const *, float, float,
+                               int32_t, int32_t,
+                               struct rr_component_physical *);
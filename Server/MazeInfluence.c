@@ -0,0 +1,150 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Server/MazeInfluence.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Shared/Utilities.h>
+
+void rr_maze_influence_init(struct rr_maze_influence *this,
+                            struct rr_maze_declaration *maze)
+{
+    uint32_t cell_count = maze->maze_dim * maze->maze_dim;
+    memset(this, 0, sizeof *this);
+    this->maze = maze;
+    this->counts = calloc(cell_count, sizeof *this->counts);
+    this->sums = calloc(cell_count, sizeof *this->sums);
+    this->stamps = malloc(RR_MAX_ENTITY_COUNT * sizeof *this->stamps);
+    for (uint32_t i = 0; i < RR_MAX_ENTITY_COUNT; ++i)
+        this->stamps[i].index = -1;
+    this->stamped = malloc(RR_MAX_ENTITY_COUNT * sizeof *this->stamped);
+    this->block_dim = maze->maze_dim / 2;
+    uint32_t block_count = this->block_dim * this->block_dim;
+    this->block_cells = calloc(block_count, sizeof *this->block_cells);
+    this->active_blocks = malloc(block_count * sizeof *this->active_blocks);
+    this->active_index = malloc(block_count * sizeof *this->active_index);
+    this->idle_since = calloc(block_count, sizeof *this->idle_since);
+    this->idle_ticks = calloc(block_count, sizeof *this->idle_ticks);
+    for (uint32_t i = 0; i < cell_count; ++i)
+        maze->maze[i].player_count = maze->maze[i].local_difficulty = 0;
+}
+
+void rr_maze_influence_free(struct rr_maze_influence *this)
+{
+    free(this->counts);
+    free(this->sums);
+    free(this->stamps);
+    free(this->stamped);
+    free(this->block_cells);
+    free(this->active_blocks);
+    free(this->active_index);
+    free(this->idle_since);
+    free(this->idle_ticks);
+}
+
+static void set_block_cell(struct rr_maze_influence *this, uint32_t x,
+                           uint32_t y, int8_t delta)
+{
+    uint32_t block = y / 2 * this->block_dim + x / 2;
+    if (delta > 0 && this->block_cells[block]++ == 0)
+    {
+        this->idle_ticks[block] += this->tick - this->idle_since[block];
+        this->active_index[block] = this->active_count;
+        this->active_blocks[this->active_count++] = block;
+    }
+    else if (delta < 0 && --this->block_cells[block] == 0)
+    {
+        this->idle_since[block] = this->tick;
+        uint32_t last = this->active_blocks[--this->active_count];
+        this->active_blocks[this->active_index[block]] = last;
+        this->active_index[last] = this->active_index[block];
+    }
+}
+
+static void stamp(struct rr_maze_influence *this,
+                  struct rr_maze_influence_stamp *stamp, int8_t sign)
+{
+    uint32_t dim = this->maze->maze_dim;
+    for (uint32_t y = stamp->start_y; y <= stamp->end_y; ++y)
+        for (uint32_t x = stamp->start_x; x <= stamp->end_x; ++x)
+        {
+            uint32_t i = y * dim + x;
+            struct rr_maze_grid *grid = &this->maze->maze[i];
+            uint32_t before = this->counts[i];
+            this->counts[i] += sign;
+            this->sums[i] +=
+                sign *
+                lrintf(rr_fclamp((stamp->level - (grid->difficulty - 1) * 2.1) /
+                                     10,
+                                 -1, 1) *
+                       RR_MAZE_INFLUENCE_ONE);
+            grid->player_count = this->counts[i] < RR_MAZE_PLAYER_COUNT_CAP
+                                     ? this->counts[i]
+                                     : RR_MAZE_PLAYER_COUNT_CAP;
+            grid->local_difficulty =
+                (float)this->sums[i] / RR_MAZE_INFLUENCE_ONE;
+            if (before == 0 || this->counts[i] == 0)
+                set_block_cell(this, x, y, sign);
+        }
+}
+
+void rr_maze_influence_set(struct rr_maze_influence *this, EntityIdx entity,
+                           uint32_t start_x, uint32_t start_y, uint32_t end_x,
+                           uint32_t end_y, uint32_t level)
+{
+    struct rr_maze_influence_stamp *current = &this->stamps[entity];
+    current->seen_tick = this->tick;
+    if (current->index >= 0 && current->start_x == start_x &&
+        current->start_y == start_y && current->end_x == end_x &&
+        current->end_y == end_y && current->level == level)
+        return;
+    struct rr_maze_influence_stamp next = {start_x, start_y, end_x,
+                                           end_y,   level,   this->tick,
+                                           current->index};
+    // the new window goes in first so blocks in both never look idle
+    stamp(this, &next, 1);
+    if (current->index >= 0)
+        stamp(this, current, -1);
+    else
+    {
+        next.index = this->stamped_count;
+        this->stamped[this->stamped_count++] = entity;
+    }
+    *current = next;
+}
+
+void rr_maze_influence_update(struct rr_maze_influence *this)
+{
+    for (uint32_t i = 0; i < this->stamped_count;)
+    {
+        struct rr_maze_influence_stamp *current =
+            &this->stamps[this->stamped[i]];
+        if (current->seen_tick == this->tick)
+        {
+            ++i;
+            continue;
+        }
+        stamp(this, current, -1);
+        EntityIdx last = this->stamped[--this->stamped_count];
+        this->stamped[i] = last;
+        this->stamps[last].index = i;
+        current->index = -1;
+    }
+    ++this->tick;
+}
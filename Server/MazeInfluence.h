@@ -0,0 +1,75 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <Shared/Entity.h>
+#include <Shared/StaticData.h>
+
+#define RR_MAZE_PLAYER_COUNT_CAP (12)
+// local difficulty is summed in fixed point so that taking a flower back out
+// leaves exactly what was there before
+#define RR_MAZE_INFLUENCE_ONE (65536)
+
+// the window of cells a flower counts towards and the level it was counted
+// with
+struct rr_maze_influence_stamp
+{
+    uint16_t start_x;
+    uint16_t start_y;
+    uint16_t end_x;
+    uint16_t end_y;
+    uint32_t level;
+    uint32_t seen_tick;
+    // position in stamped, or -1
+    int32_t index;
+};
+
+// player_count and local_difficulty of the maze cells, kept up to date as
+// flowers move between cells instead of being recounted every tick.
+// spawning works on 2x2 blocks, the blocks with a flower in range of any of
+// their cells are packed in active_blocks[0, active_count)
+struct rr_maze_influence
+{
+    struct rr_maze_declaration *maze;
+    uint32_t tick;
+    uint32_t *counts;
+    int32_t *sums;
+    struct rr_maze_influence_stamp *stamps;
+    EntityIdx *stamped;
+    uint32_t stamped_count;
+    uint32_t block_dim;
+    uint8_t *block_cells;
+    uint32_t *active_blocks;
+    uint32_t *active_index;
+    uint32_t active_count;
+    // tick the block last went idle, and how many ticks it spent idle
+    // before it became active again. the spawner catches up on those
+    uint32_t *idle_since;
+    uint32_t *idle_ticks;
+};
+
+void rr_maze_influence_init(struct rr_maze_influence *,
+                            struct rr_maze_declaration *);
+void rr_maze_influence_free(struct rr_maze_influence *);
+// counts the flower towards the window of cells, only touching the grid if
+// the window or the level changed since the last tick
+void rr_maze_influence_set(struct rr_maze_influence *, EntityIdx, uint32_t,
+                           uint32_t, uint32_t, uint32_t, uint32_t);
+// takes out the flowers that weren't set this tick and starts the next one
+void rr_maze_influence_update(struct rr_maze_influence *);
@@ -0,0 +1,333 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Server/Profiler.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Server/Scheduler.h>
+
+struct histogram
+{
+    atomic_uint buckets[RR_PROFILER_BUCKET_COUNT];
+    atomic_ullong count;
+    atomic_ullong sum;
+    atomic_ullong max;
+};
+
+// only ever written by the thread that owns it
+struct thread_histograms
+{
+    struct histogram probes[RR_PROFILER_MAX_PROBE_COUNT];
+};
+
+struct merged_histogram
+{
+    uint64_t buckets[RR_PROFILER_BUCKET_COUNT];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+};
+
+static pthread_mutex_t register_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char const *probe_names[RR_PROFILER_MAX_PROBE_COUNT];
+static uint8_t probe_is_value[RR_PROFILER_MAX_PROBE_COUNT];
+static atomic_uint probe_count;
+
+static _Atomic(struct thread_histograms *)
+    threads[RR_PROFILER_MAX_THREAD_COUNT];
+static atomic_uint thread_count;
+static atomic_ullong dropped_samples;
+static _Thread_local struct thread_histograms *current_thread;
+static _Thread_local uint8_t no_thread_slot;
+
+static atomic_uint system_probes[RR_PROFILER_MAX_PROBE_COUNT];
+
+// merged totals as of the last dump, the window is the difference
+static pthread_mutex_t dump_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct merged_histogram last_dump[RR_PROFILER_MAX_PROBE_COUNT];
+static uint64_t start_time;
+static uint64_t last_dump_time;
+
+uint64_t rr_profiler_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static uint32_t bucket_index(uint64_t value)
+{
+    if (value < 16)
+        return value;
+    uint32_t msb = 63 - __builtin_clzll(value);
+    return (msb - 3) * 16 + ((value >> (msb - 4)) & 15);
+}
+
+// middle of the bucket
+static double bucket_value(uint32_t index)
+{
+    if (index < 16)
+        return index;
+    uint32_t msb = index / 16 + 3;
+    uint64_t width = 1ull << (msb - 4);
+    return (16 + index % 16) * width + width * 0.5;
+}
+
+static uint32_t register_probe(char const *name, uint8_t is_value)
+{
+    pthread_mutex_lock(&register_mutex);
+    if (start_time == 0)
+        start_time = last_dump_time = rr_profiler_now();
+    uint32_t count = atomic_load(&probe_count);
+    uint32_t probe = 0;
+    for (; probe < count; ++probe)
+        if (strcmp(probe_names[probe], name) == 0)
+            break;
+    if (probe == count)
+    {
+        if (count < RR_PROFILER_MAX_PROBE_COUNT)
+        {
+            probe_names[count] = name;
+            probe_is_value[count] = is_value;
+            atomic_store(&probe_count, count + 1);
+        }
+        else
+        {
+            // shares the last probe rather than losing the samples
+            fprintf(stderr, "<rr_profiler::too_many_probes::%s>\n", name);
+            probe = RR_PROFILER_MAX_PROBE_COUNT - 1;
+        }
+    }
+    pthread_mutex_unlock(&register_mutex);
+    return probe;
+}
+
+uint32_t rr_profiler_register(char const *name)
+{
+    return register_probe(name, 0);
+}
+
+static uint32_t cached_probe(atomic_uint *cache, char const *name,
+                             uint8_t is_value)
+{
+    uint32_t probe = atomic_load_explicit(cache, memory_order_acquire);
+    if (probe != 0)
+        return probe - 1;
+    probe = register_probe(name, is_value);
+    atomic_store_explicit(cache, probe + 1, memory_order_release);
+    return probe;
+}
+
+uint32_t rr_profiler_probe(atomic_uint *cache, char const *name)
+{
+    return cached_probe(cache, name, 0);
+}
+
+uint32_t rr_profiler_value_probe(atomic_uint *cache, char const *name)
+{
+    return cached_probe(cache, name, 1);
+}
+
+static struct thread_histograms *claim_thread()
+{
+    if (no_thread_slot)
+        return NULL;
+    uint32_t slot = atomic_fetch_add(&thread_count, 1);
+    if (slot >= RR_PROFILER_MAX_THREAD_COUNT)
+    {
+        no_thread_slot = 1;
+        return NULL;
+    }
+    current_thread = calloc(1, sizeof *current_thread);
+    atomic_store_explicit(&threads[slot], current_thread,
+                          memory_order_release);
+    return current_thread;
+}
+
+// single writer, a relaxed load and store is enough and avoids a locked add
+#define bump(counter, amount)                                                  \
+    atomic_store_explicit(                                                     \
+        counter,                                                               \
+        atomic_load_explicit(counter, memory_order_relaxed) + (amount),        \
+        memory_order_relaxed)
+
+void rr_profiler_record(uint32_t probe, uint64_t nanoseconds)
+{
+    struct thread_histograms *thread = current_thread;
+    if (thread == NULL && (thread = claim_thread()) == NULL)
+    {
+        atomic_fetch_add_explicit(&dropped_samples, 1, memory_order_relaxed);
+        return;
+    }
+    struct histogram *histogram = &thread->probes[probe];
+    bump(&histogram->buckets[bucket_index(nanoseconds)], 1);
+    bump(&histogram->count, 1);
+    bump(&histogram->sum, nanoseconds);
+    if (nanoseconds > atomic_load_explicit(&histogram->max, memory_order_relaxed))
+        atomic_store_explicit(&histogram->max, nanoseconds,
+                              memory_order_relaxed);
+}
+
+#undef bump
+
+void rr_profiler_system_timer(uint32_t index,
+                              struct rr_scheduler_system const *system,
+                              uint64_t nanoseconds, void *captures)
+{
+    if (index >= RR_PROFILER_MAX_PROBE_COUNT)
+        return;
+    rr_profiler_record(rr_profiler_probe(&system_probes[index], system->name),
+                       nanoseconds);
+}
+
+static void merge(uint32_t probe, struct merged_histogram *out)
+{
+    memset(out, 0, sizeof *out);
+    uint32_t count = atomic_load(&thread_count);
+    if (count > RR_PROFILER_MAX_THREAD_COUNT)
+        count = RR_PROFILER_MAX_THREAD_COUNT;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        struct thread_histograms *thread =
+            atomic_load_explicit(&threads[i], memory_order_acquire);
+        if (thread == NULL)
+            continue;
+        struct histogram *histogram = &thread->probes[probe];
+        for (uint32_t j = 0; j < RR_PROFILER_BUCKET_COUNT; ++j)
+            out->buckets[j] += atomic_load_explicit(&histogram->buckets[j],
+                                                    memory_order_relaxed);
+        out->count +=
+            atomic_load_explicit(&histogram->count, memory_order_relaxed);
+        out->sum += atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+        uint64_t max =
+            atomic_load_explicit(&histogram->max, memory_order_relaxed);
+        if (max > out->max)
+            out->max = max;
+    }
+}
+
+// never above the recorded max even though buckets report their middle
+static double percentile(struct merged_histogram *histogram, double p)
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < RR_PROFILER_BUCKET_COUNT; ++i)
+        total += histogram->buckets[i];
+    if (total == 0)
+        return 0;
+    uint64_t target = p * total;
+    if (target >= total)
+        target = total - 1;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < RR_PROFILER_BUCKET_COUNT; ++i)
+        if ((seen += histogram->buckets[i]) > target)
+            return bucket_value(i) < histogram->max ? bucket_value(i)
+                                                    : histogram->max;
+    return 0;
+}
+
+static void write_histogram(FILE *file, uint32_t probe,
+                            struct merged_histogram *histogram)
+{
+    if (histogram->count == 0)
+        return;
+    double scale = probe_is_value[probe] ? 1 : 1000;
+    fprintf(file, "%-24s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            probe_names[probe], (unsigned long long)histogram->count,
+            histogram->sum / scale / histogram->count,
+            percentile(histogram, 0.5) / scale,
+            percentile(histogram, 0.9) / scale,
+            percentile(histogram, 0.99) / scale,
+            percentile(histogram, 0.999) / scale, histogram->max / scale);
+}
+
+static void write_header(FILE *file, char const *title, double seconds)
+{
+    fprintf(file, "# %s (%.1fs)\n", title, seconds);
+    // value probes are written unscaled
+    fprintf(file, "%-24s %10s %10s %10s %10s %10s %10s %10s\n", "# probe (us)",
+            "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+}
+
+static void write_locked(FILE *file, uint8_t advance_window)
+{
+    uint64_t now = rr_profiler_now();
+    uint32_t count = atomic_load(&probe_count);
+    uint32_t threads_in_use = atomic_load(&thread_count);
+    fprintf(file, "# rr_profiler, %u threads, %llu samples dropped\n",
+            threads_in_use, (unsigned long long)atomic_load(&dropped_samples));
+    struct merged_histogram *totals = malloc(count * sizeof *totals);
+    for (uint32_t i = 0; i < count; ++i)
+        merge(i, &totals[i]);
+
+    write_header(file, "since last dump", (now - last_dump_time) * 1e-9);
+    struct merged_histogram window;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        for (uint32_t j = 0; j < RR_PROFILER_BUCKET_COUNT; ++j)
+            window.buckets[j] = totals[i].buckets[j] - last_dump[i].buckets[j];
+        window.count = totals[i].count - last_dump[i].count;
+        window.sum = totals[i].sum - last_dump[i].sum;
+        // the exact max isn't known for a window, use the highest bucket
+        window.max = 0;
+        for (uint32_t j = RR_PROFILER_BUCKET_COUNT; j-- > 0;)
+            if (window.buckets[j])
+            {
+                window.max = bucket_value(j);
+                break;
+            }
+        write_histogram(file, i, &window);
+    }
+
+    write_header(file, "since startup", (now - start_time) * 1e-9);
+    for (uint32_t i = 0; i < count; ++i)
+        write_histogram(file, i, &totals[i]);
+
+    if (advance_window)
+    {
+        memcpy(last_dump, totals, count * sizeof *totals);
+        last_dump_time = now;
+    }
+    free(totals);
+}
+
+void rr_profiler_write(FILE *file)
+{
+    pthread_mutex_lock(&dump_mutex);
+    write_locked(file, 0);
+    pthread_mutex_unlock(&dump_mutex);
+}
+
+void rr_profiler_dump(char const *path)
+{
+    char temporary[256];
+    snprintf(temporary, sizeof temporary, "%s.tmp", path);
+    pthread_mutex_lock(&dump_mutex);
+    FILE *file = fopen(temporary, "w");
+    if (file == NULL)
+    {
+        pthread_mutex_unlock(&dump_mutex);
+        fprintf(stderr, "<rr_profiler::dump_failed::%s>\n", temporary);
+        return;
+    }
+    write_locked(file, 1);
+    fclose(file);
+    rename(temporary, path);
+    pthread_mutex_unlock(&dump_mutex);
+}
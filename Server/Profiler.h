@@ -0,0 +1,58 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define RR_PROFILER_MAX_PROBE_COUNT (64)
+#define RR_PROFILER_MAX_THREAD_COUNT (64)
+// 16 linear buckets per power of two, values are in nanoseconds
+#define RR_PROFILER_BUCKET_COUNT (1024)
+
+struct rr_scheduler_system;
+
+// probes are named timers. every thread records into its own histograms so
+// recording never takes a lock, readers merge all threads when dumping
+uint32_t rr_profiler_register(char const *);
+// returns the probe cached in *cache, registering it on first use
+uint32_t rr_profiler_probe(atomic_uint *, char const *);
+// same, but the samples are plain values like queue sizes and are dumped as
+// they are instead of in microseconds
+uint32_t rr_profiler_value_probe(atomic_uint *, char const *);
+uint64_t rr_profiler_now();
+void rr_profiler_record(uint32_t, uint64_t);
+
+// hook for rr_scheduler::system_timer, one probe per system name
+void rr_profiler_system_timer(uint32_t, struct rr_scheduler_system const *,
+                              uint64_t, void *);
+
+// writes the window since the last dump and the totals since startup
+void rr_profiler_write(FILE *);
+// replaces path atomically with rr_profiler_write's output
+void rr_profiler_dump(char const *);
+
+// times CODE under NAME, the probe is registered the first time it runs
+#define RR_PROFILE(NAME, CODE)                                                 \
+    {                                                                          \
+        static atomic_uint profiler_probe_;                                    \
+        uint64_t profiler_start_ = rr_profiler_now();                          \
+        CODE;                                                                  \
+        rr_profiler_record(rr_profiler_probe(&profiler_probe_, NAME),          \
+                           rr_profiler_now() - profiler_start_);               \
+    }
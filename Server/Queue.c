@@ -0,0 +1,63 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Server/Queue.h>
+
+#include <stdlib.h>
+
+void rr_queue_init(struct rr_queue *this, uint32_t capacity)
+{
+    uint32_t size = 1;
+    while (size < capacity)
+        size *= 2;
+    this->items = calloc(size, sizeof *this->items);
+    this->capacity = size;
+    atomic_init(&this->head, 0);
+    atomic_init(&this->tail, 0);
+}
+
+void rr_queue_free(struct rr_queue *this)
+{
+    free(this->items);
+    this->items = NULL;
+}
+
+uint8_t rr_queue_push(struct rr_queue *this, void *item)
+{
+    uint32_t tail = atomic_load_explicit(&this->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&this->head, memory_order_acquire) ==
+        this->capacity)
+        return 0;
+    this->items[tail & (this->capacity - 1)] = item;
+    atomic_store_explicit(&this->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+void *rr_queue_pop(struct rr_queue *this)
+{
+    uint32_t head = atomic_load_explicit(&this->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&this->tail, memory_order_acquire))
+        return NULL;
+    void *item = this->items[head & (this->capacity - 1)];
+    atomic_store_explicit(&this->head, head + 1, memory_order_release);
+    return item;
+}
+
+uint32_t rr_queue_size(struct rr_queue *this)
+{
+    return atomic_load_explicit(&this->tail, memory_order_acquire) -
+           atomic_load_explicit(&this->head, memory_order_acquire);
+}
@@ -0,0 +1,40 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// bounded lock free queue of pointers for exactly one producer thread and
+// one consumer thread
+struct rr_queue
+{
+    void **items;
+    uint32_t capacity; // power of two
+    // kept on separate cache lines so the two threads don't bounce them
+    _Alignas(64) atomic_uint head;
+    _Alignas(64) atomic_uint tail;
+};
+
+void rr_queue_init(struct rr_queue *, uint32_t);
+void rr_queue_free(struct rr_queue *);
+// producer only, returns 0 if the queue is full
+uint8_t rr_queue_push(struct rr_queue *, void *);
+// consumer only, returns NULL if the queue is empty
+void *rr_queue_pop(struct rr_queue *);
+// exact on either side, a lower bound everywhere else
+uint32_t rr_queue_size(struct rr_queue *);
@@ -0,0 +1,251 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <Server/Scheduler.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Shared/SimulationCommon.h>
+
+static _Thread_local struct rr_scheduler_command_buffer *current_command_buffer;
+static _Thread_local uint8_t inside_job;
+
+static void run_chunks(struct rr_scheduler *this)
+{
+    uint32_t chunk;
+    inside_job = 1;
+    while ((chunk = atomic_fetch_add(&this->next_chunk, 1)) <
+           this->chunk_count)
+    {
+        uint32_t begin = chunk * this->chunk_size;
+        uint32_t end = begin + this->chunk_size;
+        if (end > this->job_size)
+            end = this->job_size;
+        current_command_buffer = &this->command_buffers[chunk];
+        this->job(begin, end, this->job_captures);
+    }
+    current_command_buffer = NULL;
+    inside_job = 0;
+}
+
+static void *worker_thread(void *_this)
+{
+    struct rr_scheduler *this = _this;
+    uint64_t generation = 0;
+    while (1)
+    {
+        pthread_mutex_lock(&this->mutex);
+        while (this->generation == generation && !this->stopping)
+            pthread_cond_wait(&this->wake, &this->mutex);
+        generation = this->generation;
+        uint8_t stopping = this->stopping;
+        pthread_mutex_unlock(&this->mutex);
+        if (stopping)
+            return NULL;
+        run_chunks(this);
+        if (atomic_fetch_sub(&this->busy_workers, 1) == 1)
+        {
+            pthread_mutex_lock(&this->mutex);
+            pthread_cond_signal(&this->done);
+            pthread_mutex_unlock(&this->mutex);
+        }
+    }
+}
+
+static void run_job(struct rr_scheduler *this, uint32_t size,
+                    uint32_t chunk_size, void *captures,
+                    void (*cb)(uint32_t, uint32_t, void *))
+{
+    this->job = cb;
+    this->job_captures = captures;
+    this->job_size = size;
+    this->chunk_size = chunk_size;
+    this->chunk_count = (size + chunk_size - 1) / chunk_size;
+    atomic_store(&this->next_chunk, 0);
+    atomic_store(&this->busy_workers, this->worker_count);
+    pthread_mutex_lock(&this->mutex);
+    ++this->generation;
+    pthread_cond_broadcast(&this->wake);
+    pthread_mutex_unlock(&this->mutex);
+
+    run_chunks(this);
+
+    pthread_mutex_lock(&this->mutex);
+    while (atomic_load(&this->busy_workers) != 0)
+        pthread_cond_wait(&this->done, &this->mutex);
+    pthread_mutex_unlock(&this->mutex);
+
+    // deferred work may start jobs of its own, keep those inline so the
+    // buffers aren't reused while they're being replayed
+    inside_job = 1;
+    for (uint32_t i = 0; i < this->chunk_count; ++i)
+    {
+        struct rr_scheduler_command_buffer *buffer = &this->command_buffers[i];
+        for (uint32_t j = 0; j < buffer->size; ++j)
+            buffer->commands[j].cb(this->simulation,
+                                   buffer->commands[j].entity);
+        buffer->size = 0;
+    }
+    inside_job = 0;
+}
+
+void rr_scheduler_init(struct rr_scheduler *this,
+                       struct rr_simulation *simulation, uint32_t worker_count)
+{
+    memset(this, 0, sizeof *this);
+    this->simulation = simulation;
+    pthread_mutex_init(&this->mutex, NULL);
+    pthread_cond_init(&this->wake, NULL);
+    pthread_cond_init(&this->done, NULL);
+    if (worker_count > RR_SCHEDULER_MAX_WORKER_COUNT)
+        worker_count = RR_SCHEDULER_MAX_WORKER_COUNT;
+    for (uint32_t i = 0; i < worker_count; ++i)
+    {
+        if (pthread_create(&this->workers[i], NULL, worker_thread, this))
+        {
+            fprintf(stderr, "<rr_scheduler::worker_create_failed::%u>\n", i);
+            break;
+        }
+        ++this->worker_count;
+    }
+    fprintf(stderr, "<rr_scheduler::init::%u workers>\n", this->worker_count);
+}
+
+void rr_scheduler_free(struct rr_scheduler *this)
+{
+    pthread_mutex_lock(&this->mutex);
+    this->stopping = 1;
+    pthread_cond_broadcast(&this->wake);
+    pthread_mutex_unlock(&this->mutex);
+    for (uint32_t i = 0; i < this->worker_count; ++i)
+        pthread_join(this->workers[i], NULL);
+    for (uint32_t i = 0; i < RR_SCHEDULER_MAX_CHUNK_COUNT; ++i)
+        free(this->command_buffers[i].commands);
+    pthread_cond_destroy(&this->done);
+    pthread_cond_destroy(&this->wake);
+    pthread_mutex_destroy(&this->mutex);
+}
+
+void rr_scheduler_parallel_for(struct rr_scheduler *this, uint32_t size,
+                               uint32_t min_chunk_size, void *captures,
+                               void (*cb)(uint32_t, uint32_t, void *))
+{
+    if (this == NULL || this->worker_count == 0 || inside_job ||
+        size < 2 * min_chunk_size)
+    {
+        cb(0, size, captures);
+        return;
+    }
+    uint32_t chunk_count = (this->worker_count + 1) * 4;
+    if (chunk_count > RR_SCHEDULER_MAX_CHUNK_COUNT)
+        chunk_count = RR_SCHEDULER_MAX_CHUNK_COUNT;
+    uint32_t chunk_size = (size + chunk_count - 1) / chunk_count;
+    if (chunk_size < min_chunk_size)
+        chunk_size = min_chunk_size;
+    run_job(this, size, chunk_size, captures, cb);
+}
+
+uint8_t rr_scheduler_defer(EntityIdx entity,
+                           void (*cb)(struct rr_simulation *, EntityIdx))
+{
+    struct rr_scheduler_command_buffer *buffer = current_command_buffer;
+    if (buffer == NULL)
+        return 0;
+    if (buffer->size == buffer->capacity)
+    {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 64;
+        buffer->commands = realloc(buffer->commands,
+                                   buffer->capacity * sizeof *buffer->commands);
+    }
+    buffer->commands[buffer->size++] =
+        (struct rr_scheduler_command){cb, entity};
+    return 1;
+}
+
+static uint64_t get_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void run_system(struct rr_scheduler *this,
+                       struct rr_simulation *simulation,
+                       struct rr_scheduler_system const *systems,
+                       uint32_t index)
+{
+    if (this == NULL || this->system_timer == NULL)
+    {
+        systems[index].tick(simulation);
+        return;
+    }
+    uint64_t start = get_time();
+    systems[index].tick(simulation);
+    this->system_timer(index, &systems[index], get_time() - start,
+                       this->system_timer_captures);
+}
+
+struct run_systems_captures
+{
+    struct rr_scheduler *scheduler;
+    struct rr_simulation *simulation;
+    struct rr_scheduler_system const *systems;
+    uint32_t first;
+};
+
+static void run_systems(uint32_t begin, uint32_t end, void *_captures)
+{
+    struct run_systems_captures *captures = _captures;
+    for (uint32_t i = begin; i < end; ++i)
+        run_system(captures->scheduler, captures->simulation,
+                   captures->systems, captures->first + i);
+}
+
+void rr_scheduler_run(struct rr_scheduler *this,
+                      struct rr_simulation *simulation,
+                      struct rr_scheduler_system const *systems,
+                      uint32_t count)
+{
+    uint8_t parallel = this != NULL && this->worker_count > 0 && !inside_job;
+    uint32_t begin = 0;
+    while (begin < count)
+    {
+        uint32_t reads = systems[begin].reads;
+        uint32_t writes = systems[begin].writes;
+        uint32_t end = begin + 1;
+        for (; parallel && end < count; ++end)
+        {
+            if (systems[end].writes & (reads | writes))
+                break;
+            if (systems[end].reads & writes)
+                break;
+            reads |= systems[end].reads;
+            writes |= systems[end].writes;
+        }
+        if (end - begin == 1)
+            run_system(this, simulation, systems, begin);
+        else
+        {
+            struct run_systems_captures captures = {this, simulation,
+                                                    systems, begin};
+            run_job(this, end - begin, 1, &captures, run_systems);
+        }
+        begin = end;
+    }
+}
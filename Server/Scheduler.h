@@ -0,0 +1,118 @@
+// Copyright (C) 2024 Paul Johnson
+// Copyright (C) 2024-2025 Maxim Nesterov
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <Shared/Entity.h>
+
+#define RR_SCHEDULER_MAX_WORKER_COUNT (32)
+#define RR_SCHEDULER_MAX_CHUNK_COUNT (64)
+#define RR_SCHEDULER_ALL_RESOURCES (0xffffffffu)
+
+struct rr_simulation;
+
+// what a system touches. components use the same bit as entity_tracker, the
+// high bits are state that lives outside of the component arrays
+enum rr_scheduler_resource
+{
+#define XX(COMPONENT, ID) rr_scheduler_resource_##COMPONENT = 1 << ID,
+    RR_FOR_EACH_COMPONENT
+#undef XX
+    rr_scheduler_resource_entities = 1 << 16, // allocation and deletion
+    rr_scheduler_resource_spatial_hash = 1 << 17,
+    rr_scheduler_resource_maze = 1 << 18,
+    rr_scheduler_resource_rng = 1 << 19, // anything calling rand()
+    rr_scheduler_resource_clients = 1 << 20,
+    rr_scheduler_resource_animations = 1 << 21
+};
+
+struct rr_scheduler_system
+{
+    char const *name;
+    void (*tick)(struct rr_simulation *);
+    uint32_t reads;
+    uint32_t writes;
+};
+
+struct rr_scheduler_command
+{
+    void (*cb)(struct rr_simulation *, EntityIdx);
+    EntityIdx entity;
+};
+
+struct rr_scheduler_command_buffer
+{
+    struct rr_scheduler_command *commands;
+    uint32_t size;
+    uint32_t capacity;
+};
+
+struct rr_scheduler
+{
+    struct rr_simulation *simulation;
+    pthread_t workers[RR_SCHEDULER_MAX_WORKER_COUNT];
+    uint32_t worker_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    uint64_t generation;
+    uint8_t stopping;
+
+    void (*job)(uint32_t, uint32_t, void *);
+    void *job_captures;
+    uint32_t job_size;
+    uint32_t chunk_size;
+    uint32_t chunk_count;
+    atomic_uint next_chunk;
+    atomic_uint busy_workers;
+
+    // one per chunk, replayed in chunk order so deferred work runs in the
+    // same order as the serial loop would have run it
+    struct rr_scheduler_command_buffer
+        command_buffers[RR_SCHEDULER_MAX_CHUNK_COUNT];
+
+    // optional, called with the index of the system in the table passed to
+    // rr_scheduler_run and how long it took. may be called from workers
+    void (*system_timer)(uint32_t, struct rr_scheduler_system const *,
+                         uint64_t, void *);
+    void *system_timer_captures;
+};
+
+// worker_count == 0 runs everything on the calling thread
+void rr_scheduler_init(struct rr_scheduler *, struct rr_simulation *,
+                       uint32_t);
+void rr_scheduler_free(struct rr_scheduler *);
+
+// calls cb(begin, end, captures) over [0, count) split into chunks of at
+// least min_chunk_size. safe to call with a NULL scheduler or from inside
+// another job, in which case the whole range runs inline
+void rr_scheduler_parallel_for(struct rr_scheduler *, uint32_t, uint32_t,
+                               void *, void (*)(uint32_t, uint32_t, void *));
+
+// queues cb(simulation, entity) to run after the current parallel_for in
+// serial order. returns 0 if there is no job running, the caller should do the
+// work itself in that case
+uint8_t rr_scheduler_defer(EntityIdx, void (*)(struct rr_simulation *,
+                                                EntityIdx));
+
+// runs systems in order, systems next to each other whose reads and writes do
+// not overlap are ran at the same time
+void rr_scheduler_run(struct rr_scheduler *, struct rr_simulation *,
+                      struct rr_scheduler_system const *, uint32_t);
@@ -14,20 +14,29 @@
 // You should have received a copy of the GNU Affero General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+// pthread_setaffinity_np
+#define _GNU_SOURCE
+
 #include <Server/Server.h>
 
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
 #include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <libwebsockets.h>
 
 #include <Server/Client.h>
+#include <Server/Crafting.h>
 #include <Server/EntityAllocation.h>
 #include <Server/Logs.h>
+#include <Server/Profiler.h>
 #include <Server/Simulation.h>
 #include <Server/UpdateProtocol.h>
 #include <Server/Waves.h>
@@ -42,8 +51,20 @@
 #include <Shared/cJSON.h>
 #include <Shared/pb.h>
 
-uint8_t lws_message_data[MESSAGE_BUFFER_SIZE];
-uint8_t *outgoing_message = lws_message_data + LWS_PRE;
+#define PROFILER_DUMP_INTERVAL (60 * 25)
+#define TICK_INTERVAL (40000000ull)
+
+static atomic_uint broadcast_probe;
+static atomic_uint server_tick_probe;
+static atomic_uint input_latency_probe;
+static atomic_uint tick_start_delay_probe;
+static atomic_uint session_frames_probe;
+static atomic_uint entity_cache_probe;
+static atomic_uint update_budget_probe;
+static volatile sig_atomic_t profiler_dump_requested;
+
+// kill -USR1 writes the profiler file on the next tick
+static void request_profiler_dump(int signal) { profiler_dump_requested = 1; }
 
 struct connected_captures
 {
@@ -78,8 +99,8 @@ static void *rivet_disconnected_endpoint(void *_captures)
     return NULL;
 }
 
-static void rr_server_client_create_player_info(struct rr_server *server,
-                                                struct rr_server_client *client)
+void rr_server_client_create_player_info(struct rr_server *server,
+                                         struct rr_server_client *client)
 {
     puts("creating player info");
     struct rr_component_player_info *player_info = client->player_info =
@@ -118,6 +139,8 @@ static void rr_server_client_create_player_info(struct rr_server *server,
 void rr_server_client_free(struct rr_server_client *this)
 {
     // WARNING: ONLY TO BE USED WHEN CLIENT DISCONNECTS
+    if (this->verified)
+        rr_server_client_flush_account(this, 1);
     if (this->player_info != NULL)
     {
         rr_simulation_request_entity_deletion(&this->server->simulation,
@@ -128,16 +151,6 @@ void rr_server_client_free(struct rr_server_client *this)
     uint8_t i = this - this->server->clients;
     for (uint8_t j = 0; j < RR_MAX_CLIENT_COUNT; ++j)
         rr_bitset_unset(this->server->clients[j].blocked_clients, i);
-    struct rr_server_client_message *message = this->message_root;
-    while (message != NULL)
-    {
-        struct rr_server_client_message *tmp = message->next;
-        free(message->packet);
-        free(message);
-        message = tmp;
-    }
-    this->message_at = this->message_root = NULL;
-    this->message_length = 0;
     puts("<rr_server::client_disconnect>");
 }
 
@@ -214,8 +227,16 @@ void rr_server_client_broadcast_update(struct rr_server_client *this)
     struct rr_server *server = this->server;
     struct rr_simulation *simulation = &server->simulation;
     struct proto_bug encoder;
-    proto_bug_init(&encoder, outgoing_message);
+    if (!rr_server_client_begin_droppable_message(this, &encoder))
+    {
+        // field changes of this tick never reach the client, the next update
+        // has to resend everything it can see
+        if (this->player_info != NULL)
+            this->player_info->resync_in_view = 1;
+        return;
+    }
     proto_bug_write_uint8(&encoder, rr_clientbound_update, "header");
+    proto_bug_write_varuint(&encoder, server->tick, "tick");
 
     struct rr_squad *squad = rr_client_get_squad(server, this);
     int8_t kick_vote_pos =
@@ -260,10 +281,9 @@ void rr_server_client_broadcast_update(struct rr_server_client *this)
     proto_bug_write_uint8(&encoder, this->afk_ticks > 9 * 60 * 25, "afk");
     proto_bug_write_uint8(&encoder, this->player_info != NULL, "in game");
     if (this->player_info != NULL)
-        rr_simulation_write_binary(&server->simulation, &encoder,
-                                   this->player_info);
-    rr_server_client_write_message(this, encoder.start,
-                                   encoder.current - encoder.start);
+        rr_simulation_write_binary(&server->simulation, &server->entity_cache,
+                                   &encoder, this->player_info);
+    rr_server_client_end_message(this, &encoder);
 }
 
 void rr_server_client_broadcast_animation_update(struct rr_server_client *this)
@@ -271,13 +291,13 @@ void rr_server_client_broadcast_animation_update(struct rr_server_client *this)
     struct rr_server *server = this->server;
     struct rr_simulation *simulation = &server->simulation;
     struct proto_bug encoder;
-    proto_bug_init(&encoder, outgoing_message);
+    if (!rr_server_client_begin_droppable_message(this, &encoder))
+        return;
     proto_bug_write_uint8(&encoder, rr_clientbound_animation_update, "header");
     for (uint32_t i = 0; i < simulation->animation_length; ++i)
         write_animation_function(simulation, &encoder, this, i);
     proto_bug_write_uint8(&encoder, 0, "continue");
-    rr_server_client_write_message(this, encoder.start,
-                                   encoder.current - encoder.start);
+    rr_server_client_end_message(this, &encoder);
 }
 
 static void delete_entity_function(EntityIdx entity, void *_captures)
@@ -286,7 +306,8 @@ static void delete_entity_function(EntityIdx entity, void *_captures)
         rr_simulation_request_entity_deletion(_captures, entity);
 }
 
-void rr_server_init(struct rr_server *this)
+void rr_server_init(struct rr_server *this, struct rr_server_host *host,
+                    uint8_t instance)
 {
     fprintf(stderr, "server size: %lu\n", sizeof(struct rr_server));
 #define XX(NAME, ID)                                                           \
@@ -298,16 +319,107 @@ void rr_server_init(struct rr_server *this)
 #ifndef RIVET_BUILD
     // RR_GLOBAL_BIOME = rr_biome_id_garden;
 #endif
-    rr_static_data_init();
+    this->host = host;
+    this->instance = instance;
+    this->message_data = malloc(MESSAGE_BUFFER_SIZE);
+    this->outgoing_message = this->message_data + LWS_PRE;
+    rr_queue_init(&this->commands, RR_COMMAND_QUEUE_CAPACITY);
+    rr_queue_init(&this->api_messages, RR_API_QUEUE_CAPACITY);
+    pthread_mutex_init(&this->api_overflow_mutex, NULL);
     rr_simulation_init(&this->simulation);
     this->simulation.server = this;
+    // RR_SIMULATION_WORKERS=0 (the default) keeps the tick fully serial
+    char const *worker_count = getenv("RR_SIMULATION_WORKERS");
+    rr_scheduler_init(&this->scheduler, &this->simulation,
+                      worker_count ? atoi(worker_count) : 0);
+    this->simulation.scheduler = &this->scheduler;
+    // RR_AI_LOD_INTERVAL=1 RR_AI_LOD_FREEZE=0 runs all mob ai every tick
+    char const *ai_lod_interval = getenv("RR_AI_LOD_INTERVAL");
+    char const *ai_lod_freeze = getenv("RR_AI_LOD_FREEZE");
+    if (ai_lod_interval)
+        this->simulation.ai_lod_interval = atoi(ai_lod_interval);
+    if (ai_lod_freeze)
+        this->simulation.ai_lod_freeze = atoi(ai_lod_freeze);
+    this->scheduler.system_timer = rr_profiler_system_timer;
+    rr_entity_cache_init(&this->entity_cache, RR_ENTITY_CACHE_SIZE);
     for (uint32_t i = 0; i < RR_SQUAD_COUNT; ++i)
         rr_squad_init(&this->squads[i], this, i);
 }
 
+static void session_free(struct rr_server_session *this)
+{
+    rr_frame_pool_free(&this->frames);
+    free(this);
+}
+
 void rr_server_free(struct rr_server *this)
 {
-    lws_context_destroy(this->server);
+    rr_scheduler_free(&this->scheduler);
+    rr_entity_cache_free(&this->entity_cache);
+    for (uint32_t i = 0; i < RR_SQUAD_COUNT; ++i)
+        free(this->squad_dumps[i].data);
+    rr_maze_influence_free(&this->simulation.maze_influence);
+    rr_contact_pool_free(&this->simulation.contacts);
+    for (uint32_t i = 0; i < rr_biome_id_max; ++i)
+        free(this->simulation.mazes[i].maze);
+    struct rr_server_command *command;
+    while ((command = rr_queue_pop(&this->commands)) != NULL)
+    {
+        if (command->type == rr_server_command_close)
+            session_free(command->session);
+        free(command);
+    }
+    rr_queue_free(&this->commands);
+    struct rr_server_api_message *message;
+    while ((message = rr_queue_pop(&this->api_messages)) != NULL)
+    {
+        free(message->packet);
+        free(message);
+    }
+    rr_queue_free(&this->api_messages);
+    while ((message = this->api_overflow_head) != NULL)
+    {
+        this->api_overflow_head = message->next;
+        free(message->packet);
+        free(message);
+    }
+    pthread_mutex_destroy(&this->api_overflow_mutex);
+    free(this->message_data);
+}
+
+void rr_server_write_to_api(struct rr_server *this, uint8_t *data,
+                            uint64_t size)
+{
+    if (this->host == NULL)
+        return;
+    uint8_t envelope = this->instance == 0 ? 0 : 2;
+    struct rr_server_api_message *message = malloc(sizeof *message);
+    uint8_t *packet = malloc(LWS_PRE + envelope + size);
+    if (envelope)
+    {
+        packet[LWS_PRE] = RR_API_INSTANCE;
+        packet[LWS_PRE + 1] = this->instance;
+    }
+    memcpy(packet + LWS_PRE + envelope, data, size);
+    message->len = envelope + size;
+    message->packet = packet;
+    message->next = NULL;
+    // account saves must never be dropped, so spill instead of failing. only
+    // this thread sets api_overflowing, the network thread clears it
+    if (!atomic_load_explicit(&this->api_overflowing, memory_order_acquire) &&
+        rr_queue_push(&this->api_messages, message))
+        return;
+    pthread_mutex_lock(&this->api_overflow_mutex);
+    if (this->api_overflow_head == NULL)
+    {
+        this->api_overflow_head = message;
+        fprintf(stderr, "<rr_server::api_queue_full::%u>\n", this->instance);
+    }
+    else
+        this->api_overflow_tail->next = message;
+    this->api_overflow_tail = message;
+    atomic_store_explicit(&this->api_overflowing, 1, memory_order_release);
+    pthread_mutex_unlock(&this->api_overflow_mutex);
 }
 
 static void rr_simulation_tick_entity_resetter_function(EntityIdx entity,
@@ -319,6 +431,9 @@ static void rr_simulation_tick_entity_resetter_function(EntityIdx entity,
         rr_simulation_get_##COMPONENT(this, entity)->protocol_state = 0;
     RR_FOR_EACH_COMPONENT
 #undef XX
+    if (rr_simulation_has_physical(this, entity))
+        rr_component_physical_mark_sent(
+            rr_simulation_get_physical(this, entity));
 }
 
 static void rr_simulation_dev_cheat_kill_mob(EntityIdx entity, void *_captures)
@@ -348,29 +463,112 @@ static void rr_simulation_dev_cheat_set_max_health(EntityIdx entity, void *_capt
         rr_component_health_set_health(health, health->max_health);
 }
 
-static int handle_lws_event(struct rr_server *this, struct lws *ws,
-                            enum lws_callback_reasons reason, uint8_t *packet,
-                            size_t size)
+static void handle_api_message(struct rr_server *this, uint8_t *packet)
 {
-    switch (reason)
+    struct rr_binary_encoder decoder;
+    rr_binary_encoder_init(&decoder, packet);
+    uint8_t opcode = rr_binary_encoder_read_uint8(&decoder);
+    switch (opcode)
     {
-    case LWS_CALLBACK_ESTABLISHED:
+    case 0:
+    {
+        rr_binary_encoder_read_nt_string(&decoder, this->server_alias);
+        break;
+    }
+    case 1:
     {
-        if (!this->api_ws_ready)
+        // printf("%lu\n", size);
+        uint8_t pos = rr_binary_encoder_read_uint8(&decoder);
+        if (pos >= 64)
         {
-            lws_close_reason(ws, LWS_CLOSE_STATUS_GOINGAWAY,
-                             (uint8_t *)"api ws not ready",
-                             sizeof "api ws not ready" - 1);
-            return -1;
+            printf("<rr_api::malformed_req::%d>\n", pos);
+            break;
         }
-        char xff[100];
-        if (lws_hdr_copy(ws, xff, 100, WSI_TOKEN_X_FORWARDED_FOR) <= 0)
+        struct rr_server_client *client = &this->clients[pos];
+        if (!client->in_use || client->disconnected)
         {
-            lws_close_reason(ws, LWS_CLOSE_STATUS_GOINGAWAY,
-                             (uint8_t *)"could not get xff header",
-                             sizeof "could not get xff header" - 1);
-            return -1;
+            printf("<rr_api::client_nonexistent::%d>\n", pos);
+            break;
         }
+        if (!rr_server_client_read_from_api(client, &decoder))
+        {
+            printf("<rr_server::account_failed_read::%s>\n",
+                   client->rivet_account.uuid);
+            client->pending_kick = 1;
+            break;
+        }
+        client->verified = 1;
+        struct proto_bug encoder;
+        rr_server_client_begin_message(client, &encoder);
+        proto_bug_write_uint8(&encoder, rr_clientbound_squad_leave,
+                              "header");
+        rr_server_client_end_message(client, &encoder);
+        rr_server_client_write_account(client);
+        printf("<rr_server::account_read::%s>\n",
+               client->rivet_account.uuid);
+        break;
+    }
+    case 2:
+    {
+        uint8_t pos = rr_binary_encoder_read_uint8(&decoder);
+        if (pos >= 64)
+        {
+            printf("<rr_api::malformed_req::%d>\n", pos);
+            break;
+        }
+        struct rr_server_client *client = &this->clients[pos];
+        if (!client->in_use || client->disconnected)
+        {
+            printf("<rr_api::client_nonexistent::%d>\n", pos);
+            break;
+        }
+        char uuid[sizeof client->rivet_account.uuid];
+        rr_binary_encoder_read_nt_string(&decoder, uuid);
+        if (strcmp(uuid, client->rivet_account.uuid) == 0)
+        {
+            printf("<rr_server::client_kick::%s>\n", uuid);
+            client->pending_kick = 1;
+        }
+        break;
+    }
+    case 3:
+    {
+        uint8_t pos = rr_binary_encoder_read_uint8(&decoder);
+        if (pos >= 64)
+        {
+            printf("<rr_api::malformed_req::%d>\n", pos);
+            break;
+        }
+        struct rr_server_client *client = &this->clients[pos];
+        if (!client->in_use || !client->verified)
+            break;
+        char uuid[sizeof client->rivet_account.uuid];
+        rr_binary_encoder_read_nt_string(&decoder, uuid);
+        if (strcmp(uuid, client->rivet_account.uuid) == 0)
+        {
+            // the api's copy of the account no longer matches, replace it
+            printf("<rr_server::account_drift::%s>\n", uuid);
+            client->account_resync = 1;
+            rr_server_client_account_changed(client);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void handle_command(struct rr_server *this,
+                           struct rr_server_command *command)
+{
+    struct rr_server_session *session = command->session;
+    uint8_t *packet = command->data;
+    uint32_t size = command->size;
+    switch (command->type)
+    {
+    case rr_server_command_connect:
+    {
+        char *xff = (char *)command->data;
         puts(xff);
         for (uint64_t i = 0; i < RR_MAX_CLIENT_COUNT; i++)
             if (!rr_bitset_get_bit(this->clients_in_use, i))
@@ -378,13 +576,14 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                 rr_bitset_set(this->clients_in_use, i);
                 rr_server_client_init(this->clients + i);
                 this->clients[i].server = this;
-                this->clients[i].socket_handle = ws;
+                this->clients[i].session = session;
                 this->clients[i].in_use = 1;
                 strcpy(this->clients[i].ip_address, xff);
-                lws_set_opaque_user_data(ws, this->clients + i);
+                session->client = this->clients + i;
                 // send encryption key
                 struct proto_bug encryption_key_encoder;
-                proto_bug_init(&encryption_key_encoder, outgoing_message);
+                rr_server_client_begin_message(this->clients + i,
+                                               &encryption_key_encoder);
                 proto_bug_write_uint64(&encryption_key_encoder,
                                        this->clients[i].requested_verification,
                                        "verification");
@@ -398,29 +597,32 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                     &encryption_key_encoder,
                     this->clients[i].serverbound_encryption_key,
                     "s encryption key");
-                rr_encrypt(outgoing_message, 1024, 21094093777837637ull);
-                rr_encrypt(outgoing_message, 8, 1);
-                rr_encrypt(outgoing_message, 1024, 59731158950470853ull);
-                rr_encrypt(outgoing_message, 1024, 64709235936361169ull);
-                rr_encrypt(outgoing_message, 1024, 59013169977270713ull);
-                rr_server_client_write_message(this->clients + i,
-                                               outgoing_message, 1024);
-                return 0;
+                uint8_t *key = encryption_key_encoder.start;
+                rr_encrypt(key, 1024, 21094093777837637ull);
+                rr_encrypt(key, 8, 1);
+                rr_encrypt(key, 1024, 59731158950470853ull);
+                rr_encrypt(key, 1024, 64709235936361169ull);
+                rr_encrypt(key, 1024, 59013169977270713ull);
+                encryption_key_encoder.current = key + 1024;
+                rr_server_client_end_message(this->clients + i,
+                                             &encryption_key_encoder);
+                return;
             }
-
-        lws_close_reason(ws, LWS_CLOSE_STATUS_GOINGAWAY,
-                         (uint8_t *)"too many active clients",
-                         sizeof "to many active clients" - 1);
-        return -1;
+        atomic_store(&session->close_reason, "too many active clients");
+        return;
     }
-    case LWS_CALLBACK_CLOSED:
+    case rr_server_command_close:
     {
-        struct rr_server_client *client = lws_get_opaque_user_data(ws);
+        struct rr_server_client *client = session->client;
         if (client != NULL)
         {
             uint64_t i = (client - this->clients);
+            // the api saves the account once it hears the client is gone
+            if (client->verified)
+                rr_server_client_flush_account(client, 1);
             client->disconnected = 1;
-            client->socket_handle = NULL;
+            rr_client_squad_changed(this, client);
+            client->session = NULL;
             client->player_accel_x = 0;
             client->player_accel_y = 0;
             if (client->player_info != NULL)
@@ -432,7 +634,7 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                 rr_server_client_free(client);
             }
             if (client->received_first_packet == 0)
-                return 0;
+                return;
 #ifdef RIVET_BUILD
             char *token = malloc(500);
             strncpy(token, client->rivet_account.token, 500);
@@ -441,59 +643,23 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
             pthread_detach(thread);
 #endif
             struct rr_binary_encoder encoder;
-            rr_binary_encoder_init(&encoder, outgoing_message);
+            rr_binary_encoder_init(&encoder, this->outgoing_message);
             rr_binary_encoder_write_uint8(&encoder, 1);
             rr_binary_encoder_write_nt_string(
                 &encoder, this->clients[i].rivet_account.uuid);
             rr_binary_encoder_write_uint8(&encoder, i);
-            lws_write(this->api_client, encoder.start,
-                      encoder.at - encoder.start, LWS_WRITE_BINARY);
-            return 0;
+            rr_server_write_to_api(this, encoder.start,
+                                   encoder.at - encoder.start);
+            return;
         }
         puts("client joined but instakicked");
         break;
     }
-    case LWS_CALLBACK_SERVER_WRITEABLE:
+    case rr_server_command_receive:
     {
-        struct rr_server_client *client = lws_get_opaque_user_data(ws);
-        if (client == NULL)
-            return -1;
-        if (client->pending_kick)
-        {
-            struct rr_server_client_message *message = client->message_root;
-            while (message != NULL)
-            {
-                struct rr_server_client_message *tmp = message->next;
-                free(message->packet);
-                free(message);
-                message = tmp;
-            }
-            client->message_at = client->message_root = NULL;
-            client->message_length = 0;
-            lws_close_reason(ws, LWS_CLOSE_STATUS_GOINGAWAY,
-                             (uint8_t *)"kicked for unspecified reason",
-                             sizeof "kicked for unspecified reason" - 1);
-            return -1;
-        }
-        struct rr_server_client_message *message = client->message_root;
-        while (message != NULL)
-        {
-            lws_write(ws, message->packet + LWS_PRE, message->len,
-                      LWS_WRITE_BINARY);
-            struct rr_server_client_message *tmp = message->next;
-            free(message->packet);
-            free(message);
-            message = tmp;
-        }
-        client->message_at = client->message_root = NULL;
-        client->message_length = 0;
-        break;
-    }
-    case LWS_CALLBACK_RECEIVE:
-    {
-        struct rr_server_client *client = lws_get_opaque_user_data(ws);
-        if (client == NULL)
-            return -1;
+        struct rr_server_client *client = session->client;
+        if (client == NULL || client->session != session)
+            return;
         uint64_t i = (client - this->clients);
         rr_decrypt(packet, size, client->serverbound_encryption_key);
         client->serverbound_encryption_key =
@@ -513,11 +679,9 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                 printf("%lu %lu\n", client->requested_verification,
                        received_verification);
                 fputs("invalid verification\n", stderr);
-                lws_close_reason(ws, LWS_CLOSE_STATUS_GOINGAWAY,
-                                 (uint8_t *)"invalid v",
-                                 sizeof "invalid v" - 1);
+                atomic_store(&session->close_reason, "invalid v");
                 client->pending_kick = 1;
-                return -1;
+                return;
             }
 
             memset(&client->rivet_account, 0, sizeof(struct rr_rivet_account));
@@ -616,7 +780,10 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                            RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT));
                 }
                 if (client->in_squad)
+                {
                     rr_squad_get_client_slot(this, client)->client = client;
+                    rr_client_squad_changed(this, client);
+                }
                 this->clients[j].player_info = NULL;
                 this->clients[j].in_squad = 0;
                 if (this->clients[j].disconnected)
@@ -642,14 +809,14 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
             printf("<rr_server::socket_verified::%s>\n",
                    client->rivet_account.uuid);
             struct rr_binary_encoder encoder;
-            rr_binary_encoder_init(&encoder, outgoing_message);
+            rr_binary_encoder_init(&encoder, this->outgoing_message);
             rr_binary_encoder_write_uint8(&encoder, 0);
             rr_binary_encoder_write_nt_string(&encoder,
                                               client->rivet_account.uuid);
             rr_binary_encoder_write_uint8(&encoder, i);
-            lws_write(this->api_client, encoder.start,
-                      encoder.at - encoder.start, LWS_WRITE_BINARY);
-            return 0;
+            rr_server_write_to_api(this, encoder.start,
+                                   encoder.at - encoder.start);
+            return;
         }
         if (!client->verified)
             break;
@@ -659,11 +826,9 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
         {
             printf("%u %u\n", client->quick_verification, qv);
             fputs("invalid quick verification\n", stderr);
-            lws_close_reason(ws, LWS_CLOSE_STATUS_GOINGAWAY,
-                             (uint8_t *)"invalid qv",
-                             sizeof "invalid qv" - 1);
+            atomic_store(&session->close_reason, "invalid qv");
             client->pending_kick = 1;
-            return -1;
+            return;
         }
         uint8_t header = proto_bug_read_uint8(&encoder, "header");
         switch (header)
@@ -757,11 +922,10 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                 {
                     rr_client_leave_squad(this, client);
                     struct proto_bug encoder;
-                    proto_bug_init(&encoder, outgoing_message);
+                    rr_server_client_begin_message(client, &encoder);
                     proto_bug_write_uint8(&encoder, rr_clientbound_squad_leave,
                                           "header");
-                    rr_server_client_write_message(
-                        client, encoder.start, encoder.current - encoder.start);
+                    rr_server_client_end_message(client, &encoder);
                 }
                 break;
             }
@@ -786,36 +950,33 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
             if (squad == RR_ERROR_CODE_INVALID_SQUAD)
             {
                 struct proto_bug failure;
-                proto_bug_init(&failure, outgoing_message);
+                rr_server_client_begin_message(client, &failure);
                 proto_bug_write_uint8(&failure, rr_clientbound_squad_fail,
                                       "header");
                 proto_bug_write_uint8(&failure, 0, "fail type");
-                rr_server_client_write_message(client, failure.start,
-                                               failure.current - failure.start);
+                rr_server_client_end_message(client, &failure);
                 client->in_squad = 0;
                 break;
             }
             if (squad == RR_ERROR_CODE_FULL_SQUAD)
             {
                 struct proto_bug failure;
-                proto_bug_init(&failure, outgoing_message);
+                rr_server_client_begin_message(client, &failure);
                 proto_bug_write_uint8(&failure, rr_clientbound_squad_fail,
                                       "header");
                 proto_bug_write_uint8(&failure, 1, "fail type");
-                rr_server_client_write_message(client, failure.start,
-                                               failure.current - failure.start);
+                rr_server_client_end_message(client, &failure);
                 client->in_squad = 0;
                 break;
             }
             if (squad == RR_ERROR_CODE_KICKED_FROM_SQUAD)
             {
                 struct proto_bug failure;
-                proto_bug_init(&failure, outgoing_message);
+                rr_server_client_begin_message(client, &failure);
                 proto_bug_write_uint8(&failure, rr_clientbound_squad_fail,
                                       "header");
                 proto_bug_write_uint8(&failure, 2, "fail type");
-                rr_server_client_write_message(client, failure.start,
-                                               failure.current - failure.start);
+                rr_server_client_end_message(client, &failure);
                 client->in_squad = 0;
                 break;
             }
@@ -833,12 +994,11 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                 if (squad == RR_ERROR_CODE_INVALID_SQUAD)
                 {
                     struct proto_bug failure;
-                    proto_bug_init(&failure, outgoing_message);
+                    rr_server_client_begin_message(client, &failure);
                     proto_bug_write_uint8(&failure, rr_clientbound_squad_fail,
                                           "header");
                     proto_bug_write_uint8(&failure, 0, "fail type");
-                    rr_server_client_write_message(
-                        client, failure.start, failure.current - failure.start);
+                    rr_server_client_end_message(client, &failure);
                     client->in_squad = 0;
                     client->pending_quick_join = 0;
                     break;
@@ -858,6 +1018,7 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                         client->player_info = NULL;
                     }
                     rr_squad_get_client_slot(this, client)->playing = 1;
+                    rr_client_squad_changed(this, client);
                     rr_server_client_create_player_info(this, client);
                     rr_server_client_create_flower(client);
                 }
@@ -883,6 +1044,7 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                             printf("deleting player_info at %s:%d\n", __FILE__, __LINE__);
                             client->player_info = NULL;
                             rr_squad_get_client_slot(this, client)->playing = 0;
+                            rr_client_squad_changed(this, client);
                         }
                     }
                 }
@@ -895,6 +1057,7 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                 break;
             struct rr_squad_member *member =
                 rr_squad_get_client_slot(this, client);
+            rr_client_squad_changed(this, client);
             char nickname[16];
             proto_bug_read_string(&encoder, nickname, 16, "nickname");
             strcpy(member->nickname, rr_trim_string(nickname));
@@ -975,6 +1138,7 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
             if (client->in_squad)
             {
                 struct rr_squad *squad = rr_client_get_squad(this, client);
+                squad->dirty = 1;
                 if (client->dev)
                 {
                     squad->private ^= 1;
@@ -1014,7 +1178,10 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                 struct rr_squad *squad = rr_client_get_squad(this, client);
                 if (squad->private &&
                     (client->dev || client->squad_pos == squad->owner))
+                {
                     squad->expose_code ^= 1;
+                    squad->dirty = 1;
+                }
             }
             break;
         }
@@ -1053,6 +1220,7 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                         break;
                     client->ticks_to_next_kick_vote = 60 * 25;
                     rr_squad_get_client_slot(this, client)->kick_vote_pos = pos;
+                    squad->dirty = 1;
                     if (++kick_member->kick_vote_count <
                         RR_SQUAD_MEMBER_COUNT - 1)
                         break;
@@ -1071,12 +1239,11 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
             if (to_kick->disconnected)
                 break;
             struct proto_bug failure;
-            proto_bug_init(&failure, outgoing_message);
+            rr_server_client_begin_message(to_kick, &failure);
             proto_bug_write_uint8(&failure, rr_clientbound_squad_fail,
                                   "header");
             proto_bug_write_uint8(&failure, 2, "fail type");
-            rr_server_client_write_message(to_kick, failure.start,
-                                           failure.current - failure.start);
+            rr_server_client_end_message(to_kick, &failure);
             break;
         }
         case rr_serverbound_squad_transfer_ownership:
@@ -1103,6 +1270,7 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
                     break;
             }
             squad->owner = pos;
+            squad->dirty = 1;
             break;
         }
         case rr_serverbound_petals_craft:
@@ -1293,114 +1461,87 @@ static int handle_lws_event(struct rr_server *this, struct lws *ws,
         default:
             break;
         }
-        return 0;
+        return;
     }
-    default:
-        return 0;
+    case rr_server_command_api:
+        handle_api_message(this, packet);
+        return;
     }
+}
 
-    return 0;
+static struct rr_server_command *command_new(uint8_t type,
+                                             struct rr_server_session *session,
+                                             void *data, uint32_t size)
+{
+    struct rr_server_command *command = malloc(sizeof *command + size);
+    command->session = session;
+    command->time = rr_profiler_now();
+    command->size = size;
+    command->type = type;
+    memcpy(command->data, data, size);
+    return command;
 }
 
 static int api_lws_callback(struct lws *ws, enum lws_callback_reasons reason,
                             void *user, void *packet, size_t size)
 {
-    struct rr_server *this =
-        (struct rr_server *)lws_context_user(lws_get_context(ws));
+    struct rr_server_host *host =
+        (struct rr_server_host *)lws_context_user(lws_get_context(ws));
     switch (reason)
     {
     case LWS_CALLBACK_CLIENT_ESTABLISHED:
     {
         puts("connected to api server");
-        this->api_ws_ready = 1;
+        atomic_store(&host->api_ws_ready, 1);
         char *lobby_id =
 #ifdef RIVET_BUILD
             getenv("RIVET_LOBBY_ID");
 #else
             "localhost";
 #endif
-        struct rr_binary_encoder encoder;
-        rr_binary_encoder_init(&encoder, outgoing_message);
-        rr_binary_encoder_write_uint8(&encoder, 101);
-        rr_binary_encoder_write_nt_string(&encoder, lobby_id);
-        lws_write(this->api_client, encoder.start, encoder.at - encoder.start,
-                  LWS_WRITE_BINARY);
+        // instances don't tick before this so their queues are still empty
+        for (uint32_t i = 0; i < host->instance_count; ++i)
+        {
+            uint8_t message[LWS_PRE + 256];
+            struct rr_binary_encoder encoder;
+            rr_binary_encoder_init(&encoder, message + LWS_PRE);
+            if (i != 0)
+            {
+                rr_binary_encoder_write_uint8(&encoder, RR_API_INSTANCE);
+                rr_binary_encoder_write_uint8(&encoder, i);
+            }
+            rr_binary_encoder_write_uint8(&encoder, 101);
+            rr_binary_encoder_write_nt_string(&encoder, lobby_id);
+            lws_write(ws, encoder.start, encoder.at - encoder.start,
+                      LWS_WRITE_BINARY);
+        }
     }
     break;
     case LWS_CALLBACK_CLIENT_RECEIVE:
     {
-        // parse incoming client data
+        // only routed here, the instance parses the rest
         struct rr_binary_encoder decoder;
         rr_binary_encoder_init(&decoder, packet);
-        if (rr_binary_encoder_read_uint8(&decoder) != RR_API_SUCCESS)
-            break;
-        switch (rr_binary_encoder_read_uint8(&decoder))
-        {
-        case 0:
-        {
-            rr_binary_encoder_read_nt_string(&decoder, this->server_alias);
+        if (size < 2 || rr_binary_encoder_read_uint8(&decoder) != RR_API_SUCCESS)
             break;
-        }
-        case 1:
+        struct rr_server *this = host->instances[0];
+        if (*decoder.at == RR_API_INSTANCE)
         {
-            // printf("%lu\n", size);
-            uint8_t pos = rr_binary_encoder_read_uint8(&decoder);
-            if (pos >= 64)
-            {
-                printf("<rr_api::malformed_req::%d>\n", pos);
-                break;
-            }
-            struct rr_server_client *client = &this->clients[pos];
-            if (!client->in_use || client->disconnected)
+            uint8_t instance = decoder.at[1];
+            if (size < 4 || instance >= host->instance_count)
             {
-                printf("<rr_api::client_nonexistent::%d>\n", pos);
+                printf("<rr_api::instance_nonexistent::%d>\n", instance);
                 break;
             }
-            if (!rr_server_client_read_from_api(client, &decoder))
-            {
-                printf("<rr_server::account_failed_read::%s>\n",
-                       client->rivet_account.uuid);
-                client->pending_kick = 1;
-                break;
-            }
-            client->verified = 1;
-            struct proto_bug encoder;
-            proto_bug_init(&encoder, outgoing_message);
-            proto_bug_write_uint8(&encoder, rr_clientbound_squad_leave,
-                                  "header");
-            rr_server_client_write_message(client, encoder.start,
-                                           encoder.current - encoder.start);
-            rr_server_client_write_account(client);
-            printf("<rr_server::account_read::%s>\n",
-                   client->rivet_account.uuid);
-            break;
-        }
-        case 2:
-        {
-            uint8_t pos = rr_binary_encoder_read_uint8(&decoder);
-            if (pos >= 64)
-            {
-                printf("<rr_api::malformed_req::%d>\n", pos);
-                break;
-            }
-            struct rr_server_client *client = &this->clients[pos];
-            if (!client->in_use || client->disconnected)
-            {
-                printf("<rr_api::client_nonexistent::%d>\n", pos);
-                break;
-            }
-            char uuid[sizeof client->rivet_account.uuid];
-            rr_binary_encoder_read_nt_string(&decoder, uuid);
-            if (strcmp(uuid, client->rivet_account.uuid) == 0)
-            {
-                printf("<rr_server::client_kick::%s>\n", uuid);
-                client->pending_kick = 1;
-            }
-            break;
-        }
-        default:
-            break;
+            this = host->instances[instance];
+            decoder.at += 2;
         }
+        uint32_t length = size - (decoder.at - (uint8_t *)packet);
+        struct rr_server_command *command =
+            command_new(rr_server_command_api, NULL, decoder.at, length);
+        // the account of a joining player must not get lost
+        while (!rr_queue_push(&this->commands, command))
+            sched_yield();
         break;
     }
     case LWS_CALLBACK_CLIENT_CLOSED:
@@ -1418,47 +1559,370 @@ static int api_lws_callback(struct lws *ws, enum lws_callback_reasons reason,
     return 0;
 }
 
+// clients pick their instance with the request path, anything that isn't a
+// valid instance goes to the first one
+static uint8_t instance_from_uri(struct rr_server_host *host, struct lws *ws)
+{
+    char uri[32];
+    if (lws_hdr_copy(ws, uri, sizeof uri, WSI_TOKEN_GET_URI) <= 0)
+        return 0;
+    uint32_t instance = strtoul(uri + (uri[0] == '/'), NULL, 10);
+    if (instance >= host->instance_count)
+        return 0;
+    return instance;
+}
+
+static uint8_t push_command(struct rr_server_host *host, uint8_t type,
+                            struct rr_server_session *session, void *data,
+                            uint32_t size)
+{
+    struct rr_server_command *command = command_new(type, session, data, size);
+    if (rr_queue_push(&host->instances[session->instance]->commands, command))
+        return 1;
+    free(command);
+    return 0;
+}
+
+// runs on the network thread after an instance called lws_cancel_service
+static void flush_network(struct rr_server_host *this)
+{
+    for (struct rr_server_session *session = this->sessions; session != NULL;
+         session = session->next)
+        if (rr_frame_pool_size(&session->frames) != 0 ||
+            atomic_load(&session->close_reason) != NULL)
+            lws_callback_on_writable(session->ws);
+    for (uint32_t i = 0; i < this->instance_count; ++i)
+    {
+        struct rr_server *instance = this->instances[i];
+        struct rr_server_api_message *message;
+        while ((message = rr_queue_pop(&instance->api_messages)) != NULL)
+        {
+            lws_write(this->api_client, message->packet + LWS_PRE,
+                      message->len, LWS_WRITE_BINARY);
+            free(message->packet);
+            free(message);
+        }
+        if (!atomic_load_explicit(&instance->api_overflowing,
+                                  memory_order_acquire))
+            continue;
+        // the instance can't push while overflowing is set, so whatever is
+        // left in the queue was queued before the overflow list started
+        pthread_mutex_lock(&instance->api_overflow_mutex);
+        while ((message = rr_queue_pop(&instance->api_messages)) != NULL)
+        {
+            lws_write(this->api_client, message->packet + LWS_PRE,
+                      message->len, LWS_WRITE_BINARY);
+            free(message->packet);
+            free(message);
+        }
+        message = instance->api_overflow_head;
+        instance->api_overflow_head = instance->api_overflow_tail = NULL;
+        atomic_store_explicit(&instance->api_overflowing, 0,
+                              memory_order_release);
+        pthread_mutex_unlock(&instance->api_overflow_mutex);
+        while (message != NULL)
+        {
+            struct rr_server_api_message *next = message->next;
+            lws_write(this->api_client, message->packet + LWS_PRE,
+                      message->len, LWS_WRITE_BINARY);
+            free(message->packet);
+            free(message);
+            message = next;
+        }
+    }
+}
+
 static int lws_callback(struct lws *ws, enum lws_callback_reasons reason,
                         void *user, void *packet, size_t size)
 {
+    struct rr_server_host *host =
+        (struct rr_server_host *)lws_context_user(lws_get_context(ws));
+    struct rr_server_session *session = lws_get_opaque_user_data(ws);
     switch (reason)
     {
+    case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+        flush_network(host);
+        return 0;
     case LWS_CALLBACK_ESTABLISHED:
+    {
+        if (!atomic_load(&host->api_ws_ready))
+        {
+            lws_close_reason(ws, LWS_CLOSE_STATUS_GOINGAWAY,
+                             (uint8_t *)"api ws not ready",
+                             sizeof "api ws not ready" - 1);
+            return -1;
+        }
+        char xff[100];
+        if (lws_hdr_copy(ws, xff, 100, WSI_TOKEN_X_FORWARDED_FOR) <= 0)
+        {
+            lws_close_reason(ws, LWS_CLOSE_STATUS_GOINGAWAY,
+                             (uint8_t *)"could not get xff header",
+                             sizeof "could not get xff header" - 1);
+            return -1;
+        }
+        session = calloc(1, sizeof *session);
+        session->ws = ws;
+        session->instance = instance_from_uri(host, ws);
+        rr_frame_pool_init(&session->frames, RR_SESSION_FRAME_COUNT,
+                           MESSAGE_BUFFER_SIZE);
+        if (!push_command(host, rr_server_command_connect, session, xff,
+                          strlen(xff) + 1))
+        {
+            session_free(session);
+            lws_close_reason(ws, LWS_CLOSE_STATUS_GOINGAWAY,
+                             (uint8_t *)"server busy",
+                             sizeof "server busy" - 1);
+            return -1;
+        }
+        lws_set_opaque_user_data(ws, session);
+        session->next = host->sessions;
+        host->sessions = session;
+        return 0;
+    }
+    case LWS_CALLBACK_CLOSED:
+    {
+        if (session == NULL)
+            return 0;
+        lws_set_opaque_user_data(ws, NULL);
+        struct rr_server_session **at = &host->sessions;
+        while (*at != session)
+            at = &(*at)->next;
+        *at = session->next;
+        // the instance owns the session from here on
+        while (!push_command(host, rr_server_command_close, session, NULL, 0))
+            sched_yield();
+        return 0;
+    }
     case LWS_CALLBACK_SERVER_WRITEABLE:
+    {
+        if (session == NULL)
+            return -1;
+        char const *close_reason = atomic_load(&session->close_reason);
+        if (close_reason != NULL)
+        {
+            lws_close_reason(ws, LWS_CLOSE_STATUS_GOINGAWAY,
+                             (uint8_t *)close_reason, strlen(close_reason));
+            return -1;
+        }
+        // lws buffers whatever the kernel doesn't take, so stop once the
+        // socket is choked and leave the rest in the pool. the instance sees
+        // it filling up and backs off
+        uint8_t *frame;
+        uint32_t frame_size;
+        while ((frame = rr_frame_pool_peek(&session->frames, &frame_size)) !=
+               NULL)
+        {
+            if (lws_send_pipe_choked(ws))
+            {
+                lws_callback_on_writable(ws);
+                break;
+            }
+            lws_write(ws, frame, frame_size, LWS_WRITE_BINARY);
+            rr_frame_pool_release(&session->frames);
+        }
+        return 0;
+    }
     case LWS_CALLBACK_RECEIVE:
-    case LWS_CALLBACK_CLOSED:
-        break;
+    {
+        if (session == NULL)
+            return -1;
+        // a dropped packet would break the serverbound key chain anyway
+        if (!push_command(host, rr_server_command_receive, session, packet,
+                          size))
+        {
+            lws_close_reason(ws, LWS_CLOSE_STATUS_GOINGAWAY,
+                             (uint8_t *)"server busy",
+                             sizeof "server busy" - 1);
+            return -1;
+        }
+        return 0;
+    }
     default:
         return 0;
     }
-    // assert(pthread_mutex_lock(&mutex) == 0);
-
-    struct rr_server *this =
-        (struct rr_server *)lws_context_user(lws_get_context(ws));
-    int close = handle_lws_event(this, ws, reason, packet, size);
-    if (close)
-        return close;
-    // assert(pthread_mutex_unlock(&mutex) == 0);
-    return 0;
 }
 
-void *thread_func(void *arg)
+static void *network_thread(void *_this)
 {
-    struct rr_server *this = (struct rr_server *)arg;
-    while (1)
-    {
+    struct rr_server_host *this = _this;
+    while (!atomic_load(&this->stopping))
         lws_service(this->server, 0);
-    }
-    return 0;
+    return NULL;
 }
 
 static void lws_log(int level, char const *log) { printf("%d %s", level, log); }
 
-static void server_tick(struct rr_server *this)
+static void encode_squad_dump(struct rr_server *this, struct rr_squad *squad,
+                              struct proto_bug *encoder)
+{
+    for (uint32_t i = 0; i < RR_SQUAD_MEMBER_COUNT; ++i)
+    {
+        if (squad->members[i].in_use == 0)
+        {
+            proto_bug_write_uint8(encoder, 0, "bitbit");
+            continue;
+        }
+        struct rr_squad_member *member = &squad->members[i];
+        proto_bug_write_uint8(encoder, 1, "bitbit");
+        proto_bug_write_uint8(encoder, member->playing, "ready");
+        proto_bug_write_uint8(encoder, member->client->disconnected,
+                              "disconnected");
+        proto_bug_write_uint8(encoder, member->is_dev, "is_dev");
+        proto_bug_write_uint8(encoder, member->kick_vote_count, "kick votes");
+        proto_bug_write_varuint(encoder, member->level, "level");
+        proto_bug_write_string(encoder, member->nickname, 16, "nickname");
+        for (uint8_t j = 0; j < RR_MAX_SLOT_COUNT * 2; ++j)
+        {
+            proto_bug_write_uint8(encoder, member->loadout[j].id, "id");
+            proto_bug_write_uint8(encoder, member->loadout[j].rarity, "rar");
+        }
+    }
+    proto_bug_write_uint8(encoder, squad->owner, "sqown");
+    proto_bug_write_uint8(encoder, squad->private, "private");
+    proto_bug_write_uint8(encoder, squad->expose_code, "expose_code");
+}
+
+// serial, before the clients are broadcast to. only squads that were marked
+// dirty get encoded again
+static void update_squad_dumps(struct rr_server *this)
+{
+    for (uint32_t s = 0; s < RR_SQUAD_COUNT; ++s)
+    {
+        struct rr_squad *squad = &this->squads[s];
+        struct rr_squad_dump *dump = &this->squad_dumps[s];
+        struct proto_bug encoder;
+#ifdef NDEBUG
+        if (!squad->dirty)
+            continue;
+#endif
+        proto_bug_init(&encoder, this->outgoing_message);
+        encode_squad_dump(this, squad, &encoder);
+        uint32_t size = encoder.current - encoder.start;
+        if (!squad->dirty)
+        {
+            // a mutation that forgot to mark its squad dirty
+            assert(size == dump->size &&
+                   memcmp(dump->data, encoder.start, size) == 0 &&
+                   strcmp(dump->squad_code, squad->squad_code) == 0);
+            continue;
+        }
+        squad->dirty = 0;
+        if (size != dump->size)
+            dump->data = realloc(dump->data, size);
+        memcpy(dump->data, encoder.start, size);
+        dump->size = size;
+        strcpy(dump->squad_code, squad->squad_code);
+        ++dump->revision;
+    }
+}
+
+// what only this client sees of a squad: which members it blocked and
+// whether it gets the real squad code
+static uint8_t squad_overlay(struct rr_server *server,
+                             struct rr_server_client *client, uint32_t s)
+{
+    struct rr_squad *squad = &server->squads[s];
+    uint8_t overlay = 0;
+    for (uint32_t i = 0; i < RR_SQUAD_MEMBER_COUNT; ++i)
+        if (squad->members[i].in_use &&
+            rr_bitset_get(client->blocked_clients,
+                          squad->members[i].client - server->clients))
+            overlay |= 1 << i;
+    if (client->dev || squad->expose_code ||
+        (client->in_squad && client->squad == s))
+        overlay |= 1 << RR_SQUAD_MEMBER_COUNT;
+    return overlay;
+}
+
+// only squads whose shared part or overlay changed since the last dump this
+// client got, nothing at all if none did
+static void broadcast_squad_dump(struct rr_server_client *client)
 {
-    if (!this->api_ws_ready)
+    struct rr_server *server = client->server;
+    int8_t kick_vote_pos = -3;
+    if (client->in_squad)
+    {
+        kick_vote_pos = rr_squad_get_client_slot(server, client)->kick_vote_pos;
+        if (kick_vote_pos == -1 && client->ticks_to_next_kick_vote > 0)
+            kick_vote_pos = -2;
+    }
+    uint8_t overlays[RR_SQUAD_COUNT];
+    uint8_t changed = kick_vote_pos != client->squad_dump_kick_vote_pos ||
+                      client->dev != client->squad_dump_dev;
+    for (uint32_t s = 0; s < RR_SQUAD_COUNT; ++s)
+    {
+        overlays[s] = squad_overlay(server, client, s);
+        changed |= overlays[s] != client->squad_overlays[s] ||
+                   server->squad_dumps[s].revision !=
+                       client->squad_revisions[s];
+    }
+    if (!changed)
         return;
+    struct proto_bug encoder;
+    if (!rr_server_client_begin_droppable_message(client, &encoder))
+        return;
+    proto_bug_write_uint8(&encoder, rr_clientbound_squad_dump, "header");
+    proto_bug_write_uint8(&encoder, client->dev, "is_dev");
+    proto_bug_write_uint8(&encoder, kick_vote_pos, "kick vote");
+    proto_bug_write_uint8(&encoder, RR_GLOBAL_BIOME, "biome");
+    for (uint32_t s = 0; s < RR_SQUAD_COUNT; ++s)
+    {
+        struct rr_squad_dump *dump = &server->squad_dumps[s];
+        if (overlays[s] == client->squad_overlays[s] &&
+            dump->revision == client->squad_revisions[s])
+            continue;
+        proto_bug_write_uint8(&encoder, s + 1, "squad");
+        memcpy(encoder.current, dump->data, dump->size);
+        encoder.current += dump->size;
+        proto_bug_write_uint8(&encoder,
+                              overlays[s] & ((1 << RR_SQUAD_MEMBER_COUNT) - 1),
+                              "blocked");
+        char joined_code[16];
+        if (overlays[s] & (1 << RR_SQUAD_MEMBER_COUNT))
+            sprintf(joined_code, "%s-%s", server->server_alias,
+                    dump->squad_code);
+        else
+            strcpy(joined_code, "(private)");
+        proto_bug_write_string(&encoder, joined_code, 16, "squad code");
+        client->squad_overlays[s] = overlays[s];
+        client->squad_revisions[s] = dump->revision;
+    }
+    proto_bug_write_uint8(&encoder, 0, "squad");
+    rr_server_client_end_message(client, &encoder);
+    client->squad_dump_kick_vote_pos = kick_vote_pos;
+    client->squad_dump_dev = client->dev;
+}
+
+struct broadcast_captures
+{
+    struct rr_server *server;
+    uint8_t clients[RR_MAX_CLIENT_COUNT];
+};
+
+// each client only touches its own frames, encryption key and view, the
+// simulation is only read
+static void broadcast_clients(uint32_t begin, uint32_t end, void *_captures)
+{
+    struct broadcast_captures *captures = _captures;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        struct rr_server_client *client =
+            &captures->server->clients[captures->clients[i]];
+        if (client->in_squad)
+            rr_server_client_broadcast_update(client);
+        rr_server_client_broadcast_animation_update(client);
+        broadcast_squad_dump(client);
+    }
+}
+
+static void server_tick(struct rr_server *this)
+{
+    ++this->tick;
     rr_simulation_tick(&this->simulation);
+    uint64_t broadcast_start = rr_profiler_now();
+    struct broadcast_captures captures;
+    captures.server = this;
+    uint32_t broadcast_count = 0;
     for (uint64_t i = 0; i < RR_MAX_CLIENT_COUNT; ++i)
     {
         if (rr_bitset_get(this->clients_in_use, i))
@@ -1476,6 +1940,7 @@ static void server_tick(struct rr_server *this)
                     rr_client_get_squad(this, client)
                         ->members[member->kick_vote_pos].kick_vote_count -= 1;
                     member->kick_vote_pos = -1;
+                    rr_client_squad_changed(this, client);
                 }
             }
             if (client->disconnected)
@@ -1503,20 +1968,16 @@ static void server_tick(struct rr_server *this)
                     if (client->disconnected == 0)
                     {
                         struct proto_bug failure;
-                        proto_bug_init(&failure, outgoing_message);
+                        rr_server_client_begin_message(client, &failure);
                         proto_bug_write_uint8(
                             &failure, rr_clientbound_squad_fail, "header");
                         proto_bug_write_uint8(&failure, 3, "fail type");
-                        rr_server_client_write_message(
-                            client, failure.start,
-                            failure.current - failure.start);
+                        rr_server_client_end_message(client, &failure);
                     }
                 }
             }
             else
                 client->afk_ticks = 0;
-            if (client->pending_kick)
-                lws_callback_on_writable(client->socket_handle);
             if (!client->verified)
                 continue;
             if (client->player_info != NULL)
@@ -1541,130 +2002,255 @@ static void server_tick(struct rr_server *this)
                         uint8_t id = client->player_info->drops_this_tick[i].id;
                         uint8_t rarity =
                             client->player_info->drops_this_tick[i].rarity;
-                        ++client->inventory[id][rarity];
+                        rr_server_client_set_inventory(
+                            client, id, rarity,
+                            client->inventory[id][rarity] + 1);
                     }
-                    rr_server_client_write_to_api(client);
-                    rr_server_client_write_account(client);
                     client->player_info->drops_this_tick_size = 0;
                 }
             }
-            if (client->in_squad)
-                rr_server_client_broadcast_update(client);
-            rr_server_client_broadcast_animation_update(client);
-            // if (!client->dev)
-            //     continue;
-            struct proto_bug encoder;
-            proto_bug_init(&encoder, outgoing_message);
-            proto_bug_write_uint8(&encoder, rr_clientbound_squad_dump,
-                                  "header");
-            proto_bug_write_uint8(&encoder, client->dev, "is_dev");
-            int8_t kick_vote_pos = -3;
-            if (client->in_squad)
-            {
-                kick_vote_pos =
-                    rr_squad_get_client_slot(this, client)->kick_vote_pos;
-                if (kick_vote_pos == -1 && client->ticks_to_next_kick_vote > 0)
-                    kick_vote_pos = -2;
-            }
-            proto_bug_write_uint8(&encoder, kick_vote_pos, "kick vote");
-            for (uint32_t s = 0; s < RR_SQUAD_COUNT; ++s)
-            {
-                struct rr_squad *squad = &this->squads[s];
-                for (uint32_t i = 0; i < RR_SQUAD_MEMBER_COUNT; ++i)
-                {
-                    if (squad->members[i].in_use == 0)
-                    {
-                        proto_bug_write_uint8(&encoder, 0, "bitbit");
-                        continue;
-                    }
-                    struct rr_squad_member *member = &squad->members[i];
-                    proto_bug_write_uint8(&encoder, 1, "bitbit");
-                    proto_bug_write_uint8(&encoder, member->playing, "ready");
-                    proto_bug_write_uint8(&encoder,
-                                          member->client->disconnected,
-                                          "disconnected");
-                    uint8_t j = member->client - this->clients;
-                    uint8_t blocked = rr_bitset_get(client->blocked_clients, j);
-                    proto_bug_write_uint8(&encoder, blocked, "blocked");
-                    proto_bug_write_uint8(&encoder, member->is_dev, "is_dev");
-                    proto_bug_write_uint8(&encoder, member->kick_vote_count,
-                                          "kick votes");
-                    proto_bug_write_varuint(&encoder, member->level, "level");
-                    proto_bug_write_string(&encoder, member->nickname, 16,
-                                           "nickname");
-                    for (uint8_t j = 0; j < RR_MAX_SLOT_COUNT * 2; ++j)
-                    {
-                        proto_bug_write_uint8(&encoder, member->loadout[j].id,
-                                              "id");
-                        proto_bug_write_uint8(&encoder,
-                                              member->loadout[j].rarity, "rar");
-                    }
-                }
-                proto_bug_write_uint8(&encoder, squad->owner, "sqown");
-                proto_bug_write_uint8(&encoder, squad->private, "private");
-                proto_bug_write_uint8(&encoder, squad->expose_code,
-                                      "expose_code");
-                proto_bug_write_uint8(&encoder, RR_GLOBAL_BIOME, "biome");
-                char joined_code[16];
-                if (client->dev || squad->expose_code ||
-                    (client->in_squad && client->squad == s))
-                    sprintf(joined_code, "%s-%s", this->server_alias,
-                            squad->squad_code);
-                else
-                    strcpy(joined_code, "(private)");
-                proto_bug_write_string(&encoder, joined_code, 16, "squad code");
-            }
-            rr_server_client_write_message(client, encoder.start,
-                                           encoder.current - encoder.start);
+            rr_server_client_flush_account(client, 0);
+            captures.clients[broadcast_count++] = i;
         }
     }
+    // queries rebuild dirty spatial hashes and a player whose arena is gone
+    // gets moved back to the first one, neither can happen from the workers
+    for (uint32_t i = 0; i < this->simulation.arena_count; ++i)
+        rr_spatial_hash_build(
+            &rr_simulation_get_arena(&this->simulation,
+                                     this->simulation.arena_vector[i])
+                 ->spatial_hash);
+    for (uint32_t i = 0; i < broadcast_count; ++i)
+    {
+        struct rr_component_player_info *player_info =
+            this->clients[captures.clients[i]].player_info;
+        if (player_info != NULL &&
+            !rr_simulation_entity_alive(
+                &this->simulation,
+                rr_simulation_get_entity_hash(&this->simulation,
+                                              player_info->arena)))
+            rr_component_player_info_set_arena(player_info, 1);
+    }
+    update_squad_dumps(this);
+    rr_entity_cache_begin_tick(&this->entity_cache);
+    rr_scheduler_parallel_for(&this->scheduler, broadcast_count, 1, &captures,
+                              broadcast_clients);
+    uint64_t cache_hits = atomic_load(&this->entity_cache.hits);
+    uint64_t cache_total = cache_hits + atomic_load(&this->entity_cache.misses);
+    if (cache_total != 0)
+        rr_profiler_record(rr_profiler_value_probe(&entity_cache_probe,
+                                                   "entity_cache_hit_percent"),
+                           cache_hits * 100 / cache_total);
     rr_simulation_for_each_entity(&this->simulation, &this->simulation,
                                   rr_simulation_tick_entity_resetter_function);
+    rr_profiler_record(rr_profiler_probe(&broadcast_probe, "broadcast"),
+                       rr_profiler_now() - broadcast_start);
 }
 
-void rr_server_run(struct rr_server *this)
+// only what was queued when the tick started, the network thread keeps
+// pushing while this runs
+static void drain_commands(struct rr_server *this)
 {
+    uint64_t now = rr_profiler_now();
+    for (uint32_t count = rr_queue_size(&this->commands); count > 0; --count)
     {
-        struct lws_context_creation_info info = {0};
+        struct rr_server_command *command = rr_queue_pop(&this->commands);
+        if (command->type == rr_server_command_receive)
+            rr_profiler_record(
+                rr_profiler_probe(&input_latency_probe, "input_latency"),
+                now - command->time);
+        handle_command(this, command);
+        if (command->type == rr_server_command_close)
+            session_free(command->session);
+        free(command);
+    }
+}
 
-        info.protocols =
-            (struct lws_protocols[]){{"g", lws_callback, sizeof(uint8_t),
-                                      MESSAGE_BUFFER_SIZE, 0, NULL, 0},
-                                     {0}};
+static void instance_tick(struct rr_server *this)
+{
+    drain_commands(this);
+    uint64_t tick_start = rr_profiler_now();
+    server_tick(this);
+    rr_profiler_record(rr_profiler_probe(&server_tick_probe, "server_tick"),
+                       rr_profiler_now() - tick_start);
+    this->simulation.animation_length = 0;
+    // how far behind the sockets are, anything near
+    // RR_SESSION_DROPPABLE_FRAMES means clients are missing updates
+    for (uint32_t i = 0; i < RR_MAX_CLIENT_COUNT; ++i)
+    {
+        struct rr_server_client *client = &this->clients[i];
+        if (client->session == NULL)
+            continue;
+        rr_profiler_record(
+            rr_profiler_value_probe(&session_frames_probe, "session_frames"),
+            rr_frame_pool_size(&client->session->frames));
+        rr_server_client_update_budget(client);
+        rr_profiler_record(
+            rr_profiler_value_probe(&update_budget_probe, "update_budget"),
+            client->update_budget);
+    }
+}
 
-        info.port = 1234;
-        info.user = this;
-        info.pt_serv_buf_size = MESSAGE_BUFFER_SIZE;
+static void *instance_thread(void *_this)
+{
+    struct rr_server *this = _this;
+    struct rr_server_host *host = this->host;
+#ifdef __linux__
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count > 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(this->instance % cpu_count, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus))
+            fprintf(stderr, "<rr_server::pin_failed::%u>\n", this->instance);
+    }
+#endif
+    uint64_t generation = 0;
+    while (1)
+    {
+        pthread_mutex_lock(&host->mutex);
+        while (host->generation == generation && !host->stopping)
+            pthread_cond_wait(&host->wake, &host->mutex);
+        generation = host->generation;
+        uint8_t stopping = host->stopping;
+        pthread_mutex_unlock(&host->mutex);
+        if (stopping)
+            return NULL;
+        instance_tick(this);
+        pthread_mutex_lock(&host->mutex);
+        if (--host->busy_instances == 0)
+            pthread_cond_signal(&host->done);
+        pthread_mutex_unlock(&host->mutex);
+    }
+}
 
-        this->server = lws_create_context(&info);
-        assert(this->server);
+// every instance ticks on its own thread, a single instance stays inline
+static void tick_instances(struct rr_server_host *this)
+{
+    if (this->instance_count == 1)
+    {
+        instance_tick(this->instances[0]);
+        return;
+    }
+    pthread_mutex_lock(&this->mutex);
+    this->busy_instances = this->instance_count;
+    ++this->generation;
+    pthread_cond_broadcast(&this->wake);
+    while (this->busy_instances != 0)
+        pthread_cond_wait(&this->done, &this->mutex);
+    pthread_mutex_unlock(&this->mutex);
+}
+
+// kicks are turned into close requests, then the network thread is woken
+// up to send everything the tick queued
+static void flush_instances(struct rr_server_host *this)
+{
+    for (uint32_t i = 0; i < this->instance_count; ++i)
+    {
+        struct rr_server *instance = this->instances[i];
+        for (uint32_t j = 0; j < RR_MAX_CLIENT_COUNT; ++j)
+        {
+            struct rr_server_client *client = &instance->clients[j];
+            if (!client->in_use || client->session == NULL ||
+                !client->pending_kick)
+                continue;
+            if (atomic_load(&client->session->close_reason) == NULL)
+                atomic_store(&client->session->close_reason,
+                             "kicked for unspecified reason");
+        }
+    }
+    lws_cancel_service(this->server);
+}
+
+void rr_server_host_init(struct rr_server_host *this)
+{
+    memset(this, 0, sizeof *this);
+    pthread_mutex_init(&this->mutex, NULL);
+    pthread_cond_init(&this->wake, NULL);
+    pthread_cond_init(&this->done, NULL);
+    char const *instance_count = getenv("RR_INSTANCE_COUNT");
+    uint32_t count = instance_count ? atoi(instance_count) : 1;
+    if (count == 0)
+        count = 1;
+    if (count > RR_MAX_INSTANCE_COUNT)
+        count = RR_MAX_INSTANCE_COUNT;
+    // shared by every instance and not safe to run twice
+    rr_static_data_init();
+    rr_crafting_init();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        this->instances[i] = calloc(1, sizeof *this->instances[i]);
+        rr_server_init(this->instances[i], this, i);
+        this->instance_count = i + 1;
+    }
+    if (count > 1)
+        for (uint32_t i = 0; i < count; ++i)
+            if (pthread_create(&this->instances[i]->thread, NULL,
+                               instance_thread, this->instances[i]))
+            {
+                fprintf(stderr, "<rr_server::instance_create_failed::%u>\n",
+                        i);
+                abort();
+            }
+    fprintf(stderr, "<rr_server::init::%u instances>\n", this->instance_count);
+}
+
+void rr_server_host_free(struct rr_server_host *this)
+{
+    pthread_mutex_lock(&this->mutex);
+    atomic_store(&this->stopping, 1);
+    pthread_cond_broadcast(&this->wake);
+    pthread_mutex_unlock(&this->mutex);
+    if (this->server != NULL)
+    {
+        lws_cancel_service(this->server);
+        pthread_join(this->network_thread, NULL);
+        // the close callbacks hand the sessions to the instances
+        lws_context_destroy(this->server);
+    }
+    for (uint32_t i = 0; i < this->instance_count; ++i)
+    {
+        if (this->instance_count > 1)
+            pthread_join(this->instances[i]->thread, NULL);
+        rr_server_free(this->instances[i]);
+        free(this->instances[i]);
     }
+    pthread_cond_destroy(&this->done);
+    pthread_cond_destroy(&this->wake);
+    pthread_mutex_destroy(&this->mutex);
+}
+
+static void sleep_until(uint64_t time)
+{
+    struct timespec until = {time / 1000000000, time % 1000000000};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) ==
+           EINTR)
+        ;
+}
+
+void rr_server_host_run(struct rr_server_host *this)
+{
     {
         struct lws_context_creation_info info = {0};
         struct lws_client_connect_info client_info = {0};
 
-        struct lws_protocols protocols[] = {
-            {
-                "g",
-                api_lws_callback,
-                0,
-                128 * 1024,
-            },
-            {NULL, NULL, 0, 0} // terminator
-        };
-        info.port = CONTEXT_PORT_NO_LISTEN;
-        info.protocols = protocols;
-        info.gid = -1;
-        info.uid = -1;
+        // the api socket is a client connection on the same context so the
+        // network thread services everything with one lws_service
+        info.protocols = (struct lws_protocols[]){
+            {"g", lws_callback, sizeof(uint8_t), MESSAGE_BUFFER_SIZE, 0, NULL,
+             0},
+            {"api", api_lws_callback, 0, 128 * 1024, 0, NULL, 0},
+            {0}};
+
+        info.port = 1234;
         info.user = this;
+        info.pt_serv_buf_size = MESSAGE_BUFFER_SIZE;
 
-        this->api_client_context = lws_create_context(&info);
-        if (!this->api_client_context)
-        {
-            puts("couldn't create api server context");
-            exit(1);
-        }
-        client_info.context = this->api_client_context;
+        this->server = lws_create_context(&info);
+        assert(this->server);
+
+        client_info.context = this->server;
         client_info.address =
 #ifndef RIVET_BUILD
             "localhost";
@@ -1675,7 +2261,8 @@ void rr_server_run(struct rr_server *this)
         client_info.path = "/api/" RR_API_SECRET;
         client_info.host = client_info.address;
         client_info.origin = client_info.address;
-        client_info.protocol = protocols[0].name;
+        client_info.protocol = "g";
+        client_info.local_protocol_name = "api";
         this->api_client = lws_client_connect_via_info(&client_info);
         if (!this->api_client)
         {
@@ -1683,23 +2270,41 @@ void rr_server_run(struct rr_server *this)
             exit(1);
         }
     }
-    struct timeval start;
-    struct timeval end;
+    if (pthread_create(&this->network_thread, NULL, network_thread, this))
+    {
+        puts("couldn't create network thread");
+        exit(1);
+    }
+    // RR_PROFILER_PATH=<file> sets where the profiler is dumped every minute
+    char const *profiler_path = getenv("RR_PROFILER_PATH");
+    if (profiler_path == NULL)
+        profiler_path = "profiler.txt";
+    signal(SIGUSR1, request_profiler_dump);
+    uint32_t ticks_to_profiler_dump = PROFILER_DUMP_INTERVAL;
+    uint64_t next_tick = rr_profiler_now();
     while (1)
     {
-        gettimeofday(&start, NULL);
-        lws_service(this->server, -1);
-        lws_service(this->api_client_context, -1);
-        server_tick(this);
-        this->simulation.animation_length = 0;
-        gettimeofday(&end, NULL);
-
-        uint64_t elapsed_time = (end.tv_sec - start.tv_sec) * 1000000 +
-                                (end.tv_usec - start.tv_usec);
+        sleep_until(next_tick);
+        uint64_t start = rr_profiler_now();
+        rr_profiler_record(
+            rr_profiler_probe(&tick_start_delay_probe, "tick_start_delay"),
+            start - next_tick);
+        if (atomic_load(&this->api_ws_ready))
+            tick_instances(this);
+        flush_instances(this);
+        if (--ticks_to_profiler_dump == 0 || profiler_dump_requested)
+        {
+            profiler_dump_requested = 0;
+            ticks_to_profiler_dump = PROFILER_DUMP_INTERVAL;
+            rr_profiler_dump(profiler_path);
+        }
+        uint64_t end = rr_profiler_now();
+        uint64_t elapsed_time = (end - start) / 1000;
         if (elapsed_time > 25000)
             fprintf(stderr, "tick took %lu microseconds\n", elapsed_time);
-        int64_t to_sleep = 40000 - elapsed_time;
-        if (to_sleep > 0)
-            usleep(to_sleep);
+        // a late tick shifts the schedule instead of bursting to catch up
+        next_tick += TICK_INTERVAL;
+        if (next_tick < end)
+            next_tick = end;
     }
 }
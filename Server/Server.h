@@ -16,7 +16,13 @@
 
 #pragma once
 
+#include <pthread.h>
+
 #include <Server/Client.h>
+#include <Server/EntityCache.h>
+#include <Server/FramePool.h>
+#include <Server/Queue.h>
+#include <Server/Scheduler.h>
 #include <Server/Simulation.h>
 #include <Server/Squad.h>
 
@@ -26,29 +32,129 @@
 #define MESSAGE_BUFFER_SIZE (1024 * 1024)
 #endif
 
-extern uint8_t lws_message_data[MESSAGE_BUFFER_SIZE];
-extern uint8_t *outgoing_message;
+// reserved for one tick of shared entity encodings, only what gets written
+// is committed
+#define RR_ENTITY_CACHE_SIZE (64 * 1024 * 1024)
+
+#define RR_MAX_INSTANCE_COUNT (16)
+// game->api messages from instances other than 0 are wrapped in
+// [RR_API_INSTANCE, instance, ...] and api->game ones in
+// [RR_API_SUCCESS, RR_API_INSTANCE, instance, ...]
+#define RR_API_INSTANCE (100)
+
+#define RR_COMMAND_QUEUE_CAPACITY (16384)
+#define RR_API_QUEUE_CAPACITY (4096)
+// frames a client can have waiting on its socket. past the droppable mark
+// updates, animations and squad dumps are skipped until the socket catches
+// up, a client that also fills the rest is kicked
+#define RR_SESSION_FRAME_COUNT (32)
+#define RR_SESSION_DROPPABLE_FRAMES (16)
 
 struct lws_context;
 struct lws;
 struct rr_server;
+struct rr_server_host;
 struct rr_squad_member;
 
+struct rr_server_api_message
+{
+    uint64_t len;
+    uint8_t *packet;
+    // only used while the message sits in the overflow list
+    struct rr_server_api_message *next;
+};
+
+enum rr_server_command_type
+{
+    rr_server_command_connect, // data is the x-forwarded-for header
+    rr_server_command_receive,
+    rr_server_command_close,
+    rr_server_command_api // api message, data starts at the opcode
+};
+
+// something the network thread saw, handled by the instance at tick start
+struct rr_server_command
+{
+    struct rr_server_session *session;
+    uint64_t time;
+    uint32_t size;
+    uint8_t type;
+    uint8_t data[];
+};
+
+// one per client websocket. created by the network thread, which forgets
+// about it after the close command. the instance frees it once it has
+// handled that command
+struct rr_server_session
+{
+    struct lws *ws;
+    struct rr_server_session *next;
+    // instance side only
+    struct rr_server_client *client;
+    // instance -> network
+    struct rr_frame_pool frames;
+    // set by the instance, the network thread closes the socket
+    _Atomic(char const *) close_reason;
+    uint8_t instance;
+};
+
+// one game instance. every instance has its own simulation, clients and
+// squads and is only ever ticked by its own thread
 struct rr_server
 {
     struct rr_simulation simulation;
+    struct rr_scheduler scheduler;
     uint8_t clients_in_use[RR_BITSET_ROUND(RR_MAX_CLIENT_COUNT)];
     struct rr_server_client clients[RR_MAX_CLIENT_COUNT];
-    struct lws_context *server;
-    struct lws_context *api_client_context;
-    struct lws *api_client;
     struct rr_squad squads[RR_MAX_CLIENT_COUNT];
-    uint8_t api_ws_ready;
+    struct rr_squad_dump squad_dumps[RR_SQUAD_COUNT];
+    struct rr_entity_cache entity_cache;
+    struct rr_server_host *host;
+    uint8_t *message_data;
+    // scratch buffer for encoding, LWS_PRE bytes into message_data
+    uint8_t *outgoing_message;
+    // rr_server_command, network -> instance
+    struct rr_queue commands;
+    // rr_server_api_message, instance -> network
+    struct rr_queue api_messages;
+    // messages that did not fit into api_messages. once it is non-empty
+    // every new message goes here too so the api sees them in order
+    pthread_mutex_t api_overflow_mutex;
+    struct rr_server_api_message *api_overflow_head;
+    struct rr_server_api_message *api_overflow_tail;
+    atomic_uchar api_overflowing;
+    pthread_t thread;
+    // stamped on every update so clients can place it on their timeline
+    uint32_t tick;
+    uint8_t instance;
     char server_alias[16];
 };
 
-void rr_server_init(struct rr_server *);
+// owns the sockets. lws runs on its own network thread that only talks to
+// the instances through queues, the host thread drives the ticks
+struct rr_server_host
+{
+    struct rr_server *instances[RR_MAX_INSTANCE_COUNT];
+    struct lws_context *server;
+    struct lws *api_client;
+    // network thread only
+    struct rr_server_session *sessions;
+    pthread_t network_thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    uint64_t generation;
+    uint32_t busy_instances;
+    uint8_t instance_count;
+    atomic_uchar api_ws_ready;
+    atomic_uchar stopping;
+};
+
+// host may be NULL, api messages are dropped then. rr_static_data_init has to
+// have run already
+void rr_server_init(struct rr_server *, struct rr_server_host *, uint8_t);
 void rr_server_free(struct rr_server *);
+void rr_server_write_to_api(struct rr_server *, uint8_t *, uint64_t);
 
 uint8_t rr_client_create_squad(struct rr_server *, struct rr_server_client *);
 uint8_t rr_client_find_squad(struct rr_server *, struct rr_server_client *);
@@ -61,7 +167,16 @@ struct rr_squad_member *rr_squad_get_client_slot(struct rr_server *,
                                                  struct rr_server_client *);
 struct rr_squad *rr_client_get_squad(struct rr_server *,
                                      struct rr_server_client *);
+// marks the client's squad dirty, if it is in one
+void rr_client_squad_changed(struct rr_server *, struct rr_server_client *);
+void rr_server_client_create_player_info(struct rr_server *,
+                                         struct rr_server_client *);
+
+// RR_INSTANCE_COUNT (default 1) instances are created, clients pick one with
+// the request path, ws://host:1234/<instance>
+void rr_server_host_init(struct rr_server_host *);
+void rr_server_host_free(struct rr_server_host *);
 
 // Blocking function. The only time this function will never end unless the
 // server crashes
-void rr_server_run(struct rr_server *);
+void rr_server_host_run(struct rr_server_host *);
@@ -26,7 +26,10 @@
 #include <Server/Client.h>
 #include <Server/EntityAllocation.h>
 #include <Server/EntityDetection.h>
+#include <Server/MazeInfluence.h>
 #include <Server/MobAi/Ai.h>
+#include <Server/Profiler.h>
+#include <Server/Scheduler.h>
 #include <Server/SpatialHash.h>
 #include <Server/System/System.h>
 #include <Server/Waves.h>
@@ -128,12 +131,25 @@ static void set_spawn_zones()
 void rr_simulation_init(struct rr_simulation *this)
 {
     memset(this, 0, sizeof *this);
+    set_spawn_zones();
+    for (uint32_t i = 0; i < rr_biome_id_max; ++i)
+    {
+        uint32_t size = RR_MAZES[i].maze_dim * RR_MAZES[i].maze_dim *
+                        sizeof(struct rr_maze_grid);
+        this->mazes[i] = RR_MAZES[i];
+        this->mazes[i].maze = malloc(size);
+        memcpy(this->mazes[i].maze, RR_MAZES[i].maze, size);
+    }
+    this->entity_high_water_mark = 1;
     EntityIdx id = rr_simulation_alloc_entity(this);
     struct rr_component_arena *arena = rr_simulation_add_arena(this, id);
     arena->biome = RR_GLOBAL_BIOME;
     rr_component_arena_spatial_hash_init(arena, this);
     set_respawn_zone(arena, SPAWN_ZONE_X, SPAWN_ZONE_Y);
-    set_spawn_zones();
+    rr_maze_influence_init(&this->maze_influence, arena->maze);
+    rr_contact_pool_init(&this->contacts);
+    this->ai_lod_interval = RR_AI_LOD_INTERVAL;
+    this->ai_lod_freeze = 1;
 }
 
 struct too_close_captures
@@ -192,17 +208,7 @@ static void spawn_mob(struct rr_simulation *this, uint32_t grid_x,
         if (id == ALL_MOBS)
             id = get_spawn_id(RR_GLOBAL_BIOME, grid);
         else if (id == DIFFICULT_MOBS)
-            for (uint8_t i = 0; i < 10; ++i)
-            {
-                id = get_spawn_id(RR_GLOBAL_BIOME, grid);
-                if (id != rr_mob_id_dakotaraptor &&
-                    id != rr_mob_id_ornithomimus &&
-                    id != rr_mob_id_triceratops &&
-                    id != rr_mob_id_fern &&
-                    id != rr_mob_id_meteor &&
-                    id != rr_mob_id_golden_meteor)
-                    break;
-            }
+            id = get_difficult_spawn_id(RR_GLOBAL_BIOME);
     }
     else
         id = get_spawn_id(RR_GLOBAL_BIOME, grid);
@@ -228,8 +234,6 @@ static void spawn_mob(struct rr_simulation *this, uint32_t grid_x,
     }
 }
 
-#define PLAYER_COUNT_CAP (12)
-
 static void count_flower_vicinity(EntityIdx entity, void *_simulation)
 {
     struct rr_simulation *this = _simulation;
@@ -258,16 +262,8 @@ static void count_flower_vicinity(EntityIdx entity, void *_simulation)
     uint32_t ey = rr_fclamp((physical->y + FOV) / arena->maze->grid_size, 0,
                             arena->maze->maze_dim - 1);
 #undef FOV
-    uint32_t level = rr_simulation_get_flower(_simulation, entity)->level;
-    for (uint32_t x = sx; x <= ex; ++x)
-        for (uint32_t y = sy; y <= ey; ++y)
-        {
-            struct rr_maze_grid *grid =
-                rr_component_arena_get_grid(arena, x, y);
-            grid->player_count += grid->player_count < PLAYER_COUNT_CAP;
-            grid->local_difficulty +=
-                rr_fclamp((level - (grid->difficulty - 1) * 2.1) / 10, -1, 1);
-        }
+    rr_maze_influence_set(&this->maze_influence, entity, sx, sy, ex, ey,
+                          rr_simulation_get_flower(this, entity)->level);
 }
 
 static void despawn_mob(EntityIdx entity, void *_simulation)
@@ -317,7 +313,7 @@ static int tick_grid(struct rr_simulation *this, struct rr_maze_grid *grid,
     if (grid->value == 0 || (grid->value & 8))
         return 0;
     grid->local_difficulty =
-        rr_fclamp(grid->local_difficulty, -0.5, PLAYER_COUNT_CAP);
+        rr_fclamp(grid->local_difficulty, -0.5, RR_MAZE_PLAYER_COUNT_CAP);
     if (grid->local_difficulty > 0)
     {
         grid->overload_factor = rr_fclamp(
@@ -355,96 +351,180 @@ static int tick_grid(struct rr_simulation *this, struct rr_maze_grid *grid,
     return 0;
 }
 
-static void tick_maze(struct rr_simulation *this)
+// what tick_grid did to a block while no flower was in range of it. the
+// overload only decays, which can only ever stop the block from being
+// ticked, so checking once a second is close enough
+static void catch_up_idle_block(struct rr_simulation *this, uint32_t grid_x,
+                                uint32_t grid_y, uint32_t ticks)
 {
     struct rr_component_arena *arena = rr_simulation_get_arena(this, 1);
-    for (uint32_t i = 0; i < arena->maze->maze_dim * arena->maze->maze_dim; ++i)
-        arena->maze->maze[i].local_difficulty =
-            arena->maze->maze[i].player_count = 0;
+    struct rr_maze_grid *cells[4] = {
+        rr_component_arena_get_grid(arena, grid_x, grid_y),
+        rr_component_arena_get_grid(arena, grid_x + 1, grid_y),
+        rr_component_arena_get_grid(arena, grid_x, grid_y + 1),
+        rr_component_arena_get_grid(arena, grid_x + 1, grid_y + 1)};
+    // the flowers that just came into range weren't there
+    uint32_t player_counts[4];
+    float local_difficulties[4];
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        player_counts[i] = cells[i]->player_count;
+        local_difficulties[i] = cells[i]->local_difficulty;
+        cells[i]->player_count = 0;
+        cells[i]->local_difficulty = 0;
+    }
+    uint8_t reset_timers = 0;
+    while (ticks > 0)
+    {
+        uint32_t step = ticks < 25 ? ticks : 25;
+        float max_overall = 0;
+        uint32_t points = 0;
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            max_overall += get_max_points(this, cells[i]);
+            points += cells[i]->grid_points;
+        }
+        if (points > max_overall)
+            break;
+        uint8_t decaying = 0;
+        reset_timers = 0;
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            struct rr_maze_grid *grid = cells[i];
+            if (grid->value == 0 || (grid->value & 8))
+                continue;
+            // once before the points check and once after
+            uint8_t reset = grid->grid_points < get_max_points(this, grid);
+            decaying |= grid->overload_factor > 0;
+            grid->overload_factor = rr_fclamp(
+                grid->overload_factor - (1 + reset) * 0.025 / 25 * step, 0,
+                reset ? 15 : grid->overload_factor);
+            reset_timers |= reset << i;
+        }
+        if (!decaying)
+            break;
+        ticks -= step;
+    }
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        struct rr_maze_grid *grid = cells[i];
+        if (reset_timers >> i & 1)
+        {
+            float max_points = get_max_points(this, grid);
+            float spawn_at = max_points / (max_points - grid->grid_points) *
+                             (150 + 3 * grid->difficulty) *
+                             powf(1.2, grid->overload_factor);
+            grid->spawn_timer = rr_frand() * 0.75 * spawn_at;
+        }
+        grid->player_count = player_counts[i];
+        grid->local_difficulty = local_difficulties[i];
+    }
+}
 
+void rr_simulation_tick_maze(struct rr_simulation *this)
+{
+    struct rr_component_arena *arena = rr_simulation_get_arena(this, 1);
+    struct rr_maze_influence *influence = &this->maze_influence;
     rr_simulation_for_each_flower(this, this, count_flower_vicinity);
+    rr_maze_influence_update(influence);
     rr_simulation_for_each_mob(this, this, despawn_mob);
-    for (uint32_t grid_x = 0; grid_x < arena->maze->maze_dim; grid_x += 2)
+    // blocks without a flower in range never spawn, they are caught up on
+    // once one comes back
+    for (uint32_t i = 0; i < influence->active_count; ++i)
     {
-        for (uint32_t grid_y = 0; grid_y < arena->maze->maze_dim; grid_y += 2)
+        uint32_t block = influence->active_blocks[i];
+        uint32_t grid_x = block % influence->block_dim * 2;
+        uint32_t grid_y = block / influence->block_dim * 2;
+        if (influence->idle_ticks[block] > 0)
         {
-            struct rr_maze_grid *nw =
-                rr_component_arena_get_grid(arena, grid_x, grid_y);
-            struct rr_maze_grid *ne =
-                rr_component_arena_get_grid(arena, grid_x + 1, grid_y);
-            struct rr_maze_grid *sw =
-                rr_component_arena_get_grid(arena, grid_x, grid_y + 1);
-            struct rr_maze_grid *se =
-                rr_component_arena_get_grid(arena, grid_x + 1, grid_y + 1);
-            float max_overall =
-                get_max_points(this, nw) + get_max_points(this, ne) +
-                get_max_points(this, sw) + get_max_points(this, se);
-            if (nw->grid_points + ne->grid_points + sw->grid_points +
-                    se->grid_points >
-                max_overall)
-                continue;
-            if (tick_grid(this, nw, grid_x, grid_y))
-                continue;
-            if (tick_grid(this, ne, grid_x + 1, grid_y))
-                continue;
-            if (tick_grid(this, sw, grid_x, grid_y + 1))
-                continue;
-            if (tick_grid(this, se, grid_x + 1, grid_y + 1))
-                continue;
+            catch_up_idle_block(this, grid_x, grid_y,
+                                influence->idle_ticks[block]);
+            influence->idle_ticks[block] = 0;
         }
+        struct rr_maze_grid *nw =
+            rr_component_arena_get_grid(arena, grid_x, grid_y);
+        struct rr_maze_grid *ne =
+            rr_component_arena_get_grid(arena, grid_x + 1, grid_y);
+        struct rr_maze_grid *sw =
+            rr_component_arena_get_grid(arena, grid_x, grid_y + 1);
+        struct rr_maze_grid *se =
+            rr_component_arena_get_grid(arena, grid_x + 1, grid_y + 1);
+        float max_overall = get_max_points(this, nw) + get_max_points(this, ne) +
+                            get_max_points(this, sw) + get_max_points(this, se);
+        if (nw->grid_points + ne->grid_points + sw->grid_points +
+                se->grid_points >
+            max_overall)
+            continue;
+        if (tick_grid(this, nw, grid_x, grid_y))
+            continue;
+        if (tick_grid(this, ne, grid_x + 1, grid_y))
+            continue;
+        if (tick_grid(this, sw, grid_x, grid_y + 1))
+            continue;
+        if (tick_grid(this, se, grid_x + 1, grid_y + 1))
+            continue;
     }
 }
 
-#define RR_TIME_BLOCK_(_, CODE)                                                \
-    {                                                                          \
-        struct timeval start;                                                  \
-        struct timeval end;                                                    \
-        gettimeofday(&start, NULL);                                            \
-        CODE;                                                                  \
-        gettimeofday(&end, NULL);                                              \
-        uint64_t elapsed_time = (end.tv_sec - start.tv_sec) * 1000000 +        \
-                                (end.tv_usec - start.tv_usec);                 \
-        if (elapsed_time > 3000)                                               \
-        {                                                                      \
-            printf(_ " took %lu microseconds with %d entities\n",              \
-                   elapsed_time, this->physical_count);                        \
-        }                                                                      \
-    };
-
-#define RR_TIME_BLOCK(_, CODE)                                                 \
-    {                                                                          \
-        CODE;                                                                  \
-    };
-
 static int64_t last_zone_epoch = -1;
 
+#define RES(COMPONENT) rr_scheduler_resource_##COMPONENT
+#define ALL RR_SCHEDULER_ALL_RESOURCES
+
+// the order here is the serial order. anything that calls rand() writes rng,
+// so most of these still end up running one after another
+static struct rr_scheduler_system const simulation_systems[] = {
+    {"collision_detection", rr_system_collision_detection_tick,
+     RES(physical) | RES(relations) | RES(health) | RES(flower) | RES(petal) |
+         RES(web) | RES(drop) | RES(mob) | RES(nest) | RES(arena) |
+         RES(player_info) | RES(clients),
+     RES(physical) | RES(health) | RES(mob) | RES(arena) | RES(spatial_hash) |
+         RES(entities)},
+    {"ai", rr_system_ai_tick, ALL, ALL},
+    {"drops", rr_system_drops_tick, ALL, ALL},
+    {"petal_behavior", rr_system_petal_behavior_tick, ALL, ALL},
+    {"collision_resolution", rr_system_collision_resolution_tick,
+     RES(physical) | RES(relations) | RES(web) | RES(mob) | RES(nest) |
+         RES(flower) | RES(drop) | RES(petal) | RES(arena) | RES(player_info),
+     RES(physical) | RES(arena) | RES(rng)},
+    {"web", rr_system_web_tick, RES(web), RES(web) | RES(entities)},
+    // the flower death path is deferred but still declared here
+    {"velocity", rr_system_velocity_tick,
+     RES(physical) | RES(flower) | RES(petal) | RES(relations) |
+         RES(player_info) | RES(arena) | RES(health) | RES(clients) |
+         RES(ai),
+     RES(physical) | RES(flower) | RES(health) | RES(player_info) |
+         RES(clients) | RES(drop) | RES(relations) | RES(rng) |
+         RES(entities)},
+    {"centipede", rr_system_centipede_tick, RES(centipede) | RES(physical),
+     RES(physical)},
+    {"health", rr_system_health_tick, ALL, ALL},
+    {"camera", rr_system_camera_tick,
+     RES(player_info) | RES(flower) | RES(physical) | RES(relations) |
+         RES(clients),
+     RES(player_info) | RES(rng)},
+    // {"checkpoints", rr_system_checkpoints_tick, ALL, ALL},
+    {"spawn_tick", rr_simulation_tick_maze, ALL, ALL},
+};
+
+#undef ALL
+#undef RES
+
 void rr_simulation_tick(struct rr_simulation *this)
 {
-    rr_simulation_create_component_vectors(this);
-    RR_TIME_BLOCK("collision_detection",
-                  { rr_system_collision_detection_tick(this); });
-    RR_TIME_BLOCK("ai", { rr_system_ai_tick(this); });
-    RR_TIME_BLOCK("drops", { rr_system_drops_tick(this); });
-    RR_TIME_BLOCK("petal_behavior", { rr_system_petal_behavior_tick(this); });
-    RR_TIME_BLOCK("collision_resolution",
-                  { rr_system_collision_resolution_tick(this); });
-    RR_TIME_BLOCK("web", { rr_system_web_tick(this); });
-    RR_TIME_BLOCK("velocity", { rr_system_velocity_tick(this); });
-    RR_TIME_BLOCK("centipede", { rr_system_centipede_tick(this); });
-    RR_TIME_BLOCK("health", { rr_system_health_tick(this); });
-    RR_TIME_BLOCK("camera", { rr_system_camera_tick(this); });
-    // RR_TIME_BLOCK("checkpoints", { rr_system_checkpoints_tick(this); });
-    RR_TIME_BLOCK("spawn_tick", { tick_maze(this); });
+    rr_scheduler_run(this->scheduler, this, simulation_systems,
+                     sizeof simulation_systems / sizeof *simulation_systems);
+    rr_simulation_release_entity_ids(this);
     memcpy(this->deleted_last_tick, this->pending_deletions,
            sizeof this->pending_deletions);
     memset(this->pending_deletions, 0, sizeof this->pending_deletions);
-    RR_TIME_BLOCK("free_component", {
+    RR_PROFILE("free_component", {
         rr_bitset_for_each_bit(
             this->deleted_last_tick,
             this->deleted_last_tick + (RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT)),
             this, __rr_simulation_pending_deletion_free_components);
     });
-    RR_TIME_BLOCK("unset_entity", {
+    RR_PROFILE("unset_entity", {
         rr_bitset_for_each_bit(
             this->deleted_last_tick,
             this->deleted_last_tick + RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT),
@@ -19,6 +19,8 @@
 #include <Shared/SimulationCommon.h>
 
 void rr_simulation_tick(struct rr_simulation *);
+// the maze spawner, run by rr_simulation_tick as spawn_tick
+void rr_simulation_tick_maze(struct rr_simulation *);
 
 int rr_simulation_entity_alive(struct rr_simulation *,
                                EntityHash); // stricter version
@@ -23,15 +23,59 @@
 #include <Shared/Bitset.h>
 #include <Shared/SimulationCommon.h>
 
-#define spatial_hash_get(x, y) &this->cells[(x) * this->size + (y)]
+#define cell_begin(x, y) (this->cell_start[(x) * this->size + (y)])
+#define cell_end(x, y) (this->cell_start[(x) * this->size + (y) + 1])
+#define NO_TARGET_PARTITION (255)
+
 void rr_spatial_hash_init(struct rr_spatial_hash *this,
-                          struct rr_simulation *simulation, float size)
+                          struct rr_simulation *simulation, float size,
+                          float cell_size)
 {
     memset(this, 0, sizeof *this);
-    this->size = (size + SPATIAL_HASH_GRID_SIZE - 0.1) / SPATIAL_HASH_GRID_SIZE;
+    this->cell_size = cell_size;
+    this->size = (size + cell_size - 0.1) / cell_size;
     this->simulation = simulation;
-    this->cells =
-        calloc(sizeof(struct rr_spatial_hash_cell), this->size * this->size);
+    this->cell_start = calloc(this->size * this->size + 1, sizeof(uint32_t));
+    this->target_start = calloc(
+        RR_SPATIAL_HASH_TARGET_PARTITION_COUNT * this->size * this->size + 1,
+        sizeof(uint32_t));
+    this->target_min_aggro_multiplier = 1;
+}
+
+void rr_spatial_hash_free(struct rr_spatial_hash *this)
+{
+    free(this->cell_start);
+    free(this->entities);
+    free(this->inserted);
+    free(this->inserted_cell);
+    free(this->inserted_partition);
+    free(this->target_start);
+    free(this->targets);
+    free(this->target_order);
+    memset(this, 0, sizeof *this);
+}
+
+static uint8_t get_target_partition(struct rr_simulation *simulation,
+                                    EntityIdx entity)
+{
+    uint8_t kind;
+    if (rr_simulation_has_arena(simulation, entity))
+        return NO_TARGET_PARTITION;
+    if (rr_simulation_has_flower(simulation, entity) ||
+        rr_simulation_has_mob(simulation, entity))
+        kind = rr_spatial_hash_target_kind_body;
+    else if (rr_simulation_has_petal(simulation, entity) &&
+             (rr_simulation_get_petal(simulation, entity)->id ==
+                  rr_petal_id_seed ||
+              rr_simulation_get_petal(simulation, entity)->id ==
+                  rr_petal_id_nest))
+        kind = rr_spatial_hash_target_kind_seed;
+    else
+        return NO_TARGET_PARTITION;
+    uint8_t team = rr_simulation_get_relations(simulation, entity)->team;
+    if (team > rr_simulation_team_id_pvp)
+        team = rr_simulation_team_id_pvp;
+    return team * rr_spatial_hash_target_kind_max + kind;
 }
 
 void rr_spatial_hash_insert(struct rr_spatial_hash *this, EntityIdx entity)
@@ -42,106 +86,358 @@ void rr_spatial_hash_insert(struct rr_spatial_hash *this, EntityIdx entity)
     // force positions unsigned for a significantly better hash function
     uint32_t x =
         rr_fclamp(physical->x, physical->radius,
-                  this->size * SPATIAL_HASH_GRID_SIZE - physical->radius) /
-        SPATIAL_HASH_GRID_SIZE;
+                  this->size * this->cell_size - physical->radius) /
+        this->cell_size;
     uint32_t y =
         rr_fclamp(physical->y, physical->radius,
-                  this->size * SPATIAL_HASH_GRID_SIZE - physical->radius) /
-        SPATIAL_HASH_GRID_SIZE;
-    struct rr_spatial_hash_cell *cell = spatial_hash_get(x, y);
-    cell->entities[cell->entities_in_use++] = entity;
+                  this->size * this->cell_size - physical->radius) /
+        this->cell_size;
+    if (x >= this->size)
+        x = this->size - 1;
+    if (y >= this->size)
+        y = this->size - 1;
+    if (this->inserted_count == this->capacity)
+    {
+        this->capacity = this->capacity ? this->capacity * 2 : 1024;
+        this->entities =
+            realloc(this->entities, this->capacity * sizeof *this->entities);
+        this->inserted =
+            realloc(this->inserted, this->capacity * sizeof *this->inserted);
+        this->inserted_cell = realloc(
+            this->inserted_cell, this->capacity * sizeof *this->inserted_cell);
+        this->inserted_partition =
+            realloc(this->inserted_partition,
+                    this->capacity * sizeof *this->inserted_partition);
+        this->targets =
+            realloc(this->targets, this->capacity * sizeof *this->targets);
+        this->target_order = realloc(
+            this->target_order, this->capacity * sizeof *this->target_order);
+    }
+    uint8_t partition = get_target_partition(this->simulation, entity);
+    if (partition != NO_TARGET_PARTITION)
+    {
+        if (physical->radius > this->target_max_radius)
+            this->target_max_radius = physical->radius;
+        if (physical->aggro_range_multiplier <
+            this->target_min_aggro_multiplier)
+            this->target_min_aggro_multiplier =
+                physical->aggro_range_multiplier;
+    }
+    this->inserted_partition[this->inserted_count] = partition;
+    this->inserted[this->inserted_count] = entity;
+    this->inserted_cell[this->inserted_count++] = x * this->size + y;
+    this->dirty = 1;
 }
 
 void rr_spatial_hash_update(struct rr_spatial_hash *this, EntityIdx entity) {}
 
+void rr_spatial_hash_build(struct rr_spatial_hash *this)
+{
+    if (!this->dirty)
+        return;
+    uint32_t cell_count = this->size * this->size;
+    uint32_t *start = this->cell_start;
+    memset(start, 0, (cell_count + 1) * sizeof *start);
+    for (uint32_t i = 0; i < this->inserted_count; ++i)
+        ++start[this->inserted_cell[i] + 1];
+    for (uint32_t c = 0; c < cell_count; ++c)
+        start[c + 1] += start[c];
+    // start[c] is used as the write cursor for cell c, which leaves it at
+    // the beginning of cell c + 1. insertion order is kept within a cell
+    for (uint32_t i = 0; i < this->inserted_count; ++i)
+        this->entities[start[this->inserted_cell[i]]++] = this->inserted[i];
+    memmove(start + 1, start, cell_count * sizeof *start);
+    start[0] = 0;
+
+    // same again for the targets, keyed by partition then cell
+    uint32_t key_count = RR_SPATIAL_HASH_TARGET_PARTITION_COUNT * cell_count;
+    start = this->target_start;
+    memset(start, 0, (key_count + 1) * sizeof *start);
+    for (uint32_t i = 0; i < this->inserted_count; ++i)
+        if (this->inserted_partition[i] != NO_TARGET_PARTITION)
+            ++start[this->inserted_partition[i] * cell_count +
+                    this->inserted_cell[i] + 1];
+    for (uint32_t k = 0; k < key_count; ++k)
+        start[k + 1] += start[k];
+    this->target_count = start[key_count];
+    for (uint32_t i = 0; i < this->inserted_count; ++i)
+    {
+        if (this->inserted_partition[i] == NO_TARGET_PARTITION)
+            continue;
+        uint32_t at = start[this->inserted_partition[i] * cell_count +
+                            this->inserted_cell[i]]++;
+        this->targets[at] = this->inserted[i];
+        this->target_order[at] = i;
+    }
+    memmove(start + 1, start, key_count * sizeof *start);
+    start[0] = 0;
+    this->dirty = 0;
+}
+
 void rr_spatial_hash_query(struct rr_spatial_hash *this, float fx, float fy,
                            float fw, float fh, void *user_captures,
                            void (*cb)(EntityIdx, void *))
 {
-    float x = fmaxf(fx - fw, 0);
-    float y = fmaxf(fy - fh, 0);
+    rr_spatial_hash_build(this);
     // should not take in an entity id like insert does. the reason is so stuff
     // like ai can query a large radius without a viewing entity
-    uint32_t s_x =
-        rr_fclamp((fx - fw - SPATIAL_HASH_GRID_SIZE) / SPATIAL_HASH_GRID_SIZE,
-                  0, this->size - 1);
+    uint32_t s_x = rr_fclamp((fx - fw - this->cell_size) / this->cell_size, 0,
+                             this->size - 1);
+
+    uint32_t s_y = rr_fclamp((fy - fh - this->cell_size) / this->cell_size, 0,
+                             this->size - 1);
+
+    uint32_t e_x = rr_fclamp((fx + fw + this->cell_size) / this->cell_size, 0,
+                             this->size - 1);
 
-    uint32_t s_y =
-        rr_fclamp((fy - fh - SPATIAL_HASH_GRID_SIZE) / SPATIAL_HASH_GRID_SIZE,
-                  0, this->size - 1);
+    uint32_t e_y = rr_fclamp((fy + fh + this->cell_size) / this->cell_size, 0,
+                             this->size - 1);
 
-    uint32_t e_x =
-        rr_fclamp((fx + fw + SPATIAL_HASH_GRID_SIZE) / SPATIAL_HASH_GRID_SIZE,
-                  0, this->size - 1);
+    for (uint32_t y = s_y; y <= e_y; y++)
+        for (uint32_t x = s_x; x <= e_x; x++)
+        {
+            uint32_t end = cell_end(x, y);
+            for (uint32_t i = cell_begin(x, y); i < end; i++)
+                cb(this->entities[i], user_captures);
+        }
+}
 
-    uint32_t e_y =
-        rr_fclamp((fy + fh + SPATIAL_HASH_GRID_SIZE) / SPATIAL_HASH_GRID_SIZE,
-                  0, this->size - 1);
+void rr_spatial_hash_query_targets(struct rr_spatial_hash *this, float fx,
+                                   float fy, float fw, float fh,
+                                   uint32_t partitions, void *user_captures,
+                                   void (*cb)(EntityIdx, void *))
+{
+    rr_spatial_hash_build(this);
+    uint32_t s_x = rr_fclamp((fx - fw - this->cell_size) / this->cell_size, 0,
+                             this->size - 1);
+    uint32_t s_y = rr_fclamp((fy - fh - this->cell_size) / this->cell_size, 0,
+                             this->size - 1);
+    uint32_t e_x = rr_fclamp((fx + fw + this->cell_size) / this->cell_size, 0,
+                             this->size - 1);
+    uint32_t e_y = rr_fclamp((fy + fh + this->cell_size) / this->cell_size, 0,
+                             this->size - 1);
+    uint32_t cell_count = this->size * this->size;
+    uint32_t at[RR_SPATIAL_HASH_TARGET_PARTITION_COUNT];
+    uint32_t end[RR_SPATIAL_HASH_TARGET_PARTITION_COUNT];
 
     for (uint32_t y = s_y; y <= e_y; y++)
         for (uint32_t x = s_x; x <= e_x; x++)
         {
-            struct rr_spatial_hash_cell *cell = spatial_hash_get(x, y);
-            for (uint64_t i = 0; i < cell->entities_in_use; i++)
-                cb(cell->entities[i], user_captures);
+            uint32_t cell = x * this->size + y;
+            uint32_t heads = 0;
+            for (uint32_t p = 0; p < RR_SPATIAL_HASH_TARGET_PARTITION_COUNT;
+                 ++p)
+            {
+                if (!(partitions & (1u << p)))
+                    continue;
+                at[heads] = this->target_start[p * cell_count + cell];
+                end[heads] = this->target_start[p * cell_count + cell + 1];
+                if (at[heads] < end[heads])
+                    ++heads;
+            }
+            // each partition is in insertion order within the cell, merging
+            // them gives back the order of the plain cell
+            while (heads > 0)
+            {
+                uint32_t next = 0;
+                for (uint32_t h = 1; h < heads; ++h)
+                    if (this->target_order[at[h]] <
+                        this->target_order[at[next]])
+                        next = h;
+                cb(this->targets[at[next]], user_captures);
+                if (++at[next] == end[next])
+                {
+                    --heads;
+                    at[next] = at[heads];
+                    end[next] = end[heads];
+                }
+            }
+        }
+}
+
+struct nearest_target
+{
+    EntityIdx entity;
+    float distance;
+    uint64_t order;
+};
+
+static void find_nearest_in_cell(struct rr_spatial_hash *this, uint32_t x,
+                                 uint32_t y, uint32_t partitions,
+                                 struct nearest_target *best,
+                                 void *user_captures,
+                                 uint8_t (*cb)(EntityIdx, float, float *,
+                                               void *))
+{
+    uint32_t cell_count = this->size * this->size;
+    uint32_t cell = x * this->size + y;
+    // position in the row major walk of rr_spatial_hash_query
+    uint64_t cell_order = (uint64_t)(y * this->size + x) << 32;
+    for (uint32_t p = 0; p < RR_SPATIAL_HASH_TARGET_PARTITION_COUNT; ++p)
+    {
+        if (!(partitions & (1u << p)))
+            continue;
+        uint32_t end = this->target_start[p * cell_count + cell + 1];
+        for (uint32_t i = this->target_start[p * cell_count + cell]; i < end;
+             ++i)
+        {
+            float distance;
+            if (!cb(this->targets[i], best->distance, &distance,
+                    user_captures))
+                continue;
+            uint64_t order = cell_order | this->target_order[i];
+            if (distance == best->distance &&
+                best->entity != RR_NULL_ENTITY && order < best->order)
+                continue;
+            best->entity = this->targets[i];
+            best->distance = distance;
+            best->order = order;
+        }
+    }
+}
+
+// lowest distance anything bucketed at least ring cells away from the
+// center cell can have. entities may have moved up to a cell since they
+// were inserted, the same slack rr_spatial_hash_query pads its range with,
+// and insert clamps positions by up to a radius
+static float ring_lower_bound(struct rr_spatial_hash *this, float x, float y,
+                              int32_t c_x, int32_t c_y, int32_t ring)
+{
+    float left = x - ((float)c_x - ring + 1) * this->cell_size;
+    float right = ((float)c_x + ring) * this->cell_size - x;
+    float bottom = y - ((float)c_y - ring + 1) * this->cell_size;
+    float top = ((float)c_y + ring) * this->cell_size - y;
+    float edge = left;
+    if (right < edge)
+        edge = right;
+    if (bottom < edge)
+        edge = bottom;
+    if (top < edge)
+        edge = top;
+    if (edge < 0)
+        edge = 0;
+    float bound =
+        (edge - this->cell_size - this->target_max_radius) *
+            this->target_min_aggro_multiplier -
+        this->target_max_radius;
+    // petal distances are doubled
+    return bound < 0 ? bound * 2 : bound;
+}
+
+EntityIdx rr_spatial_hash_find_nearest_target(
+    struct rr_spatial_hash *this, float x, float y, float range,
+    uint32_t partitions, void *user_captures,
+    uint8_t (*cb)(EntityIdx, float, float *, void *))
+{
+    rr_spatial_hash_build(this);
+    // same cells as rr_spatial_hash_query(x, y, range, range)
+    int32_t s_x = rr_fclamp((x - range - this->cell_size) / this->cell_size, 0,
+                            this->size - 1);
+    int32_t s_y = rr_fclamp((y - range - this->cell_size) / this->cell_size, 0,
+                            this->size - 1);
+    int32_t e_x = rr_fclamp((x + range + this->cell_size) / this->cell_size, 0,
+                            this->size - 1);
+    int32_t e_y = rr_fclamp((y + range + this->cell_size) / this->cell_size, 0,
+                            this->size - 1);
+    int32_t c_x = rr_fclamp(x / this->cell_size, s_x, e_x);
+    int32_t c_y = rr_fclamp(y / this->cell_size, s_y, e_y);
+    int32_t ring_count = c_x - s_x;
+    if (e_x - c_x > ring_count)
+        ring_count = e_x - c_x;
+    if (c_y - s_y > ring_count)
+        ring_count = c_y - s_y;
+    if (e_y - c_y > ring_count)
+        ring_count = e_y - c_y;
+
+    struct nearest_target best = {RR_NULL_ENTITY, range, 0};
+    for (int32_t ring = 0; ring <= ring_count; ++ring)
+    {
+        if (ring > 0 &&
+            best.distance < ring_lower_bound(this, x, y, c_x, c_y, ring))
+            break;
+        for (int32_t cy = c_y - ring; cy <= c_y + ring; ++cy)
+        {
+            if (cy < s_y || cy > e_y)
+                continue;
+            // whole row on the top and bottom edges, both ends otherwise
+            int32_t step = cy == c_y - ring || cy == c_y + ring ? 1 : 2 * ring;
+            for (int32_t cx = c_x - ring; cx <= c_x + ring; cx += step)
+            {
+                if (cx < s_x || cx > e_x)
+                    continue;
+                find_nearest_in_cell(this, cx, cy, partitions, &best,
+                                     user_captures, cb);
+            }
         }
+    }
+    return best.entity;
 }
 
 void rr_spatial_hash_find_possible_collisions(
     struct rr_spatial_hash *this, void *user_captures,
     void (*cb)(struct rr_simulation *, EntityIdx, EntityIdx, void *))
 {
-    for (uint64_t x = 0; x < this->size; ++x)
+    rr_spatial_hash_build(this);
+    rr_spatial_hash_find_possible_collisions_in_columns(this, 0, this->size,
+                                                        user_captures, cb);
+}
+
+#define for_each_in_cell(X, Y)                                                 \
+    for (uint32_t j = cell_begin(X, Y), j_end = cell_end(X, Y); j < j_end;      \
+         ++j)                                                                  \
+        cb(this->simulation, entity, this->entities[j], user_captures);
+
+// the first entity of every pair comes from a column in [begin, end), so
+// disjoint column ranges can be swept from different threads. the grid has to
+// be built already
+void rr_spatial_hash_find_possible_collisions_in_columns(
+    struct rr_spatial_hash *this, uint32_t begin, uint32_t end,
+    void *user_captures,
+    void (*cb)(struct rr_simulation *, EntityIdx, EntityIdx, void *))
+{
+    for (uint32_t x = begin; x < end; ++x)
     {
-        for (uint64_t y = 0; y < this->size; ++y)
+        for (uint32_t y = 0; y < this->size; ++y)
         {
-            struct rr_spatial_hash_cell *cell = spatial_hash_get(x, y);
-            for (uint64_t i = 0; i < cell->entities_in_use; ++i)
+            uint32_t i_end = cell_end(x, y);
+            for (uint32_t i = cell_begin(x, y); i < i_end; ++i)
             {
-                for (uint64_t j = i + 1; j < cell->entities_in_use; ++j)
-                    cb(this->simulation, cell->entities[i], cell->entities[j],
+                EntityIdx entity = this->entities[i];
+                for (uint32_t j = i + 1; j < i_end; ++j)
+                    cb(this->simulation, entity, this->entities[j],
                        user_captures);
                 if (x > 0)
                 {
-                    struct rr_spatial_hash_cell *adj =
-                        spatial_hash_get(x - 1, y);
-                    for (uint64_t j = 0; j < adj->entities_in_use; ++j)
-                        cb(this->simulation, cell->entities[i],
-                           adj->entities[j], user_captures);
+                    for_each_in_cell(x - 1, y);
                     if (y > 0)
-                    {
-                        struct rr_spatial_hash_cell *adj =
-                            spatial_hash_get(x - 1, y - 1);
-                        for (uint64_t j = 0; j < adj->entities_in_use; ++j)
-                            cb(this->simulation, cell->entities[i],
-                               adj->entities[j], user_captures);
-                    }
+                        for_each_in_cell(x - 1, y - 1);
                 }
                 if (y > 0)
                 {
-                    struct rr_spatial_hash_cell *adj =
-                        spatial_hash_get(x, y - 1);
-                    for (uint64_t j = 0; j < adj->entities_in_use; ++j)
-                        cb(this->simulation, cell->entities[i],
-                           adj->entities[j], user_captures);
+                    for_each_in_cell(x, y - 1);
                     if (x + 1 < this->size)
-                    {
-                        struct rr_spatial_hash_cell *adj =
-                            spatial_hash_get(x + 1, y - 1);
-                        for (uint64_t j = 0; j < adj->entities_in_use; ++j)
-                            cb(this->simulation, cell->entities[i],
-                               adj->entities[j], user_captures);
-                    }
+                        for_each_in_cell(x + 1, y - 1);
                 }
             }
         }
     }
 }
 
+#undef for_each_in_cell
+
 void rr_spatial_hash_reset(struct rr_spatial_hash *this)
 {
-    for (uint64_t i = 0; i < this->size; i++)
-        for (uint64_t j = 0; j < this->size; j++)
-            this->cells[i * this->size + j].entities_in_use = 0;
-    // memset(&this->cells, 0, sizeof this->cells);
-}
\ No newline at end of file
+    this->inserted_count = 0;
+    this->target_max_radius = 0;
+    this->target_min_aggro_multiplier = 1;
+    this->dirty = 1;
+}
+
+uint64_t rr_spatial_hash_memory_usage(struct rr_spatial_hash *this)
+{
+    return (this->size * this->size + 1) * sizeof *this->cell_start +
+           (RR_SPATIAL_HASH_TARGET_PARTITION_COUNT * this->size * this->size +
+            1) * sizeof *this->target_start +
+           this->capacity * (3 * sizeof(EntityIdx) + 2 * sizeof(uint32_t) +
+                             sizeof(uint8_t));
+}
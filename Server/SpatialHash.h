@@ -19,34 +19,95 @@
 #include <Shared/Entity.h>
 #include <Shared/StaticData.h>
 
+// default cell size. find_possible_collisions only looks at neighbouring
+// cells, so a cell must be at least as wide as the largest collision diameter
 #define SPATIAL_HASH_GRID_SIZE (1024)
-#define RR_SPATIAL_HASH_GRID_LENGTH                                            \
-    (((RR_ARENA_LENGTH + SPATIAL_HASH_GRID_SIZE - 1) / SPATIAL_HASH_GRID_SIZE))
-#define RR_SPATIAL_HASH_CELL_MAX_ENTITY_COUNT (2048)
 
 struct rr_simulation;
 
-struct rr_spatial_hash_cell
+// target acquisition only ever returns flowers, mobs and detached seed or
+// nest petals. those are kept a second time, apart by team (every team from
+// rr_simulation_team_id_pvp up shares the last one) and kind, so a search
+// only walks the buckets that can hold a match
+#define RR_SPATIAL_HASH_TARGET_TEAM_COUNT (3)
+
+enum rr_spatial_hash_target_kind
 {
-    uint32_t entities_in_use;
-    EntityIdx entities[RR_SPATIAL_HASH_CELL_MAX_ENTITY_COUNT];
+    // flowers and mobs that aren't arenas
+    rr_spatial_hash_target_kind_body,
+    // seed and nest petals, detached or not
+    rr_spatial_hash_target_kind_seed,
+    rr_spatial_hash_target_kind_max
 };
 
+#define RR_SPATIAL_HASH_TARGET_PARTITION_COUNT                                 \
+    (RR_SPATIAL_HASH_TARGET_TEAM_COUNT * rr_spatial_hash_target_kind_max)
+// partition masks passed to the target queries
+#define rr_spatial_hash_target_bit(team, kind)                                 \
+    (1u << ((team) * rr_spatial_hash_target_kind_max + (kind)))
+#define rr_spatial_hash_target_team_bits(team)                                 \
+    (rr_spatial_hash_target_bit(team, rr_spatial_hash_target_kind_body) |      \
+     rr_spatial_hash_target_bit(team, rr_spatial_hash_target_kind_seed))
+
+// entities are appended by insert and sorted into cells (counting sort) the
+// first time the grid is read after that. cell c owns
+// entities[cell_start[c] .. cell_start[c + 1]), cells are indexed x * size + y
 struct rr_spatial_hash
 {
-    struct rr_spatial_hash_cell *cells;
     struct rr_simulation *simulation;
+    uint32_t *cell_start;
+    EntityIdx *entities;
+    EntityIdx *inserted;
+    uint32_t *inserted_cell;
+    uint8_t *inserted_partition;
+    uint32_t inserted_count;
+    // partition p and cell c own
+    // targets[target_start[p * cells + c] .. target_start[p * cells + c + 1]),
+    // target_order is the position of a target in the insertion order
+    uint32_t *target_start;
+    EntityIdx *targets;
+    uint32_t *target_order;
+    uint32_t target_count;
+    // bounds the ring search uses to stop early
+    float target_max_radius;
+    float target_min_aggro_multiplier;
+    uint32_t capacity;
     uint32_t size;
+    float cell_size;
+    uint8_t dirty;
 };
 
 void rr_spatial_hash_init(struct rr_spatial_hash *, struct rr_simulation *,
-                          float);
+                          float, float);
+void rr_spatial_hash_free(struct rr_spatial_hash *);
 void rr_spatial_hash_insert(struct rr_spatial_hash *, EntityIdx);
 void rr_spatial_hash_update(struct rr_spatial_hash *, EntityIdx);
+// sorts everything inserted since the last reset into cells. called lazily
+// by the readers, call it up front if the first reads happen on several
+// threads at once
+void rr_spatial_hash_build(struct rr_spatial_hash *);
 void rr_spatial_hash_query(struct rr_spatial_hash *, float, float, float, float,
                            void *, void (*)(EntityIdx, void *));
+// visits the targets in the given partitions in the same order
+// rr_spatial_hash_query would visit them
+void rr_spatial_hash_query_targets(struct rr_spatial_hash *, float, float,
+                                   float, float, uint32_t, void *,
+                                   void (*)(EntityIdx, void *));
+// closest target within range in the given partitions. cb gets the best
+// distance so far and returns 1 after writing the distance of a candidate
+// that is no farther, measured as |delta| * aggro_range_multiplier - radius
+// (doubled for petals). cells are walked in rings around (x, y) and the walk
+// stops once the next ring can't hold anything closer. ties go to the target
+// rr_spatial_hash_query would have visited last
+EntityIdx rr_spatial_hash_find_nearest_target(
+    struct rr_spatial_hash *, float, float, float, uint32_t, void *,
+    uint8_t (*)(EntityIdx, float, float *, void *));
 void rr_spatial_hash_find_possible_collisions(struct rr_spatial_hash *, void *,
                                               void (*)(struct rr_simulation *,
                                                        EntityIdx, EntityIdx,
                                                        void *));
-void rr_spatial_hash_reset(struct rr_spatial_hash *);
\ No newline at end of file
+void rr_spatial_hash_find_possible_collisions_in_columns(
+    struct rr_spatial_hash *, uint32_t, uint32_t, void *,
+    void (*)(struct rr_simulation *, EntityIdx, EntityIdx, void *));
+void rr_spatial_hash_reset(struct rr_spatial_hash *);
+uint64_t rr_spatial_hash_memory_usage(struct rr_spatial_hash *);
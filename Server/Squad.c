@@ -25,6 +25,7 @@ void rr_squad_init(struct rr_squad *this, struct rr_server *server, uint8_t pos)
 {
     memset(this, 0, sizeof *this);
     this->expose_code = 1;
+    this->dirty = 1;
     for (uint32_t i = 0; i < 6; ++i)
         this->squad_code[i] = (char)(97 + rand() % 26);
     this->squad_code[6] = 0;
@@ -44,6 +45,7 @@ void rr_squad_add_client(struct rr_squad *this, struct rr_server_client *client)
         if (this->members[i].in_use)
             continue;
         memset(&this->members[i], 0, sizeof this->members[i]);
+        this->dirty = 1;
         client->squad_pos = i;
         this->members[i].client = client;
         this->member_count += 1;
@@ -68,6 +70,7 @@ void rr_squad_remove_client(struct rr_squad *this,
             member->kick_vote_pos = -1;
     }
     this->member_count -= 1;
+    this->dirty = 1;
     memset(&this->members[client->squad_pos], 0,
            sizeof(struct rr_squad_member));
     if (this->member_count == 0)
@@ -128,6 +131,7 @@ uint8_t rr_client_create_squad(struct rr_server *this,
             this->squads[i].private = 1;
             this->squads[i].expose_code = 0;
             this->squads[i].owner = 0;
+            this->squads[i].dirty = 1;
             for (uint32_t j = 0; j < RR_MAX_CLIENT_COUNT; ++j)
                 rr_bitset_unset(this->clients[j].joined_squad_before, i);
             return i;
@@ -190,4 +194,11 @@ struct rr_squad *rr_client_get_squad(struct rr_server *this,
     if (!member->in_squad)
         return NULL;
     return &this->squads[member->squad];
-}
\ No newline at end of file
+}
+
+void rr_client_squad_changed(struct rr_server *this,
+                             struct rr_server_client *member)
+{
+    if (member->in_squad)
+        this->squads[member->squad].dirty = 1;
+}
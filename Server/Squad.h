@@ -37,6 +37,19 @@ struct rr_squad
     uint8_t private;
     uint8_t expose_code;
     char squad_code[7];
+    // set by every change that shows up in the squad dump, cleared once the
+    // dump is re-encoded
+    uint8_t dirty;
+};
+
+// the part of a squad's dump that is the same for every viewer. it is only
+// encoded again after the squad was dirty and the revision goes up each time
+struct rr_squad_dump
+{
+    uint8_t *data;
+    uint32_t size;
+    uint32_t revision;
+    char squad_code[7];
 };
 
 void rr_squad_init(struct rr_squad *, struct rr_server *, uint8_t);
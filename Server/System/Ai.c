@@ -19,15 +19,45 @@
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <Server/Client.h>
 #include <Server/EntityAllocation.h>
 #include <Server/EntityDetection.h>
 #include <Server/MobAi/Ai.h>
+#include <Server/Profiler.h>
 #include <Server/Simulation.h>
 #include <Shared/Entity.h>
 #include <Shared/Vector.h>
 
+// flowers count towards every maze cell within 3072 of them, so a mob in a
+// cell nobody counts towards is out of aggro and view range of all of them.
+// one with no flower counting towards its neighbours either can't be
+// reached within a tick
+static uint8_t get_lod(struct rr_simulation *this, EntityIdx entity)
+{
+    struct rr_component_ai *ai = rr_simulation_get_ai(this, entity);
+    struct rr_component_physical *physical =
+        rr_simulation_get_physical(this, entity);
+    if (physical->arena != 1 || ai->target_entity != RR_NULL_ENTITY ||
+        rr_simulation_get_mob(this, entity)->player_spawned)
+        return rr_ai_lod_full;
+    struct rr_component_arena *arena = rr_simulation_get_arena(this, 1);
+    int32_t dim = arena->maze->maze_dim;
+    int32_t x = rr_fclamp(physical->x / arena->maze->grid_size, 0, dim - 1);
+    int32_t y = rr_fclamp(physical->y / arena->maze->grid_size, 0, dim - 1);
+    if (rr_component_arena_get_grid(arena, x, y)->player_count > 0)
+        return rr_ai_lod_full;
+    if (!this->ai_lod_freeze)
+        return rr_ai_lod_reduced;
+    for (int32_t n_y = y - 1; n_y <= y + 1; ++n_y)
+        for (int32_t n_x = x - 1; n_x <= x + 1; ++n_x)
+            if (n_x >= 0 && n_y >= 0 && n_x < dim && n_y < dim &&
+                rr_component_arena_get_grid(arena, n_x, n_y)->player_count > 0)
+                return rr_ai_lod_reduced;
+    return rr_ai_lod_frozen;
+}
+
 static void system_for_each(EntityIdx entity, void *simulation)
 {
     struct rr_simulation *this = simulation;
@@ -43,6 +73,26 @@ static void system_for_each(EntityIdx entity, void *simulation)
     struct rr_component_mob *mob = rr_simulation_get_mob(this, entity);
     struct rr_component_physical *physical =
         rr_simulation_get_physical(this, entity);
+    uint8_t lod = get_lod(this, entity);
+    ++this->ai_lod_counts[lod];
+    if (lod == rr_ai_lod_frozen ||
+        (lod == rr_ai_lod_reduced &&
+         this->ai_tick - ai->lod_tick < this->ai_lod_interval))
+    {
+        ai->lod = lod;
+        return;
+    }
+    // the ticks that were skipped, the one decrement below is for this one
+    if (ai->lod != rr_ai_lod_full)
+    {
+        uint32_t skipped = this->ai_tick - ai->lod_tick - 1;
+        if (ai->ticks_until_next_action > skipped)
+            ai->ticks_until_next_action -= skipped;
+        else
+            ai->ticks_until_next_action = 0;
+    }
+    ai->lod = lod;
+    ai->lod_tick = this->ai_tick;
     if (ai->target_entity != RR_NULL_ENTITY &&
         (!rr_simulation_entity_alive(simulation, ai->target_entity) ||
          is_dead_flower(simulation, ai->target_entity) ||
@@ -123,5 +173,14 @@ static void system_for_each(EntityIdx entity, void *simulation)
 
 void rr_system_ai_tick(struct rr_simulation *simulation)
 {
+    static atomic_uint lod_probes[rr_ai_lod_max];
+    static char const *lod_names[rr_ai_lod_max] = {
+        "ai_lod_full", "ai_lod_reduced", "ai_lod_frozen"};
+    memset(simulation->ai_lod_counts, 0, sizeof simulation->ai_lod_counts);
+    ++simulation->ai_tick;
     rr_simulation_for_each_ai(simulation, simulation, system_for_each);
+    for (uint32_t i = 0; i < rr_ai_lod_max; ++i)
+        rr_profiler_record(
+            rr_profiler_value_probe(&lod_probes[i], lod_names[i]),
+            simulation->ai_lod_counts[i]);
 }
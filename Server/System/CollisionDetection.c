@@ -20,6 +20,7 @@
 #include <string.h>
 
 #include <Server/Client.h>
+#include <Server/Scheduler.h>
 #include <Server/Simulation.h>
 #include <Server/SpatialHash.h>
 #include <Shared/Bitset.h>
@@ -30,7 +31,7 @@ struct physics_simulation_captures
     struct rr_component_physical *physical;
 };
 
-static void system_reset_colliding_with(EntityIdx entity, void *captures)
+static void system_check_owner_arena(EntityIdx entity, void *captures)
 {
     struct rr_simulation *this = captures;
     if (!rr_simulation_has_physical(this, entity))
@@ -38,7 +39,6 @@ static void system_reset_colliding_with(EntityIdx entity, void *captures)
 
     struct rr_component_physical *physical =
         rr_simulation_get_physical(this, entity);
-    physical->colliding_with_size = 0;
     EntityIdx owner = rr_simulation_get_relations(this, entity)->owner;
     if (rr_simulation_entity_alive(this, owner) &&
         rr_simulation_has_physical(this, owner))
@@ -90,10 +90,17 @@ static uint8_t should_entities_collide(struct rr_simulation *this, EntityIdx a,
 
     return 1;
 }
+struct column_captures
+{
+    struct rr_spatial_hash *spatial_hash;
+    uint32_t column;
+};
+
 static void grid_filter_candidates(struct rr_simulation *this,
                                    EntityIdx entity1, EntityIdx entity2,
                                    void *_captures)
 {
+    struct column_captures *captures = _captures;
     struct rr_component_physical *physical1 =
         rr_simulation_get_physical(this, entity1);
     struct rr_component_physical *physical2 =
@@ -130,13 +137,8 @@ static void grid_filter_candidates(struct rr_simulation *this,
                               physical1->y - physical2->y};
     float collision_radius = physical1->radius + physical2->radius;
     if (rr_vector_magnitude_cmp(&delta, collision_radius) == -1)
-    {
-#ifndef RIVET_BUILD
-        if (physical1->colliding_with_size >= RR_MAX_COLLISION_COUNT)
-            puts("entity cram limit exceeded");
-#endif
-        physical1->colliding_with[physical1->colliding_with_size++] = entity2;
-    }
+        rr_contact_pool_add(&this->contacts, captures->column, entity1,
+                            entity2);
 }
 
 static void collapse_arena(EntityIdx entity, void *_captures)
@@ -159,18 +161,42 @@ static void collapse_arena(EntityIdx entity, void *_captures)
         rr_simulation_request_entity_deletion(this, entity);
 }
 
+static void find_collisions_in_columns(uint32_t begin, uint32_t end,
+                                       void *_captures)
+{
+    // grid_filter_candidates only writes to the first entity of the pair,
+    // and to the contact list of the column it is in
+    struct column_captures captures = {_captures};
+    for (captures.column = begin; captures.column < end; ++captures.column)
+        rr_spatial_hash_find_possible_collisions_in_columns(
+            captures.spatial_hash, captures.column, captures.column + 1,
+            &captures, grid_filter_candidates);
+}
+
 static void find_collisions(EntityIdx entity, void *_captures)
 {
     struct rr_simulation *this = _captures;
     struct rr_component_arena *arena = rr_simulation_get_arena(this, entity);
-    rr_spatial_hash_find_possible_collisions(&arena->spatial_hash, NULL,
-                                             grid_filter_candidates);
+    rr_spatial_hash_build(&arena->spatial_hash);
+    rr_scheduler_parallel_for(this->scheduler, arena->spatial_hash.size, 1,
+                              &arena->spatial_hash,
+                              find_collisions_in_columns);
 }
 
 void rr_system_collision_detection_tick(struct rr_simulation *this)
 {
+    uint32_t column_count = 0;
+    for (uint32_t i = 0; i < this->arena_count; ++i)
+    {
+        uint32_t size =
+            rr_simulation_get_arena(this, this->arena_vector[i])
+                ->spatial_hash.size;
+        if (size > column_count)
+            column_count = size;
+    }
+    rr_contact_pool_reset(&this->contacts, column_count);
     rr_simulation_for_each_arena(this, this, collapse_arena);
-    rr_simulation_for_each_physical(this, this, system_reset_colliding_with);
+    rr_simulation_for_each_physical(this, this, system_check_owner_arena);
     rr_simulation_for_each_physical(this, this, system_insert_entities);
     rr_simulation_for_each_arena(this, this, find_collisions);
 }
@@ -238,8 +238,10 @@ static void system_for_each_function(EntityIdx entity, void *_captures)
     captures.physical = physical;
     captures.simulation = this;
 
-    for (uint64_t i = 0; i < physical->colliding_with_size; ++i)
-        colliding_with_function(physical->colliding_with[i], &captures);
+    uint32_t count;
+    EntityIdx *contacts = rr_contact_pool_get(&this->contacts, entity, &count);
+    for (uint32_t i = 0; i < count; ++i)
+        colliding_with_function(contacts[i], &captures);
 }
 
 static void system_reset_collision_velocity(EntityIdx entity, void *_captures)
@@ -374,10 +374,6 @@ static void colliding_with_function(uint64_t i, void *_captures)
 static void system_for_each_function(EntityIdx entity, void *_captures)
 {
     struct rr_simulation *this = _captures;
-    // all health has physical
-
-    struct rr_component_physical *physical =
-        rr_simulation_get_physical(this, entity);
     struct rr_component_health *health = rr_simulation_get_health(this, entity);
 
     if (health->health == 0)
@@ -387,8 +383,10 @@ static void system_for_each_function(EntityIdx entity, void *_captures)
     captures.health = health;
     captures.simulation = this;
 
-    for (uint32_t i = 0; i < physical->colliding_with_size; ++i)
-        colliding_with_function(physical->colliding_with[i], &captures);
+    uint32_t count;
+    EntityIdx *contacts = rr_contact_pool_get(&this->contacts, entity, &count);
+    for (uint32_t i = 0; i < count; ++i)
+        colliding_with_function(contacts[i], &captures);
 }
 
 void rr_system_health_tick(struct rr_simulation *this)
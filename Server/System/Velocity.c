@@ -19,159 +19,21 @@
 #include <math.h>
 
 #include <Server/Client.h>
+#include <Server/MazeCollision.h>
+#include <Server/Scheduler.h>
 #include <Server/Simulation.h>
 #include <Shared/Entity.h>
 #include <Shared/StaticData.h>
 #include <Shared/Vector.h>
 
-static void perform_internal_bound_check_custom_grid(
-    struct rr_component_arena *arena, float test_x, float test_y, int32_t x,
-    int32_t y, struct rr_component_physical *physical)
-{
-    // add a check for in-wall
-    uint32_t size = arena->maze->maze_dim;
-    float maze_dim = arena->maze->grid_size;
-#define offset(a, b)                                                           \
-    ((x + a < 0 || y + b < 0 || x + a >= size || y + b >= size)                \
-         ? 0                                                                   \
-         : rr_component_arena_get_grid(arena, x + a, y + b)->value)
-
-#define curve_check                                                            \
-    {                                                                          \
-        struct rr_vector dist = {test_x - cx, test_y - cy};                    \
-        if (rr_vector_magnitude_cmp(&dist, maze_dim - physical->radius) ==     \
-                1 &&                                                           \
-            inverse == 0)                                                      \
-        {                                                                      \
-            rr_vector_set_magnitude(&dist, maze_dim - physical->radius);       \
-            rr_component_physical_set_x(physical, cx + dist.x);                \
-            rr_component_physical_set_y(physical, cy + dist.y);                \
-            rr_vector_set(&physical->wall_collision, -dist.x, -dist.y);        \
-            return;                                                            \
-        }                                                                      \
-        if (rr_vector_magnitude_cmp(&dist, maze_dim + physical->radius) ==     \
-                -1 &&                                                          \
-            inverse == 1)                                                      \
-        {                                                                      \
-            rr_vector_set_magnitude(&dist, maze_dim + physical->radius);       \
-            rr_component_physical_set_x(physical, cx + dist.x);                \
-            rr_component_physical_set_y(physical, cy + dist.y);                \
-            rr_vector_set(&physical->wall_collision, dist.x, dist.y);          \
-            return;                                                            \
-        }                                                                      \
-    }
-
-    if (offset(0, 0) != 1)
-    {
-        // tile can't be 0 (that would be illegal)
-        uint8_t tile = offset(0, 0);
-        if (tile == 0)
-            return;
-        uint8_t left = (tile >> 1) & 1;
-        uint8_t top = tile & 1;
-        uint8_t inverse = ((tile >> 3) & 1);
-        float cx = (x + left) * maze_dim;
-        float cy = (y + top) * maze_dim;
-        curve_check;
-    }
-    if (offset(-1, 0) != 1 && test_x - x * maze_dim < physical->radius)
-    {
-        uint8_t tile = offset(-1, 0);
-        if (tile == 0)
-        {
-            test_x = x * maze_dim + physical->radius;
-            rr_component_physical_set_x(physical, test_x);
-            rr_component_physical_set_y(physical, test_y);
-            rr_vector_set(&physical->wall_collision, 1, 0);
-            return;
-        }
-        else
-        {
-            uint8_t left = (tile >> 1) & 1;
-            uint8_t top = tile & 1;
-            uint8_t inverse = ((tile >> 3) & 1);
-            float cx = (x - 1 + left) * maze_dim;
-            float cy = (y + top) * maze_dim;
-            curve_check;
-        }
-    }
-    if (offset(0, -1) != 1 && test_y - y * maze_dim < physical->radius)
-    {
-        uint8_t tile = offset(0, -1);
-        if (tile == 0)
-        {
-            test_y = y * maze_dim + physical->radius;
-            rr_component_physical_set_x(physical, test_x);
-            rr_component_physical_set_y(physical, test_y);
-            rr_vector_set(&physical->wall_collision, 0, 1);
-            return;
-        }
-        else
-        {
-            uint8_t left = (tile >> 1) & 1;
-            uint8_t top = tile & 1;
-            uint8_t inverse = ((tile >> 3) & 1);
-            float cx = (x + left) * maze_dim;
-            float cy = (y - 1 + top) * maze_dim;
-            curve_check;
-        }
-    }
-    if (offset(1, 0) != 1 && (x + 1) * maze_dim - test_x < physical->radius)
-    {
-        uint8_t tile = offset(1, 0);
-        if (tile == 0)
-        {
-            test_x = (x + 1) * maze_dim - physical->radius;
-            rr_component_physical_set_x(physical, test_x);
-            rr_component_physical_set_y(physical, test_y);
-            rr_vector_set(&physical->wall_collision, -1, 0);
-            return;
-        }
-        else
-        {
-            uint8_t left = (tile >> 1) & 1;
-            uint8_t top = tile & 1;
-            uint8_t inverse = ((tile >> 3) & 1);
-            float cx = (x + 1 + left) * maze_dim;
-            float cy = (y + top) * maze_dim;
-            curve_check;
-        }
-    }
-    if (offset(0, 1) != 1 && (y + 1) * maze_dim - test_y < physical->radius)
-    {
-        uint8_t tile = offset(0, 1);
-        if (tile == 0)
-        {
-            test_y = (y + 1) * maze_dim - physical->radius;
-            rr_component_physical_set_x(physical, test_x);
-            rr_component_physical_set_y(physical, test_y);
-            rr_vector_set(&physical->wall_collision, 0, -1);
-            return;
-        }
-        else
-        {
-            uint8_t left = (tile >> 1) & 1;
-            uint8_t top = tile & 1;
-            uint8_t inverse = ((tile >> 3) & 1);
-            float cx = (x + left) * maze_dim;
-            float cy = (y + 1 + top) * maze_dim;
-            curve_check;
-        }
-    }
-    rr_component_physical_set_x(physical, test_x);
-    rr_component_physical_set_y(physical, test_y);
-#undef offset
-#undef curve_check
-}
-
 static void perform_internal_bound_check(struct rr_component_arena *arena,
                                          float test_x, float test_y,
                                          struct rr_component_physical *physical)
 {
     int32_t x = test_x / arena->maze->grid_size;
     int32_t y = test_y / arena->maze->grid_size;
-    perform_internal_bound_check_custom_grid(arena, test_x, test_y, x, y,
-                                             physical);
+    rr_maze_collision_resolve(arena->collision, test_x, test_y, x, y,
+                              physical);
 }
 
 static float reverse_lerp(float test, float start, float end)
@@ -197,10 +59,29 @@ static uint32_t min_of_4(float *arr)
     return min;
 }
 
+static void system_velocity_deferred(struct rr_simulation *, EntityIdx);
+
 static void system_velocity(EntityIdx id, void *simulation)
 {
     struct rr_component_physical *physical =
         rr_simulation_get_physical(simulation, id);
+    // bubbling out of the map kills the flower, which rolls rand() and can
+    // allocate drops. that has to happen in serial order
+    if (physical->bubbling_to_death && !is_dead_flower(simulation, id) &&
+        rr_scheduler_defer(id, system_velocity_deferred))
+        return;
+    // frozen mobs stay put until a flower comes back
+    if (rr_simulation_has_ai(simulation, id) &&
+        rr_simulation_get_ai(simulation, id)->lod == rr_ai_lod_frozen)
+    {
+        if (physical->stun_ticks > 0)
+            --physical->stun_ticks;
+        rr_vector_set(&physical->velocity, 0, 0);
+        rr_vector_set(&physical->acceleration, 0, 0);
+        rr_vector_set(&physical->wall_collision, 0, 0);
+        physical->acceleration_scale = physical->web_slowdown = 1;
+        return;
+    }
     rr_vector_scale(&physical->velocity, physical->friction);
     physical->acceleration_scale *=
         rr_lerp(physical->web_slowdown, 1, physical->slow_resist);
@@ -281,13 +162,9 @@ static void system_velocity(EntityIdx id, void *simulation)
     int32_t before_grid_y = floorf(before_y / arena->maze->grid_size);
     int32_t now_grid_y = floorf(now_y / arena->maze->grid_size);
 #define grid(a, b)                                                             \
-    ((before_grid_x + a < 0 || before_grid_y + b < 0 ||                        \
-      before_grid_x + a >= arena->maze->maze_dim ||                            \
-      before_grid_y + b >= arena->maze->maze_dim)                              \
-         ? 0                                                                   \
-         : rr_component_arena_get_grid(arena, before_grid_x + a,               \
-                                       before_grid_y + b)                      \
-               ->value)
+    (rr_maze_collision_get_shape(arena->collision, before_grid_x + a,          \
+                                 before_grid_y + b)                            \
+         ->tile)
     if (before_grid_x == now_grid_x && before_grid_y == now_grid_y)
         perform_internal_bound_check(arena, now_x, now_y, physical);
     else
@@ -318,9 +195,9 @@ static void system_velocity(EntityIdx id, void *simulation)
                                   (before_grid_x + 1) * arena->maze->grid_size);
                 now_y = rr_fclamp(now_y, before_grid_y * arena->maze->grid_size,
                                   (before_grid_y + 1) * arena->maze->grid_size);
-                perform_internal_bound_check_custom_grid(
-                    arena, now_x, now_y, before_grid_x, before_grid_y,
-                    physical);
+                rr_maze_collision_resolve(arena->collision, now_x, now_y,
+                                          before_grid_x, before_grid_y,
+                                          physical);
             }
             else
             {
@@ -345,8 +222,8 @@ static void system_velocity(EntityIdx id, void *simulation)
                     rr_component_physical_set_x(physical, now_x);
                     rr_component_physical_set_y(physical, now_y);
                 }
-                perform_internal_bound_check_custom_grid(
-                    arena, now_x, now_y, before_grid_x + hor,
+                rr_maze_collision_resolve(
+                    arena->collision, now_x, now_y, before_grid_x + hor,
                     before_grid_y + ver, physical);
             }
         }
@@ -373,14 +250,32 @@ static void system_velocity(EntityIdx id, void *simulation)
                 rr_component_physical_set_x(physical, now_x);
                 rr_component_physical_set_y(physical, now_y);
             }
-            perform_internal_bound_check_custom_grid(
-                arena, now_x, now_y, before_grid_x + hor, before_grid_y + ver,
-                physical);
+            rr_maze_collision_resolve(arena->collision, now_x, now_y,
+                                      before_grid_x + hor, before_grid_y + ver,
+                                      physical);
         }
     }
 }
 
+static void system_velocity_deferred(struct rr_simulation *simulation,
+                                     EntityIdx id)
+{
+    system_velocity(id, simulation);
+}
+
+static void system_velocity_chunk(uint32_t begin, uint32_t end,
+                                  void *simulation)
+{
+    struct rr_simulation *this = simulation;
+    for (uint32_t i = begin; i < end; ++i)
+        system_velocity(this->physical_vector[i], this);
+}
+
 void rr_system_velocity_tick(struct rr_simulation *simulation)
 {
-    rr_simulation_for_each_physical(simulation, simulation, system_velocity);
+    EntityIdx count = simulation->physical_count;
+    rr_scheduler_parallel_for(simulation->scheduler, count, 64, simulation,
+                              system_velocity_chunk);
+    // drops allocated by dying flowers still get moved this tick
+    system_velocity_chunk(count, simulation->physical_count, simulation);
 }
@@ -22,6 +22,7 @@
 #include <string.h>
 
 #include <Server/Client.h>
+#include <Server/EntityCache.h>
 #include <Server/Simulation.h>
 #include <Server/SpatialHash.h>
 #include <Shared/Bitset.h>
@@ -34,42 +35,170 @@
 struct rr_protocol_for_each_function_captures
 {
     struct rr_simulation *simulation;
+    struct rr_entity_cache *cache;
     struct proto_bug *encoder;
     struct rr_component_player_info *player_info;
-    uint8_t *entities_in_view;
+    struct rr_server_client *client;
+    uint8_t *updates_start;
+    EntityHash owner;
+    float view_x;
+    float view_y;
+    float view_extent;
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    uint8_t *removed;
+    uint8_t *added;
+    uint8_t *kept;
+    uint8_t resync;
+    uint8_t over_budget;
+    uint8_t is_creation;
 };
 
-static void rr_simulation_write_entity_function(uint64_t _id, void *_captures)
+// how much an entity's accumulator grows every tick the client sees it.
+// whatever belongs to or targets the client's flower is as urgent as it gets,
+// the rest is weighed by distance from the camera, size and speed
+static uint32_t
+entity_priority(struct rr_protocol_for_each_function_captures *captures,
+                EntityIdx id)
 {
-    EntityIdx id = _id;
-    struct rr_protocol_for_each_function_captures *captures = _captures;
     struct rr_simulation *simulation = captures->simulation;
-    struct proto_bug *encoder = captures->encoder;
-    struct rr_component_player_info *player_info = captures->player_info;
-    uint8_t *new_entities_in_view = captures->entities_in_view;
-
-    proto_bug_write_varuint(encoder, id, "entity update id");
+    if (!rr_simulation_has_physical(simulation, id))
+        return RR_UPDATE_THRESHOLD_MAX;
+    if (rr_simulation_has_relations(simulation, id) &&
+        rr_simulation_get_relations(simulation, id)->root_owner ==
+            captures->owner)
+        return RR_UPDATE_THRESHOLD_MAX;
+    if (rr_simulation_has_ai(simulation, id) &&
+        rr_simulation_get_ai(simulation, id)->target_entity ==
+            captures->player_info->flower_id &&
+        captures->player_info->flower_id != RR_NULL_ENTITY)
+        return RR_UPDATE_THRESHOLD_MAX;
+    struct rr_component_physical *physical =
+        rr_simulation_get_physical(simulation, id);
+    struct rr_vector delta = {physical->x - captures->view_x,
+                              physical->y - captures->view_y};
+    float closeness =
+        1 - rr_vector_get_magnitude(&delta) / captures->view_extent;
+    if (closeness < 0)
+        closeness = 0;
+    float speed = rr_vector_get_magnitude(&physical->velocity);
+    return 32 + 96 * closeness +
+           (physical->radius < 64 ? physical->radius : 64) +
+           (speed < 16 ? speed : 16) * 4;
+}
 
-    uint8_t is_creation = 0;
+static uint8_t entity_dirty(struct rr_simulation *simulation, EntityIdx id)
+{
+    uint32_t component_flags = simulation->entity_tracker[id];
+#define XX(COMPONENT, ID)                                                      \
+    if ((component_flags & (1 << ID)) &&                                       \
+        rr_simulation_get_##COMPONENT(simulation, id)->protocol_state)         \
+        return 1;
+    RR_FOR_EACH_COMPONENT;
+#undef XX
+    return 0;
+}
 
-    if (!rr_bitset_get_bit(player_info->entities_in_view, id))
+// the client's own entities and the arena always go out. everything else
+// waits until its accumulated priority reaches the client's threshold, and
+// nothing else goes out at all once the update is over budget. an entity
+// that changed while it waited gets a full update the next time
+static uint8_t
+should_send(struct rr_protocol_for_each_function_captures *captures,
+            EntityIdx id, uint8_t is_creation)
+{
+    struct rr_simulation *simulation = captures->simulation;
+    struct rr_component_player_info *player_info = captures->player_info;
+    struct rr_server_client *client = captures->client;
+    if (id == 1 || id == player_info->parent_id ||
+        id == (EntityIdx)player_info->flower_id || id == player_info->arena ||
+        rr_simulation_has_player_info(simulation, id))
+        return 1;
+    if (captures->encoder->current - captures->updates_start >=
+        client->update_budget)
+        captures->over_budget = 1;
+    if (is_creation ||
+        (client->update_threshold == 0 && !captures->over_budget))
     {
-        is_creation = 1;
-        rr_bitset_set(player_info->entities_in_view, id);
+        client->entity_priority[id] = 0;
+        return !captures->over_budget;
+    }
+    uint32_t accumulated =
+        client->entity_priority[id] + entity_priority(captures, id);
+    if (!captures->over_budget && accumulated >= client->update_threshold)
+    {
+        client->entity_priority[id] = 0;
+        return 1;
     }
+    client->entity_priority[id] =
+        accumulated < UINT16_MAX ? accumulated : UINT16_MAX;
+    if (entity_dirty(simulation, id))
+        rr_bitset_set(client->entities_stale, id);
+    return 0;
+}
 
+static void write_components(struct rr_simulation *simulation, EntityIdx id,
+                             struct proto_bug *encoder, uint8_t full,
+                             struct rr_component_player_info *player_info)
+{
     uint32_t component_flags = simulation->entity_tracker[id];
-    proto_bug_write_uint8(encoder, is_creation, "upcreate");
     proto_bug_write_varuint(encoder, component_flags, "entity component flags");
 #define XX(COMPONENT, ID)                                                      \
     if (component_flags & (1 << ID))                                           \
         rr_component_##COMPONENT##_write(                                      \
-            rr_simulation_get_##COMPONENT(simulation, id), encoder,            \
-            is_creation, player_info);
+            rr_simulation_get_##COMPONENT(simulation, id), encoder, full,      \
+            player_info);
     RR_FOR_EACH_COMPONENT;
 #undef XX
 }
 
+static void rr_simulation_write_entity_function(uint64_t _id, void *_captures)
+{
+    EntityIdx id = _id;
+    struct rr_protocol_for_each_function_captures *captures = _captures;
+    struct rr_simulation *simulation = captures->simulation;
+    struct proto_bug *encoder = captures->encoder;
+    struct rr_component_player_info *player_info = captures->player_info;
+    uint8_t is_creation = captures->is_creation;
+    if (!should_send(captures, id, is_creation))
+        return;
+    proto_bug_write_varuint(encoder, id, "entity update id");
+    if (is_creation)
+    {
+        rr_bitset_set(player_info->entities_in_view, id);
+        captures->client->entity_generations[id] =
+            simulation->entity_hash_tracker[id];
+    }
+    proto_bug_write_uint8(encoder, is_creation, "upcreate");
+    uint8_t full = is_creation | captures->resync |
+                   rr_bitset_get(captures->client->entities_stale, id);
+    rr_bitset_unset(captures->client->entities_stale, id);
+    // player_info depends on who is looking, everything else can be shared
+    if (rr_simulation_has_player_info(simulation, id))
+    {
+        write_components(simulation, id, encoder, full, player_info);
+        return;
+    }
+    uint32_t key = id * 2 + full;
+    uint32_t size;
+    uint8_t claimed;
+    uint8_t *cached =
+        rr_entity_cache_get(captures->cache, key, &size, &claimed);
+    if (cached != NULL)
+    {
+        memcpy(encoder->current, cached, size);
+        encoder->current += size;
+        ++captures->cache_hits;
+        return;
+    }
+    uint8_t *start = encoder->current;
+    write_components(simulation, id, encoder, full, player_info);
+    ++captures->cache_misses;
+    if (claimed)
+        rr_entity_cache_store(captures->cache, key, start,
+                              encoder->current - start);
+}
+
 struct rr_simulation_find_entities_in_view_for_each_function_captures
 {
     int32_t view_width;
@@ -154,32 +283,45 @@ static void rr_simulation_write_entity_deletions_function(uint64_t _id,
     struct rr_protocol_for_each_function_captures *captures = _captures;
     struct rr_component_player_info *player_info = captures->player_info;
     struct proto_bug *encoder = captures->encoder;
-    uint8_t *new_entities_in_view = captures->entities_in_view;
 
-    if (!rr_bitset_get_bit(new_entities_in_view, id))
+    // a reused id means the entity the client knows is gone
+    uint8_t serverside_delete =
+        !entity_alive(captures->simulation, id) ||
+        captures->client->entity_generations[id] !=
+            captures->simulation->entity_hash_tracker[id];
+    if (serverside_delete == 0)
     {
-        // deletion spotted!
-        uint8_t serverside_delete = !entity_alive(captures->simulation, id);
-        if (serverside_delete == 0)
+        if (rr_simulation_has_drop(captures->simulation, id))
         {
-            if (rr_simulation_has_drop(captures->simulation, id))
-            {
-                struct rr_component_drop *drop =
-                    rr_simulation_get_drop(captures->simulation, id);
-                if (drop->can_be_picked_up_by != player_info->squad)
-                    serverside_delete = 1;
-                else if (drop->picked_up_by & (1 << player_info->squad_pos))
-                    // 1 = in-place deletion, 2 = suck to player
-                    serverside_delete = 2;
-            }
+            struct rr_component_drop *drop =
+                rr_simulation_get_drop(captures->simulation, id);
+            if (drop->can_be_picked_up_by != player_info->squad)
+                serverside_delete = 1;
+            else if (drop->picked_up_by & (1 << player_info->squad_pos))
+                // 1 = in-place deletion, 2 = suck to player
+                serverside_delete = 2;
         }
-        rr_bitset_unset(player_info->entities_in_view, id);
-        proto_bug_write_varuint(encoder, id, "entity deletion id");
-        proto_bug_write_uint8(encoder, serverside_delete, "deletion type");
     }
+    proto_bug_write_varuint(encoder, id, "entity deletion id");
+    proto_bug_write_uint8(encoder, serverside_delete, "deletion type");
+}
+
+// the id was freed and handed out again while updates to this client were
+// dropped, the old entity is deleted and the new one created in its place
+static void check_entity_generation_function(uint64_t _id, void *_captures)
+{
+    EntityIdx id = _id;
+    struct rr_protocol_for_each_function_captures *captures = _captures;
+    if (captures->client->entity_generations[id] ==
+        captures->simulation->entity_hash_tracker[id])
+        return;
+    rr_bitset_unset(captures->kept, id);
+    rr_bitset_set(captures->removed, id);
+    rr_bitset_set(captures->added, id);
 }
 
 void rr_simulation_write_binary(struct rr_simulation *this,
+                                struct rr_entity_cache *cache,
                                 struct proto_bug *encoder,
                                 struct rr_component_player_info *player_info)
 {
@@ -205,23 +347,62 @@ void rr_simulation_write_binary(struct rr_simulation *this,
 
     struct rr_protocol_for_each_function_captures captures;
     captures.simulation = this;
+    captures.cache = cache;
     captures.encoder = encoder;
     captures.player_info = player_info;
-    captures.entities_in_view = new_entities_in_view;
+    captures.client = player_info->client;
+    captures.owner = rr_simulation_get_entity_hash(this, player_info->parent_id);
+    captures.view_x = player_info->camera_x;
+    captures.view_y = player_info->camera_y;
+    captures.view_extent = 1469.0f / player_info->camera_fov;
+    captures.cache_hits = 0;
+    captures.cache_misses = 0;
+    captures.over_budget = 0;
+    captures.resync = player_info->resync_in_view;
+    player_info->resync_in_view = 0;
 
-    rr_bitset_for_each_bit(&player_info->entities_in_view[0],
-                           &player_info->entities_in_view[0] +
-                               (RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT)),
+    // the client's view becomes what stayed in it, creations are added back
+    // as they are sent
+    uint8_t removed[RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT)];
+    uint8_t added[RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT)];
+    uint8_t kept[RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT)];
+    rr_bitset_diff(player_info->entities_in_view, new_entities_in_view,
+                   removed, added, kept, RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT));
+    captures.removed = removed;
+    captures.added = added;
+    captures.kept = kept;
+    rr_bitset_for_each_set(kept, RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT),
+                           &captures, check_entity_generation_function);
+    memcpy(player_info->entities_in_view, kept, sizeof kept);
+    rr_bitset_for_each_set(removed, RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT),
                            &captures,
                            rr_simulation_write_entity_deletions_function);
     proto_bug_write_varuint(
         encoder, RR_NULL_ENTITY,
         "entity deletion id"); // null terminate deletion list
 
-    rr_bitset_for_each_bit(new_entities_in_view,
-                           new_entities_in_view +
-                               (RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT)),
+    captures.updates_start = encoder->current;
+    captures.is_creation = 1;
+    rr_bitset_for_each_set(added, RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT),
                            &captures, rr_simulation_write_entity_function);
+    captures.is_creation = 0;
+    rr_bitset_for_each_set(kept, RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT),
+                           &captures, rr_simulation_write_entity_function);
+    struct rr_server_client *client = player_info->client;
+    if (captures.over_budget)
+    {
+        client->update_threshold += client->update_threshold / 4 + 32;
+        if (client->update_threshold > RR_UPDATE_THRESHOLD_MAX)
+            client->update_threshold = RR_UPDATE_THRESHOLD_MAX;
+    }
+    else if (encoder->current - captures.updates_start <
+             client->update_budget / 2)
+        client->update_threshold -= client->update_threshold / 8 +
+                                    (client->update_threshold != 0);
+    atomic_fetch_add_explicit(&cache->hits, captures.cache_hits,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&cache->misses, captures.cache_misses,
+                              memory_order_relaxed);
     proto_bug_write_varuint(encoder, RR_NULL_ENTITY,
                             "entity update id"); // null terminate update list
     proto_bug_write_varuint(encoder, player_info->parent_id,
@@ -16,9 +16,13 @@
 
 #pragma once
 
+struct rr_entity_cache;
 struct rr_simulation;
 struct proto_bug;
 struct rr_component_player_info;
 
-void rr_simulation_write_binary(struct rr_simulation *, struct proto_bug *,
+// entities' components come from the cache when another client already
+// encoded them this tick
+void rr_simulation_write_binary(struct rr_simulation *,
+                                struct rr_entity_cache *, struct proto_bug *,
                                 struct rr_component_player_info *);
@@ -23,32 +23,177 @@
 #include <Shared/StaticData.h>
 #include <Shared/Utilities.h>
 
+// walker alias tables: a uniform column, then the column's own outcome or
+// its alias
+struct alias_table
+{
+    float probability[rr_mob_id_max];
+    uint8_t alias[rr_mob_id_max];
+    uint8_t count;
+};
+
+// grid difficulties are maze tiles, so whole numbers below this
+#define RARITY_TABLE_COUNT (256)
+
+struct rarity_table
+{
+    struct alias_table outcomes;
+    uint8_t first;
+};
+
+// [biome][difficult]
+static struct alias_table mob_tables[2][2];
+static struct rarity_table rarity_tables[RARITY_TABLE_COUNT];
+
+static void build_alias_table(struct alias_table *this, double const *weights,
+                              uint8_t count)
+{
+    double sum = 0;
+    for (uint8_t i = 0; i < count; ++i)
+        sum += weights[i];
+    double scaled[rr_mob_id_max];
+    uint8_t small[rr_mob_id_max];
+    uint8_t large[rr_mob_id_max];
+    uint8_t small_count = 0;
+    uint8_t large_count = 0;
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        scaled[i] = weights[i] * count / sum;
+        if (scaled[i] < 1)
+            small[small_count++] = i;
+        else
+            large[large_count++] = i;
+    }
+    while (small_count > 0 && large_count > 0)
+    {
+        uint8_t less = small[--small_count];
+        uint8_t more = large[--large_count];
+        this->probability[less] = scaled[less];
+        this->alias[less] = more;
+        scaled[more] += scaled[less] - 1;
+        if (scaled[more] < 1)
+            small[small_count++] = more;
+        else
+            large[large_count++] = more;
+    }
+    // whatever is left is 1 up to rounding
+    while (large_count > 0)
+    {
+        uint8_t i = large[--large_count];
+        this->probability[i] = 1;
+        this->alias[i] = i;
+    }
+    while (small_count > 0)
+    {
+        uint8_t i = small[--small_count];
+        this->probability[i] = 1;
+        this->alias[i] = i;
+    }
+    this->count = count;
+}
+
+static uint8_t sample_alias_table(struct alias_table const *this)
+{
+    double seed = rand() / ((double)RAND_MAX + 1) * this->count;
+    uint8_t column = seed;
+    return seed - column < this->probability[column] ? column
+                                                     : this->alias[column];
+}
+
+static uint8_t is_easy_mob(uint8_t id)
+{
+    return id == rr_mob_id_dakotaraptor || id == rr_mob_id_ornithomimus ||
+           id == rr_mob_id_triceratops || id == rr_mob_id_fern ||
+           id == rr_mob_id_meteor || id == rr_mob_id_golden_meteor;
+}
+
+// chance that get_spawn_rarity picks at most rarity
+static double rarity_cumulative(uint32_t rarity, double difficulty)
+{
+    return pow(1 - (1 - RR_MOB_WAVE_RARITY_COEFFICIENTS[rarity + 1]) * 0.3,
+               pow(1.5, difficulty));
+}
+
+static uint32_t rarity_cap(double difficulty)
+{
+    uint32_t cap = rr_rarity_id_common + (difficulty + 8) / 8;
+    return cap > rr_rarity_id_unique ? rr_rarity_id_unique : cap;
+}
+
+void rr_spawn_tables_init()
+{
+    for (uint8_t biome = 0; biome < 2; ++biome)
+    {
+        double *table = biome == 0 ? RR_HELL_CREEK_MOB_ID_RARITY_COEFFICIENTS
+                                   : RR_GARDEN_MOB_ID_RARITY_COEFFICIENTS;
+        // the table is cumulative and the last id takes whatever is left
+        double weights[rr_mob_id_max];
+        double easy = 0;
+        for (uint8_t id = 0; id < rr_mob_id_max; ++id)
+        {
+            weights[id] = (id == rr_mob_id_max - 1 ? 1 : table[id]) -
+                          (id == 0 ? 0 : table[id - 1]);
+            if (is_easy_mob(id))
+                easy += weights[id];
+        }
+        build_alias_table(&mob_tables[biome][0], weights, rr_mob_id_max);
+        // difficult zones draw up to 10 times until they get a mob that
+        // isn't easy and keep the last draw otherwise
+        double hard_scale = 0;
+        for (uint8_t i = 0; i < 10; ++i)
+            hard_scale = hard_scale * easy + 1;
+        double easy_scale = pow(easy, 9);
+        for (uint8_t id = 0; id < rr_mob_id_max; ++id)
+            weights[id] *= is_easy_mob(id) ? easy_scale : hard_scale;
+        build_alias_table(&mob_tables[biome][1], weights, rr_mob_id_max);
+    }
+    for (uint32_t difficulty = 0; difficulty < RARITY_TABLE_COUNT;
+         ++difficulty)
+    {
+        struct rarity_table *table = &rarity_tables[difficulty];
+        double clamped = difficulty < 1 ? 1 : difficulty;
+        uint32_t cap = rarity_cap(clamped);
+        table->first = cap >= 2 ? cap - 2 : 0;
+        double weights[3];
+        double below = 0;
+        for (uint32_t rarity = table->first; rarity < cap; ++rarity)
+        {
+            // the seed is below 1, whatever the power gives
+            double at_most = fmin(rarity_cumulative(rarity, clamped), 1);
+            weights[rarity - table->first] = fmax(at_most - below, 0);
+            below = fmax(at_most, below);
+        }
+        weights[cap - table->first] = fmax(1 - below, 0);
+        build_alias_table(&table->outcomes, weights, cap - table->first + 1);
+    }
+}
+
 uint32_t get_spawn_rarity(float difficulty)
 {
     if (difficulty < 1)
         difficulty = 1;
+    if (difficulty < RARITY_TABLE_COUNT && difficulty == (uint32_t)difficulty)
+    {
+        struct rarity_table *table = &rarity_tables[(uint32_t)difficulty];
+        return table->first + sample_alias_table(&table->outcomes);
+    }
     double rarity_seed = rr_frand();
-    uint32_t rarity_cap = rr_rarity_id_common + (difficulty + 8) / 8;
-    if (rarity_cap > rr_rarity_id_unique)
-        rarity_cap = rr_rarity_id_unique;
-    uint32_t rarity = rarity_cap >= 2 ? rarity_cap - 2 : 0;
-    for (; rarity < rarity_cap; ++rarity)
-        if (pow(1 - (1 - RR_MOB_WAVE_RARITY_COEFFICIENTS[rarity + 1]) * 0.3,
-                pow(1.5, difficulty)) >= rarity_seed)
+    uint32_t cap = rarity_cap(difficulty);
+    uint32_t rarity = cap >= 2 ? cap - 2 : 0;
+    for (; rarity < cap; ++rarity)
+        if (rarity_cumulative(rarity, difficulty) >= rarity_seed)
             break;
     return rarity;
 }
 
 uint8_t get_spawn_id(uint8_t biome, struct rr_maze_grid *zone)
 {
-    double *table = biome == 0 ? RR_HELL_CREEK_MOB_ID_RARITY_COEFFICIENTS
-                               : RR_GARDEN_MOB_ID_RARITY_COEFFICIENTS;
-    double seed = rr_frand();
-    uint8_t id = 0;
-    for (; id < rr_mob_id_max - 1; ++id)
-        if (seed <= table[id])
-            break;
-    return id;
+    return sample_alias_table(&mob_tables[biome != 0][0]);
+}
+
+uint8_t get_difficult_spawn_id(uint8_t biome)
+{
+    return sample_alias_table(&mob_tables[biome != 0][1]);
 }
 
 int should_spawn_at(uint8_t id, uint8_t rarity)
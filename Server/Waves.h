@@ -20,7 +20,12 @@
 
 struct rr_maze_grid;
 
+// builds the alias tables the spawn functions sample from, called by
+// rr_static_data_init
+void rr_spawn_tables_init();
 uint32_t get_spawn_rarity(float);
 uint8_t get_spawn_id(uint8_t, struct rr_maze_grid *);
+// what get_spawn_id rerolled up to 10 times to avoid the easy mobs gives
+uint8_t get_difficult_spawn_id(uint8_t);
 
 int should_spawn_at(uint8_t, uint8_t);
@@ -16,6 +16,12 @@
 
 #include <Shared/Bitset.h>
 
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 uint8_t rr_bitset_get_bit(uint8_t *a, uint64_t i)
 {
     // return a[i];
@@ -139,3 +145,77 @@ void rr_bitset_for_each_bit(uint8_t *start, uint8_t *end, void *captures,
         start++;
     }
 }
+
+// bit i of a bitset is bit i % 64 of its (i / 64)th little endian word
+static inline uint64_t load_word(uint8_t const *bytes)
+{
+    uint64_t word;
+    memcpy(&word, bytes, sizeof word);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+static inline void store_word(uint8_t *bytes, uint64_t word)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    memcpy(bytes, &word, sizeof word);
+}
+
+void rr_bitset_diff(uint8_t *old, uint8_t const *new, uint8_t *removed,
+                    uint8_t *added, uint8_t *kept, uint64_t size)
+{
+    uint64_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((__m128i const *)(old + i));
+        __m128i b = _mm_loadu_si128((__m128i const *)(new + i));
+        _mm_storeu_si128((__m128i *)(removed + i), _mm_andnot_si128(b, a));
+        _mm_storeu_si128((__m128i *)(added + i), _mm_andnot_si128(a, b));
+        _mm_storeu_si128((__m128i *)(kept + i), _mm_and_si128(a, b));
+    }
+#endif
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t a = load_word(old + i);
+        uint64_t b = load_word(new + i);
+        store_word(removed + i, a & ~b);
+        store_word(added + i, b & ~a);
+        store_word(kept + i, a & b);
+    }
+    for (; i < size; ++i)
+    {
+        uint8_t a = old[i];
+        uint8_t b = new[i];
+        removed[i] = a & ~b;
+        added[i] = b & ~a;
+        kept[i] = a & b;
+    }
+}
+
+uint64_t rr_bitset_count(uint8_t const *bitset, uint64_t size)
+{
+    uint64_t count = 0;
+    uint64_t i = 0;
+    for (; i + 8 <= size; i += 8)
+        count += __builtin_popcountll(load_word(bitset + i));
+    for (; i < size; ++i)
+        count += __builtin_popcount(bitset[i]);
+    return count;
+}
+
+void rr_bitset_for_each_set(uint8_t const *bitset, uint64_t size,
+                            void *captures, void (*cb)(uint64_t, void *))
+{
+    uint64_t i = 0;
+    for (; i + 8 <= size; i += 8)
+        for (uint64_t word = load_word(bitset + i); word; word &= word - 1)
+            cb(i * 8 + __builtin_ctzll(word), captures);
+    for (; i < size; ++i)
+        for (uint8_t byte = bitset[i]; byte; byte &= byte - 1)
+            cb(i * 8 + __builtin_ctz(byte), captures);
+}
@@ -34,3 +34,15 @@ void rr_bitset_for_each_bit(uint8_t *start, uint8_t *end, void *,
                             void (*cb)(uint64_t, void *));
 void rr_bitset_for_each_bit_until(uint8_t *start, uint8_t *end, void *,
                                   uint8_t (*cb)(uint64_t, void *));
+
+// the rest works on whole words, sizes are in bytes like RR_BITSET_ROUND
+
+// removed = old & ~new, added = new & ~old and kept = old & new in one pass.
+// any of the outputs may be old itself
+void rr_bitset_diff(uint8_t *old, uint8_t const *new, uint8_t *removed,
+                    uint8_t *added, uint8_t *kept, uint64_t size);
+uint64_t rr_bitset_count(uint8_t const *, uint64_t size);
+// ascending like rr_bitset_for_each_bit, but every word is read once before
+// its bits are visited so cb must not count on seeing bits it sets itself
+void rr_bitset_for_each_set(uint8_t const *, uint64_t size, void *,
+                            void (*cb)(uint64_t, void *));
@@ -46,6 +46,20 @@ enum rr_ai_state
     rr_ai_state_returning_to_owner
 };
 
+// how often a mob's ai runs, picked every tick from the player counts of
+// the maze cells around it. see Server/System/Ai.c
+enum rr_ai_lod
+{
+    rr_ai_lod_full,
+    // ai every ai_lod_interval ticks, still moves every tick
+    rr_ai_lod_reduced,
+    // neither ai nor movement
+    rr_ai_lod_frozen,
+    rr_ai_lod_max
+};
+
+#define RR_AI_LOD_INTERVAL (4)
+
 struct rr_component_ai
 {
     RR_SERVER_ONLY(uint32_t ticks_until_next_action;)
@@ -56,6 +70,9 @@ struct rr_component_ai
     RR_SERVER_ONLY(uint8_t protocol_state;)
     RR_SERVER_ONLY(uint8_t has_prediction;)
     RR_SERVER_ONLY(float aggro_range;)
+    // ai tick the ai last ran on, timers catch up on the ticks in between
+    RR_SERVER_ONLY(uint32_t lod_tick;)
+    RR_SERVER_ONLY(uint8_t lod;)
 };
 
 void rr_component_ai_init(struct rr_component_ai *, struct rr_simulation *);
@@ -70,19 +70,22 @@ void rr_component_arena_free(struct rr_component_arena *this,
             physical->velocity.y = sinf(angle) * v;
         }
     }
-    free(this->spatial_hash.cells);
+    rr_spatial_hash_free(&this->spatial_hash);
 #endif
 }
 
 #ifdef RR_SERVER
+#include <Server/MazeCollision.h>
 #include <Shared/StaticData.h>
 
 void rr_component_arena_spatial_hash_init(struct rr_component_arena *this,
                                           struct rr_simulation *simulation)
 {
-    this->maze = &RR_MAZES[this->biome];
+    this->maze = &simulation->mazes[this->biome];
+    this->collision = &RR_MAZE_COLLISIONS[this->biome];
     rr_spatial_hash_init(&this->spatial_hash, simulation,
-                         this->maze->maze_dim * this->maze->grid_size);
+                         this->maze->maze_dim * this->maze->grid_size,
+                         SPATIAL_HASH_GRID_SIZE);
 }
 
 struct rr_maze_grid *
@@ -25,6 +25,7 @@ struct proto_bug;
 RR_CLIENT_ONLY(struct rr_renderer;)
 RR_SERVER_ONLY(struct rr_component_player_info;)
 RR_SERVER_ONLY(struct rr_maze_declaration;)
+RR_SERVER_ONLY(struct rr_maze_collision;)
 
 #ifdef RR_SERVER
 #include <Server/SpatialHash.h>
@@ -41,6 +42,7 @@ struct rr_component_arena
     RR_SERVER_ONLY(uint8_t player_entered;)
     RR_SERVER_ONLY(EntityIdx mob_count;)
     RR_SERVER_ONLY(struct rr_maze_declaration *maze;)
+    RR_SERVER_ONLY(struct rr_maze_collision *collision;)
     RR_SERVER_ONLY(struct rr_spatial_hash spatial_hash;)
     RR_SERVER_ONLY(uint8_t pvp;)
 };
@@ -56,23 +56,30 @@ void rr_component_health_free(struct rr_component_health *this,
 
 #include <Shared/StaticData.h>
 
+static void write_fields(struct rr_component_health *this,
+                         struct proto_bug *encoder, uint64_t state)
+{
+#define X(NAME, TYPE) RR_ENCODE_PUBLIC_FIELD(NAME, TYPE);
+    FOR_EACH_PUBLIC_FIELD
+#undef X
+}
+
 void rr_component_health_write(struct rr_component_health *this,
                                struct proto_bug *encoder, int is_creation,
                                struct rr_component_player_info *client)
 {
     uint64_t state = this->protocol_state | (state_flags_all * is_creation);
     proto_bug_write_varuint(encoder, state, "health component state");
-    float tmp_health = this->health;
-    float tmp_max = this->max_health;
-    if (this->flags & 1)
+    if (!(this->flags & 1))
     {
-        this->health = this->max_health = 0;
+        write_fields(this, encoder, state);
+        return;
     }
-#define X(NAME, TYPE) RR_ENCODE_PUBLIC_FIELD(NAME, TYPE);
-    FOR_EACH_PUBLIC_FIELD
-#undef X
-    this->health = tmp_health;
-    this->max_health = tmp_max;
+    // hidden health goes out as 0. written from a copy since other clients
+    // can be encoding this component at the same time
+    struct rr_component_health hidden = *this;
+    hidden.health = hidden.max_health = 0;
+    write_fields(&hidden, encoder, state);
 }
 
 void rr_component_health_do_damage(struct rr_simulation *simulation,
@@ -123,9 +123,9 @@ void rr_component_mob_free(struct rr_component_mob *this,
                                       physical->y - flower_physical->y};
             if (rr_vector_magnitude_cmp(&delta, 2000) == 1)
                 continue;
-            ++member->client->mob_gallery[this->id][this->rarity];
-            rr_server_client_write_to_api(member->client);
-            rr_server_client_write_account(member->client);
+            rr_server_client_set_mob_gallery(
+                member->client, this->id, this->rarity,
+                member->client->mob_gallery[this->id][this->rarity] + 1);
         }
 
         uint8_t spawn_ids[4] = {};
@@ -16,6 +16,7 @@
 
 #include <Shared/Component/Physical.h>
 
+#include <math.h>
 #include <string.h>
 
 #include <Shared/pb.h>
@@ -26,15 +27,11 @@ enum
     state_flags_radius = 0b00010,
     state_flags_angle = 0b00100,
     state_flags_x = 0b01000,
-    state_flags_all = 0b01111
+    state_flags_all = 0b01111,
+    // x and y are absolute instead of deltas
+    state_flags_absolute = 0b10000
 };
 
-#define FOR_EACH_PUBLIC_FIELD                                                  \
-    X(angle, float32)                                                          \
-    X(radius, float32)                                                         \
-    X(x, float32)                                                              \
-    X(y, float32)
-
 void rr_component_physical_init(struct rr_component_physical *this,
                                 struct rr_simulation *simulation)
 {
@@ -51,15 +48,64 @@ void rr_component_physical_free(struct rr_component_physical *this,
 }
 
 #ifdef RR_SERVER
+static int32_t quantize_position(float position)
+{
+    return lroundf(position * RR_PHYSICAL_POSITION_SCALE);
+}
+
+static uint16_t quantize_angle(float angle)
+{
+    return lroundf(fmodf(angle, 2 * M_PI) *
+                   (RR_PHYSICAL_ANGLE_STEPS / (2 * M_PI))) &
+           (RR_PHYSICAL_ANGLE_STEPS - 1);
+}
+
+// zigzag so small negative deltas stay small varuints
+static uint64_t encode_delta(int32_t delta)
+{
+    return ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+}
+
 void rr_component_physical_write(struct rr_component_physical *this,
                                  struct proto_bug *encoder, int is_creation,
                                  struct rr_component_player_info *client)
 {
     uint64_t state = this->protocol_state | (state_flags_all * is_creation);
+    int32_t x = quantize_position(this->x);
+    int32_t y = quantize_position(this->y);
+    uint16_t angle = quantize_angle(this->angle);
+    int32_t base_x = 0;
+    int32_t base_y = 0;
+    if (is_creation)
+        state |= state_flags_absolute;
+    else
+    {
+        // changes below the quantization step don't need to go out
+        if (x == this->sent_x)
+            state &= ~state_flags_x;
+        if (y == this->sent_y)
+            state &= ~state_flags_y;
+        if (angle == this->sent_angle)
+            state &= ~state_flags_angle;
+        base_x = this->sent_x;
+        base_y = this->sent_y;
+    }
     proto_bug_write_varuint(encoder, state, "physical component state");
-#define X(NAME, TYPE) RR_ENCODE_PUBLIC_FIELD(NAME, TYPE);
-    FOR_EACH_PUBLIC_FIELD
-#undef X
+    if (state & state_flags_angle)
+        proto_bug_write_varuint(encoder, angle, "field angle");
+    if (state & state_flags_radius)
+        proto_bug_write_float32(encoder, this->radius, "field radius");
+    if (state & state_flags_x)
+        proto_bug_write_varuint(encoder, encode_delta(x - base_x), "field x");
+    if (state & state_flags_y)
+        proto_bug_write_varuint(encoder, encode_delta(y - base_y), "field y");
+}
+
+void rr_component_physical_mark_sent(struct rr_component_physical *this)
+{
+    this->sent_x = quantize_position(this->x);
+    this->sent_y = quantize_position(this->y);
+    this->sent_angle = quantize_angle(this->angle);
 }
 
 RR_DEFINE_PUBLIC_FIELD(physical, float, x)
@@ -69,13 +115,62 @@ RR_DEFINE_PUBLIC_FIELD(physical, float, radius)
 #endif
 
 #ifdef RR_CLIENT
+static int32_t decode_delta(uint64_t delta)
+{
+    return (int32_t)(delta >> 1) ^ -(int32_t)(delta & 1);
+}
+
 void rr_component_physical_read(struct rr_component_physical *this,
                                 struct proto_bug *encoder)
 {
     uint64_t state =
         proto_bug_read_varuint(encoder, "physical component state");
-#define X(NAME, TYPE) RR_DECODE_PUBLIC_FIELD(NAME, TYPE);
-    FOR_EACH_PUBLIC_FIELD
-#undef X
+    if (state & state_flags_absolute)
+        this->received_x = this->received_y = 0;
+    if (state & state_flags_angle)
+        this->angle = proto_bug_read_varuint(encoder, "field angle") *
+                      (2 * M_PI / RR_PHYSICAL_ANGLE_STEPS);
+    if (state & state_flags_radius)
+        this->radius = proto_bug_read_float32(encoder, "field radius");
+    if (state & state_flags_x)
+    {
+        this->received_x +=
+            decode_delta(proto_bug_read_varuint(encoder, "field x"));
+        this->x = (float)this->received_x / RR_PHYSICAL_POSITION_SCALE;
+    }
+    if (state & state_flags_y)
+    {
+        this->received_y +=
+            decode_delta(proto_bug_read_varuint(encoder, "field y"));
+        this->y = (float)this->received_y / RR_PHYSICAL_POSITION_SCALE;
+    }
 }
-#endif
\ No newline at end of file
+
+static void push_snapshot(struct rr_component_physical *this,
+                          struct rr_physical_snapshot *snapshot)
+{
+    if (this->snapshot_count < RR_PHYSICAL_SNAPSHOT_COUNT)
+        ++this->snapshot_count;
+    this->snapshot_head =
+        (this->snapshot_head + 1) % RR_PHYSICAL_SNAPSHOT_COUNT;
+    this->snapshots[this->snapshot_head] = *snapshot;
+}
+
+void rr_component_physical_push_snapshot(struct rr_component_physical *this,
+                                         uint32_t tick)
+{
+    struct rr_physical_snapshot snapshot = {tick, this->x, this->y,
+                                            this->angle, this->radius};
+    if (this->snapshot_count > 0)
+    {
+        struct rr_physical_snapshot *newest =
+            &this->snapshots[this->snapshot_head];
+        if (newest->tick == tick)
+        {
+            *newest = snapshot;
+            return;
+        }
+    }
+    push_snapshot(this, &snapshot);
+}
+#endif
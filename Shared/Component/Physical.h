@@ -22,11 +22,28 @@
 #include <Shared/Utilities.h>
 #include <Shared/Vector.h>
 
+// positions go out as fixed point deltas in steps of
+// 1 / RR_PHYSICAL_POSITION_SCALE, angles in steps of 1 / RR_PHYSICAL_ANGLE_STEPS
+// of a turn
+#define RR_PHYSICAL_POSITION_SCALE (16)
+#define RR_PHYSICAL_ANGLE_STEPS (4096)
+// server ticks of state the client keeps around to interpolate through
+#define RR_PHYSICAL_SNAPSHOT_COUNT (8)
+
 struct rr_simulation;
 struct proto_bug;
 
 RR_SERVER_ONLY(struct rr_component_player_info;)
 
+struct rr_physical_snapshot
+{
+    uint32_t tick;
+    float x;
+    float y;
+    float angle;
+    float radius;
+};
+
 struct rr_component_physical
 {
     struct rr_vector velocity;
@@ -65,10 +82,20 @@ struct rr_component_physical
     RR_CLIENT_ONLY(uint8_t deletion_type : 2;)
     RR_CLIENT_ONLY(uint8_t animation_started : 1;)
     RR_SERVER_ONLY(uint8_t protocol_state;)
+    // quantized values every client with this entity in view has, deltas are
+    // taken against these
+    RR_SERVER_ONLY(int32_t sent_x;)
+    RR_SERVER_ONLY(int32_t sent_y;)
+    RR_SERVER_ONLY(uint16_t sent_angle;)
+    RR_CLIENT_ONLY(int32_t received_x;)
+    RR_CLIENT_ONLY(int32_t received_y;)
+    // ring of received states, snapshot_head is the newest
+    RR_CLIENT_ONLY(
+        struct rr_physical_snapshot snapshots[RR_PHYSICAL_SNAPSHOT_COUNT];)
+    RR_CLIENT_ONLY(uint8_t snapshot_head;)
+    RR_CLIENT_ONLY(uint8_t snapshot_count;)
     EntityIdx parent_id;
     RR_SERVER_ONLY(EntityIdx arena;)
-    RR_SERVER_ONLY(uint16_t colliding_with_size;)
-    RR_SERVER_ONLY(EntityIdx colliding_with[RR_MAX_COLLISION_COUNT];)
 };
 
 void rr_component_physical_init(struct rr_component_physical *,
@@ -81,6 +108,12 @@ RR_SERVER_ONLY(void rr_component_physical_write(
                    struct rr_component_player_info *);)
 RR_CLIENT_ONLY(void rr_component_physical_read(struct rr_component_physical *,
                                                struct proto_bug *);)
+// records the current state as the one of server tick
+RR_CLIENT_ONLY(void rr_component_physical_push_snapshot(
+                   struct rr_component_physical *, uint32_t);)
+// called once every client got this tick's update
+RR_SERVER_ONLY(void rr_component_physical_mark_sent(
+                   struct rr_component_physical *);)
 
 RR_DECLARE_PUBLIC_FIELD(physical, float, x)
 RR_DECLARE_PUBLIC_FIELD(physical, float, y)
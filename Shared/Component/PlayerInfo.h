@@ -91,6 +91,9 @@ struct rr_component_player_info
     uint8_t squad;
     uint8_t slot_count;
     RR_SERVER_ONLY(uint8_t *entities_in_view;)
+    // set when an update was dropped, the next one resends every field of the
+    // entities that were already in view
+    RR_SERVER_ONLY(uint8_t resync_in_view;)
     RR_SERVER_ONLY(struct rr_id_rarity_pair
                        drops_this_tick[1];) // yes, it's limited to 1. if the
                                             // player poicks up more than that
@@ -16,13 +16,27 @@
 
 #include <Shared/Crypto.h>
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <Shared/MagicNumber.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHACHA20_X86
+#include <immintrin.h>
+#endif
+
 // https://github.com/shiffthq/chacha20/blob/master/src/chacha20.c
+// the round order and the constants differ from rfc 7539 on purpose and have
+// to stay that way, clients decrypt with the same cipher
+static inline uint32_t u8t32le(uint8_t const p[4])
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
 static inline void u32t8le(uint32_t v, uint8_t p[4])
 {
     p[0] = v & 0xff;
@@ -31,17 +45,6 @@ static inline void u32t8le(uint32_t v, uint8_t p[4])
     p[3] = (v >> 24) & 0xff;
 }
 
-static inline uint32_t u8t32le(uint8_t p[4])
-{
-    uint32_t value = p[3];
-
-    value = (value << 8) | p[2];
-    value = (value << 8) | p[1];
-    value = (value << 8) | p[0];
-
-    return value;
-}
-
 static inline uint32_t rotl32(uint32_t x, int n)
 {
     // http://blog.regehr.org/archives/1063
@@ -49,60 +52,195 @@ static inline uint32_t rotl32(uint32_t x, int n)
 }
 
 // https://tools.ietf.org/html/rfc7539#section-2.1
-static void chacha20_quarterround(uint32_t *x, int a, int b, int c, int d)
+#define QUARTERROUND(x, a, b, c, d, ADD, XOR, ROTL)                            \
+    x[a] = ADD(x[a], x[b]);                                                    \
+    x[d] = ROTL(XOR(x[d], x[a]), 16);                                          \
+    x[c] = ADD(x[c], x[d]);                                                    \
+    x[b] = ROTL(XOR(x[b], x[c]), 12);                                          \
+    x[a] = ADD(x[a], x[b]);                                                    \
+    x[d] = ROTL(XOR(x[d], x[a]), 8);                                           \
+    x[c] = ADD(x[c], x[d]);                                                    \
+    x[b] = ROTL(XOR(x[b], x[c]), 7);
+
+// the same for every width, x holds one word of as many blocks as fit
+#define DOUBLEROUNDS(x, ADD, XOR, ROTL)                                        \
+    for (int round = 0; round < 10; ++round)                                   \
+    {                                                                          \
+        QUARTERROUND(x, 0, 4, 8, 12, ADD, XOR, ROTL)                           \
+        QUARTERROUND(x, 1, 5, 9, 13, ADD, XOR, ROTL)                           \
+        QUARTERROUND(x, 2, 6, 10, 14, ADD, XOR, ROTL)                          \
+        QUARTERROUND(x, 3, 7, 11, 15, ADD, XOR, ROTL)                          \
+        QUARTERROUND(x, 1, 5, 10, 15, ADD, XOR, ROTL)                          \
+        QUARTERROUND(x, 1, 6, 11, 14, ADD, XOR, ROTL)                          \
+        QUARTERROUND(x, 2, 7, 8, 13, ADD, XOR, ROTL)                           \
+        QUARTERROUND(x, 3, 4, 9, 14, ADD, XOR, ROTL)                           \
+    }
+
+#define SCALAR_ADD(a, b) ((a) + (b))
+#define SCALAR_XOR(a, b) ((a) ^ (b))
+
+// one block, whole words at a time. the tail of the message is the only
+// place bytes are handled one by one
+static void chacha20_xor_block(uint32_t const s[16], uint8_t *data,
+                               uint64_t size)
 {
-    x[a] += x[b];
-    x[d] = rotl32(x[d] ^ x[a], 16);
-    x[c] += x[d];
-    x[b] = rotl32(x[b] ^ x[c], 12);
-    x[a] += x[b];
-    x[d] = rotl32(x[d] ^ x[a], 8);
-    x[c] += x[d];
-    x[b] = rotl32(x[b] ^ x[c], 7);
+    uint32_t x[16];
+    memcpy(x, s, sizeof x);
+    DOUBLEROUNDS(x, SCALAR_ADD, SCALAR_XOR, rotl32)
+    for (int i = 0; i < 16; ++i)
+        x[i] += s[i];
+    if (size >= 64)
+    {
+        for (int i = 0; i < 16; ++i)
+            u32t8le(u8t32le(data + i * 4) ^ x[i], data + i * 4);
+        return;
+    }
+    uint8_t block[64];
+    for (int i = 0; i < 16; ++i)
+        u32t8le(x[i], block + i * 4);
+    for (uint64_t i = 0; i < size; ++i)
+        data[i] ^= block[i];
 }
 
-static void chacha20_serialize(uint32_t in[16], uint8_t output[64])
+#ifdef CHACHA20_X86
+#define SSE2_ROTL(v, n)                                                        \
+    _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+// 4 consecutive words of 4 blocks in, 4 words of one block per vector out
+#define SSE2_TRANSPOSE(a, b, c, d)                                             \
+    {                                                                          \
+        __m128i t0 = _mm_unpacklo_epi32(a, b);                                 \
+        __m128i t1 = _mm_unpackhi_epi32(a, b);                                 \
+        __m128i t2 = _mm_unpacklo_epi32(c, d);                                 \
+        __m128i t3 = _mm_unpackhi_epi32(c, d);                                 \
+        a = _mm_unpacklo_epi64(t0, t2);                                        \
+        b = _mm_unpackhi_epi64(t0, t2);                                        \
+        c = _mm_unpacklo_epi64(t1, t3);                                        \
+        d = _mm_unpackhi_epi64(t1, t3);                                        \
+    }
+
+// 4 blocks per iteration, every lane is a block
+static void chacha20_xor_sse2(uint32_t const s[16], uint8_t *data,
+                              uint64_t count)
 {
-    int i;
-    for (i = 0; i < 16; i++)
+    __m128i in[16];
+    for (int i = 0; i < 16; ++i)
+        in[i] = _mm_set1_epi32(s[i]);
+    in[12] = _mm_add_epi32(in[12], _mm_setr_epi32(0, 1, 2, 3));
+    for (; count > 0; --count, data += 256)
     {
-        u32t8le(in[i], output + (i << 2));
+        __m128i x[16];
+        memcpy(x, in, sizeof x);
+        DOUBLEROUNDS(x, _mm_add_epi32, _mm_xor_si128, SSE2_ROTL)
+        for (int i = 0; i < 16; ++i)
+            x[i] = _mm_add_epi32(x[i], in[i]);
+        for (int i = 0; i < 16; i += 4)
+        {
+            SSE2_TRANSPOSE(x[i], x[i + 1], x[i + 2], x[i + 3])
+            for (int block = 0; block < 4; ++block)
+            {
+                __m128i *word = (__m128i *)(data + block * 64 + i * 4);
+                _mm_storeu_si128(word, _mm_xor_si128(_mm_loadu_si128(word),
+                                                     x[i + block]));
+            }
+        }
+        in[12] = _mm_add_epi32(in[12], _mm_set1_epi32(4));
     }
 }
 
-static void chacha20_block(uint32_t in[16], uint8_t out[64], int num_rounds)
-{
-    int i;
-    uint32_t x[16];
+#define AVX2_ROTL(v, n)                                                        \
+    _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
 
-    memcpy(x, in, sizeof(uint32_t) * 16);
+static inline __attribute__((target("avx2"))) void
+avx2_xor_store(uint8_t *data, __m256i words)
+{
+    __m256i *address = (__m256i *)data;
+    _mm256_storeu_si256(address,
+                        _mm256_xor_si256(_mm256_loadu_si256(address), words));
+}
 
-    for (i = num_rounds; i > 0; i -= 2)
+// 8 blocks per iteration
+static __attribute__((target("avx2"))) void
+chacha20_xor_avx2(uint32_t const s[16], uint8_t *data, uint64_t count)
+{
+    __m256i in[16];
+    for (int i = 0; i < 16; ++i)
+        in[i] = _mm256_set1_epi32(s[i]);
+    in[12] =
+        _mm256_add_epi32(in[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    for (; count > 0; --count, data += 512)
     {
-        chacha20_quarterround(x, 0, 4, 8, 12);
-        chacha20_quarterround(x, 1, 5, 9, 13);
-        chacha20_quarterround(x, 2, 6, 10, 14);
-        chacha20_quarterround(x, 3, 7, 11, 15);
-        chacha20_quarterround(x, 1, 5, 10, 15);
-        chacha20_quarterround(x, 1, 6, 11, 14);
-        chacha20_quarterround(x, 2, 7, 8, 13);
-        chacha20_quarterround(x, 3, 4, 9, 14);
+        __m256i x[16];
+        memcpy(x, in, sizeof x);
+        DOUBLEROUNDS(x, _mm256_add_epi32, _mm256_xor_si256, AVX2_ROTL)
+        for (int i = 0; i < 16; ++i)
+            x[i] = _mm256_add_epi32(x[i], in[i]);
+        // 8 words of 8 blocks to 8 words per block. the unpacks work on
+        // each 128 bit half, so blocks 0-3 end up in the low and 4-7 in the
+        // high halves
+        for (int i = 0; i < 16; i += 8)
+        {
+            __m256i t[8];
+            __m256i u[8];
+            for (int j = 0; j < 8; j += 2)
+            {
+                t[j] = _mm256_unpacklo_epi32(x[i + j], x[i + j + 1]);
+                t[j + 1] = _mm256_unpackhi_epi32(x[i + j], x[i + j + 1]);
+            }
+            for (int j = 0; j < 8; j += 4)
+            {
+                u[j] = _mm256_unpacklo_epi64(t[j], t[j + 2]);
+                u[j + 1] = _mm256_unpackhi_epi64(t[j], t[j + 2]);
+                u[j + 2] = _mm256_unpacklo_epi64(t[j + 1], t[j + 3]);
+                u[j + 3] = _mm256_unpackhi_epi64(t[j + 1], t[j + 3]);
+            }
+            for (int block = 0; block < 4; ++block)
+            {
+                avx2_xor_store(data + block * 64 + i * 4,
+                               _mm256_permute2x128_si256(u[block], u[block + 4],
+                                                         0x20));
+                avx2_xor_store(data + (block + 4) * 64 + i * 4,
+                               _mm256_permute2x128_si256(u[block], u[block + 4],
+                                                         0x31));
+            }
+        }
+        in[12] = _mm256_add_epi32(in[12], _mm256_set1_epi32(8));
     }
+}
+#endif
 
-    for (i = 0; i < 16; i++)
+// s[12] is the block counter and wraps around like it always did
+static void chacha20_xor(uint32_t s[16], uint8_t *data, uint64_t size)
+{
+#ifdef CHACHA20_X86
+    if (size >= 512 && __builtin_cpu_supports("avx2"))
     {
-        x[i] += in[i];
+        uint64_t count = size / 512;
+        chacha20_xor_avx2(s, data, count);
+        s[12] += count * 8;
+        data += count * 512;
+        size -= count * 512;
+    }
+    if (size >= 256)
+    {
+        uint64_t count = size / 256;
+        chacha20_xor_sse2(s, data, count);
+        s[12] += count * 4;
+        data += count * 256;
+        size -= count * 256;
+    }
+#endif
+    for (; size > 0; data += 64, size -= size < 64 ? size : 64)
+    {
+        chacha20_xor_block(s, data, size);
+        ++s[12];
     }
-
-    chacha20_serialize(x, out);
 }
 
 // https://tools.ietf.org/html/rfc7539#section-2.3
-static void chacha20_init_state(uint32_t s[16], uint8_t key[32],
-                                uint32_t counter, uint8_t nonce[12])
+static void chacha20_init_state(uint32_t s[16], uint8_t const key[32],
+                                uint32_t counter, uint8_t const nonce[12])
 {
-    int i;
-
     // refer:
     // https://dxr.mozilla.org/mozilla-beta/source/security/nss/lib/freebl/chacha20.c
     // convert magic number to string: "expand 32-byte k"
@@ -110,44 +248,11 @@ static void chacha20_init_state(uint32_t s[16], uint8_t key[32],
     s[1] = 0x3320646e ^ 0xfacefeed;
     s[2] = 0x79622d32 ^ 0xdeadbeef;
     s[3] = 0x6b206574 ^ 0xbeefdaed;
-
-    for (i = 0; i < 8; i++)
-    {
+    for (int i = 0; i < 8; i++)
         s[4 + i] = u8t32le(key + i * 4);
-    }
-
     s[12] = counter;
-
-    for (i = 0; i < 3; i++)
-    {
+    for (int i = 0; i < 3; i++)
         s[13 + i] = u8t32le(nonce + i * 4);
-    }
-}
-
-static void ChaCha20XOR(uint8_t key[32], uint32_t counter, uint8_t nonce[12],
-                        uint8_t *in, uint8_t *out, int inlen)
-{
-    int i, j;
-
-    uint32_t s[16];
-    uint8_t block[64];
-
-    chacha20_init_state(s, key, counter, nonce);
-
-    for (i = 0; i < inlen; i += 64)
-    {
-        chacha20_block(s, block, 20);
-        s[12]++;
-
-        for (j = i; j < i + 64; j++)
-        {
-            if (j >= inlen)
-            {
-                break;
-            }
-            out[j] = in[j] ^ block[j - i];
-        }
-    }
 }
 
 uint64_t rr_get_hash(uint64_t x)
@@ -159,14 +264,23 @@ uint64_t rr_get_hash(uint64_t x)
     return x;
 }
 
-static uint64_t g_random_seed = 123123213231231123;
+static _Atomic uint64_t g_random_seed = 123123213231231123;
 
-uint64_t rr_get_rand() { return g_random_seed = rr_get_hash(g_random_seed); }
+// instance threads and the network thread all draw from the same sequence
+uint64_t rr_get_rand()
+{
+    uint64_t seed = atomic_load_explicit(&g_random_seed, memory_order_relaxed);
+    uint64_t next;
+    do
+        next = rr_get_hash(seed);
+    while (!atomic_compare_exchange_weak_explicit(
+        &g_random_seed, &seed, next, memory_order_relaxed,
+        memory_order_relaxed));
+    return next;
+}
 
 void rr_encrypt(uint8_t *start, uint64_t size, uint64_t key)
 {
-    uint8_t *clone = malloc(size);
-    memcpy(clone, start, size);
     uint64_t cipher_key[4];
     // idk what the nonce is for but it gets initialized with random bytes
     uint32_t nonce[3];
@@ -180,9 +294,10 @@ void rr_encrypt(uint8_t *start, uint64_t size, uint64_t key)
         nonce[i] = key = rr_get_hash(rr_get_hash(key));
     counter = rr_get_hash(key);
 
-    ChaCha20XOR((uint8_t *)cipher_key, counter, (uint8_t *)nonce, clone, start,
-                size);
-    free(clone);
+    uint32_t state[16];
+    chacha20_init_state(state, (uint8_t *)cipher_key, counter,
+                        (uint8_t *)nonce);
+    chacha20_xor(state, start, size);
 }
 
 void rr_decrypt(uint8_t *start, uint64_t size, uint64_t key)
@@ -27,7 +27,6 @@ typedef uint32_t EntityHash;
 
 #define RR_MAX_CLIENT_COUNT (64)
 #define RR_SQUAD_COUNT (RR_MAX_CLIENT_COUNT)
-#define RR_MAX_COLLISION_COUNT (256)
 
 #define RR_MAX_SLOT_COUNT (12)
 
@@ -52,6 +52,29 @@ void __rr_simulation_pending_deletion_free_components(uint64_t i,
 #undef XX
 }
 
+#define XX(COMPONENT, ID)                                                      \
+    static uint8_t COMPONENT##_vector_contains(struct rr_simulation *this,     \
+                                               EntityIdx entity)               \
+    {                                                                          \
+        EntityIdx pos = this->COMPONENT##_index[entity];                       \
+        return pos < this->COMPONENT##_count &&                                \
+               this->COMPONENT##_vector[pos] == entity;                        \
+    }                                                                          \
+                                                                               \
+    static void COMPONENT##_vector_remove(struct rr_simulation *this,          \
+                                          EntityIdx entity)                    \
+    {                                                                          \
+        if (!COMPONENT##_vector_contains(this, entity))                        \
+            return;                                                            \
+        EntityIdx pos = this->COMPONENT##_index[entity];                       \
+        EntityIdx last =                                                       \
+            this->COMPONENT##_vector[--this->COMPONENT##_count];               \
+        this->COMPONENT##_vector[pos] = last;                                  \
+        this->COMPONENT##_index[last] = pos;                                   \
+    }
+RR_FOR_EACH_COMPONENT;
+#undef XX
+
 void __rr_simulation_pending_deletion_unset_entity(uint64_t i, void *captures)
 {
     struct rr_simulation *this = captures;
@@ -60,24 +83,12 @@ void __rr_simulation_pending_deletion_unset_entity(uint64_t i, void *captures)
     RR_SERVER_ONLY(printf("<rr_simulation::deletion::%lu>\n", i);)
 #endif
 
-    this->entity_tracker[(EntityIdx)i] = 0;
-}
-
-void rr_simulation_create_component_vectors(struct rr_simulation *this)
-{
-#define XX(COMPONENT, ID) this->COMPONENT##_count = 0;
-    RR_FOR_EACH_COMPONENT;
-#undef XX
-    for (EntityIdx entity = 1; entity < RR_MAX_ENTITY_COUNT; ++entity)
-    {
-        if (!(this->entity_tracker[entity] & 1))
-            continue;
 #define XX(COMPONENT, ID)                                                      \
-    if (this->entity_tracker[entity] & (1 << ID))                              \
-        this->COMPONENT##_vector[this->COMPONENT##_count++] = entity;
-        RR_FOR_EACH_COMPONENT;
+    if (this->entity_tracker[(EntityIdx)i] & (1 << ID))                        \
+        COMPONENT##_vector_remove(this, i);
+    RR_FOR_EACH_COMPONENT;
 #undef XX
-    }
+    this->entity_tracker[(EntityIdx)i] = 0;
 }
 
 void rr_simulation_for_each_entity(struct rr_simulation *this,
@@ -114,7 +125,11 @@ void rr_simulation_for_each_entity(struct rr_simulation *this,
         rr_component_##COMPONENT##_init(&this->COMPONENT##_components[entity], \
                                         this);                                 \
         this->COMPONENT##_components[entity].parent_id = entity;               \
-        this->COMPONENT##_vector[this->COMPONENT##_count++] = entity;          \
+        if (!COMPONENT##_vector_contains(this, entity))                        \
+        {                                                                      \
+            this->COMPONENT##_index[entity] = this->COMPONENT##_count;         \
+            this->COMPONENT##_vector[this->COMPONENT##_count++] = entity;      \
+        }                                                                      \
         return rr_simulation_get_##COMPONENT(this, entity);                    \
     }                                                                          \
     struct rr_component_##COMPONENT *rr_simulation_get_##COMPONENT(            \
@@ -33,7 +33,10 @@
 #include <Shared/Utilities.h>
 
 #ifdef RR_SERVER
+#include <Server/ContactPool.h>
+#include <Server/MazeInfluence.h>
 #include <Shared/Vector.h>
+struct rr_scheduler;
 struct rr_spatial_hash;
 #endif
 
@@ -87,18 +90,49 @@ struct rr_simulation
     uint8_t pending_deletions[RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT)];
     RR_SERVER_ONLY(
         uint8_t deleted_last_tick[RR_BITSET_ROUND(RR_MAX_ENTITY_COUNT)];)
+    // ring of ids that are out of quarantine, ids past the high water mark
+    // have never been used
+    RR_SERVER_ONLY(EntityIdx free_entities[RR_MAX_ENTITY_COUNT];)
+    RR_SERVER_ONLY(uint16_t free_entities_start;)
+    RR_SERVER_ONLY(uint16_t free_entities_count;)
+    RR_SERVER_ONLY(uint16_t entity_high_water_mark;)
 
+    // COMPONENT##_vector is a sparse set: entities with the component are
+    // packed in [0, count), COMPONENT##_index maps an entity to its position
 #define XX(COMPONENT, ID)                                                      \
     struct rr_component_##COMPONENT                                            \
         COMPONENT##_components[RR_MAX_ENTITY_COUNT];                           \
     EntityIdx COMPONENT##_vector[RR_MAX_ENTITY_COUNT];                         \
+    EntityIdx COMPONENT##_index[RR_MAX_ENTITY_COUNT];                          \
     EntityIdx COMPONENT##_count;
     RR_FOR_EACH_COMPONENT;
 #undef XX
     RR_SERVER_ONLY(struct rr_simulation_animation animations[16384];)
     RR_SERVER_ONLY(uint32_t animation_length;)
     RR_SERVER_ONLY(struct rr_server *server;)
+    RR_SERVER_ONLY(struct rr_scheduler *scheduler;)
+    // spawning writes to the grids, so every simulation has its own copy
+    RR_SERVER_ONLY(struct rr_maze_declaration mazes[rr_biome_id_max];)
+    // zone of mobs that weren't spawned by the maze
+    RR_SERVER_ONLY(struct rr_maze_grid default_grid;)
+    // flowers in range of the cells of arena 1, which is the one that spawns
+    RR_SERVER_ONLY(struct rr_maze_influence maze_influence;)
+    // what collision detection found touching this tick
+    RR_SERVER_ONLY(struct rr_contact_pool contacts;)
+    // ai level of detail. an interval of 1 and freezing turned off run every
+    // mob every tick
+    RR_SERVER_ONLY(uint32_t ai_lod_interval;)
+    RR_SERVER_ONLY(uint8_t ai_lod_freeze;)
+    RR_SERVER_ONLY(uint32_t ai_tick;)
+    // mobs in each tier on the last ai tick
+    RR_SERVER_ONLY(uint32_t ai_lod_counts[rr_ai_lod_max];)
     RR_CLIENT_ONLY(uint8_t updated_this_tick;)
+    // server tick of the newest update and the one entities are drawn at,
+    // trailing it by RR_INTERPOLATION_DELAY_TICKS
+    RR_CLIENT_ONLY(uint32_t latest_tick;)
+    RR_CLIENT_ONLY(double render_tick;)
+    // updates that came in after the render clock had already run past them
+    RR_CLIENT_ONLY(uint32_t late_updates;)
     uint8_t game_over;
 };
 
@@ -107,7 +141,6 @@ int rr_simulation_has_entity(struct rr_simulation *, EntityIdx);
 void rr_simulation_request_entity_deletion(struct rr_simulation *, EntityIdx);
 void rr_simulation_for_each_entity(struct rr_simulation *, void *,
                                    void (*)(EntityIdx, void *));
-void rr_simulation_create_component_vectors(struct rr_simulation *);
 
 // internal use
 void __rr_simulation_pending_deletion_free_components(uint64_t, void *);
@@ -21,6 +21,11 @@
 
 #include <Shared/Utilities.h>
 
+#ifdef RR_SERVER
+#include <Server/MazeCollision.h>
+#include <Server/Waves.h>
+#endif
+
 // clang-format off
 struct rr_petal_base_stat_scale const offensive[rr_rarity_id_max] = {
     {1.0,      1.0      },
@@ -549,6 +554,10 @@ void rr_static_data_init()
     init_game_coefficients();
     init(HELL_CREEK);
     init(BURROW);
+#ifdef RR_SERVER
+    rr_spawn_tables_init();
+    rr_maze_collision_init();
+#endif
 #ifdef RR_SERVER
     print_chances(1);   // c
     print_chances(4);   // C